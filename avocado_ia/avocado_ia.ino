@@ -1,13 +1,33 @@
 #include "esp_camera.h"
+#include "esp_jpg_decode.h"
 #include "modelo.h"
+#include "preprocesado.h"
+#include "operaciones.h"
+#include "enlace_nodo.h"
+#include "suavizado.h"
+
+// Con AVOCADO_ESP_NN=1 se compila contra esp-tflite-micro (componente de
+// ESP-IDF) en lugar de la librería de Arduino: sus kernels int8 de Conv2D,
+// DepthwiseConv2D, FullyConnected y pooling usan ESP-NN con las
+// instrucciones vectoriales del ESP32-S3
+#ifndef AVOCADO_ESP_NN
+#define AVOCADO_ESP_NN 0
+#endif
+
+#if AVOCADO_ESP_NN
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#else
 #include <TensorFlowLite_ESP32.h>
-#include "tensorflow/lite/micro/all_ops_resolver.h"
 #include "tensorflow/lite/micro/micro_error_reporter.h"
 #include "tensorflow/lite/micro/micro_interpreter.h"
+#endif
 #include "tensorflow/lite/schema/schema_generated.h"
 #include "esp_heap_caps.h"
 #include "esp_timer.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
 
 // Pines para la cámara
 #define PWDN_GPIO_NUM -1
@@ -28,22 +48,115 @@
 #define PCLK_GPIO_NUM 13
 
 #define OUTPUT_PIN D6      // Pin de salida GPIO para enviar datos (HIGH o LOW)
-#define CAPTURE_INTERVAL 10000 // Intervalo de captura de 10 segundos
+#define CAPTURE_INTERVAL 1000 // Intervalo de captura de 1 segundo
+
+// UART con el nodo sensor: cada solicitud dispara una captura inmediata
+#define LINK_BAUD 115200
+#define LINK_RX_PIN D4
+#define LINK_TX_PIN D5
+
+// Captura y preprocesado en un núcleo, inferencia en el otro; se alternan dos
+// buffers de entrada para que ambas etapas trabajen a la vez
+#define NUM_INPUT_BUFFERS 2
+#define CAPTURE_CORE 0
+#define INFERENCE_CORE 1
+#define CAPTURE_STACK_SIZE 6144
+#define INFERENCE_STACK_SIZE 8192
+
+// Si la escena apenas cambia respecto al último cuadro inferido se omite la
+// decodificación completa y la inferencia. El umbral es la diferencia media de
+// la miniatura en décimas de nivel de gris; pasado MAX_STALENESS_MS se infiere
+// igualmente para no arrastrar un resultado viejo.
+#ifndef CHANGE_THRESHOLD
+#define CHANGE_THRESHOLD 40
+#endif
+#ifndef MAX_STALENESS_MS
+#define MAX_STALENESS_MS 60000
+#endif
 
 // Variables de TensorFlow Lite
 namespace {
+#if !AVOCADO_ESP_NN
 tflite::ErrorReporter* error_reporter = nullptr;
+#endif
 const tflite::Model* model = nullptr;
 tflite::MicroInterpreter* interpreter = nullptr;
 TfLiteTensor* input = nullptr;
 TfLiteTensor* output = nullptr;
 }
 
-constexpr int kTensorArenaSize = 128 * 1024;
+// La arena se dimensiona con lo que realmente usa el modelo. Si se define
+// TENSOR_ARENA_SIZE (p. ej. con el arena_used_bytes() que informa el banco de
+// pruebas) se usa ese valor; si no, se mide al arrancar con una arena de
+// prueba de kTensorArenaMaxSize en PSRAM.
+constexpr size_t kTensorArenaMaxSize = 128 * 1024;
+constexpr size_t kTensorArenaMargin = 2 * 1024;   // Holgura sobre lo medido
 uint8_t* tensor_arena = nullptr;
+size_t tensor_arena_size = 0;
+bool tensor_arena_internal = false;
+
+#if AVOCADO_ESP_NN
+#define INTERPRETER_ARGS(arena, size) model, resolver, arena, size
+#else
+#define INTERPRETER_ARGS(arena, size) model, resolver, arena, size, error_reporter
+#endif
 
 static const char* TAG = "Detector";
-unsigned long lastCaptureTime = 0;
+
+// Marcas de tiempo de cada etapa de un cuadro (esp_timer, microsegundos)
+struct FrameTiming {
+  uint32_t frame;
+  int64_t start_us;
+  int64_t captured_us;
+  int64_t decoded_us;
+  int64_t ready_us;
+};
+
+struct InputBuffer {
+  int8_t data[MODEL_WIDTH * MODEL_HEIGHT];
+  FrameTiming timing;
+};
+
+// Todos los buffers se reservan una sola vez; nada se asigna por cuadro
+static InputBuffer input_buffers[NUM_INPUT_BUFFERS];
+alignas(4) static uint8_t luma_buf[LUMA_WIDTH * LUMA_HEIGHT];
+static QueueHandle_t free_buffers = nullptr;    // Índices listos para llenar
+static QueueHandle_t ready_buffers = nullptr;   // Índices listos para inferir
+
+// Detección de cambios: solo la usa la tarea de captura
+static uint8_t thumb_source[THUMB_SOURCE_WIDTH * THUMB_SOURCE_HEIGHT];
+static uint8_t thumb[THUMB_WIDTH * THUMB_HEIGHT];
+static uint8_t thumb_reference[THUMB_WIDTH * THUMB_HEIGHT]; // Último cuadro inferido
+static bool has_reference = false;
+static int64_t reference_us = 0;
+static uint32_t last_mad = 0;
+static uint32_t frames_inferred = 0;
+static uint32_t frames_skipped = 0;
+
+// Solicitud del nodo pendiente de respuesta; la escribe la recepción del UART
+// y la consume la tarea de inferencia
+static portMUX_TYPE request_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool request_pending = false;
+static uint16_t request_seq = 0;
+static int64_t request_us = 0;
+static TaskHandle_t capture_task = nullptr;
+
+// Posprocesado de la clasificación; lo actualiza la tarea de inferencia y lo
+// reconfigura la consola por USB
+static portMUX_TYPE filter_lock = portMUX_INITIALIZER_UNLOCKED;
+static StressFilter stress_filter;
+
+// Último resultado de la inferencia, para responder sin volver a inferir
+// mientras la escena no cambia. Protegido por request_lock.
+static LinkResult last_result;
+static bool has_last_result = false;
+
+struct LumaDecoder {
+  const camera_fb_t* fb;
+  uint8_t* dst;
+  uint16_t width;
+  uint16_t height;
+};
 
 // Inicialización de la cámara
 bool initCamera() {
@@ -82,31 +195,69 @@ bool initCamera() {
 }
 
 // Inicialización de TensorFlow Lite
+// Bytes de arena que necesita el modelo, midiendo con una arena de prueba
+static size_t measureArena(const AvocadoOpResolver& resolver) {
+#ifdef TENSOR_ARENA_SIZE
+  (void)resolver;
+  return TENSOR_ARENA_SIZE;
+#else
+  uint8_t* probe = (uint8_t*)heap_caps_malloc(kTensorArenaMaxSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!probe) {
+    return 0;
+  }
+
+  size_t used = 0;
+  {
+    tflite::MicroInterpreter probe_interpreter(INTERPRETER_ARGS(probe, kTensorArenaMaxSize));
+    if (probe_interpreter.AllocateTensors() == kTfLiteOk) {
+      used = probe_interpreter.arena_used_bytes();
+    }
+  }
+  heap_caps_free(probe);
+  return used;
+#endif
+}
+
+// Reserva la arena en SRAM interna (los accesos de Conv2D no pagan la
+// latencia de la PSRAM) y solo si no cabe recurre a la PSRAM. Los pesos del
+// modelo se quedan en flash, leídos en sitio desde model_tflite.
+static bool allocateArena(size_t used) {
+  tensor_arena_size = (used + kTensorArenaMargin + 15) & ~(size_t)15;
+
+  tensor_arena = (uint8_t*)heap_caps_aligned_alloc(16, tensor_arena_size,
+                                                   MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  tensor_arena_internal = (tensor_arena != nullptr);
+  if (!tensor_arena) {
+    ESP_LOGW(TAG, "Arena of %u bytes does not fit in internal SRAM, using PSRAM",
+             (unsigned)tensor_arena_size);
+    tensor_arena = (uint8_t*)heap_caps_aligned_alloc(16, tensor_arena_size,
+                                                     MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  }
+  return tensor_arena != nullptr;
+}
+
 bool initTensorFlow() {
+#if !AVOCADO_ESP_NN
   static tflite::MicroErrorReporter micro_error_reporter;
   error_reporter = &micro_error_reporter;
+#endif
 
   model = tflite::GetModel(model_tflite);
   if (model->version() != TFLITE_SCHEMA_VERSION) {
     return false;
   }
 
-  static tflite::MicroMutableOpResolver<12> resolver;
-  resolver.AddQuantize();
-  resolver.AddConv2D();
-  resolver.AddDepthwiseConv2D();
-  resolver.AddPad();
-  resolver.AddLogistic();
-  resolver.AddShape();
-  resolver.AddStridedSlice();
-  resolver.AddPack();
-  resolver.AddReshape();
-  resolver.AddFullyConnected();
-  resolver.AddDequantize();
-  resolver.AddAveragePool2D();
+  static AvocadoOpResolver resolver;
+  registerOps(resolver);
+
+  size_t used = measureArena(resolver);
+  if (used == 0 || !allocateArena(used)) {
+    ESP_LOGE(TAG, "Failed to allocate tensor arena");
+    return false;
+  }
 
   static tflite::MicroInterpreter static_interpreter(
-    model, resolver, tensor_arena, kTensorArenaSize, error_reporter);
+    INTERPRETER_ARGS(tensor_arena, tensor_arena_size));
   interpreter = &static_interpreter;
 
   TfLiteStatus allocate_status = interpreter->AllocateTensors();
@@ -117,72 +268,318 @@ bool initTensorFlow() {
   input = interpreter->input(0);
   output = interpreter->output(0);
 
-  return (input != nullptr && output != nullptr);
+  return (input != nullptr && output != nullptr &&
+          input->bytes == MODEL_WIDTH * MODEL_HEIGHT);
+}
+
+// Inferencia de prueba con la entrada vacía para informar del tiempo real en
+// este dispositivo antes de empezar a capturar
+static void reportInferenceTime() {
+  memset(input->data.int8, -128, input->bytes);
+  interpreter->Invoke();   // La primera ejecución incluye inicializaciones
+
+  int64_t start_us = esp_timer_get_time();
+  TfLiteStatus status = interpreter->Invoke();
+  int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+  Serial.printf("Arena: %u bytes en %s (%u usados), kernels %s\n",
+                (unsigned)tensor_arena_size, tensor_arena_internal ? "SRAM interna" : "PSRAM",
+                (unsigned)interpreter->arena_used_bytes(),
+                AVOCADO_ESP_NN ? "ESP-NN" : "de referencia");
+  Serial.printf("Tiempo de inferencia: %lld us%s\n", elapsed_us,
+                status == kTfLiteOk ? "" : " (Invoke falló)");
+  if (elapsed_us > CAPTURE_INTERVAL * 1000LL) {
+    ESP_LOGW(TAG, "Inference is slower than the capture interval (%d ms)", CAPTURE_INTERVAL);
+  }
 }
 
 // Función para enviar datos al GPIO y mostrar en serial
-void sendResults(float good_prob, float bad_prob) {
-  String result = (good_prob > bad_prob) ? "01" : "00";
+void sendResults(bool stressed, uint16_t score_pm, bool changed) {
+  // HIGH para "01" (sin estrés) y LOW para "00"
+  digitalWrite(OUTPUT_PIN, stressed ? LOW : HIGH);
+  Serial.printf("Resultado: %s, estrés suavizado %u.%u%%\n",
+                stressed ? "Con estrés hídrico (00)" : "Sin estrés hídrico (01)",
+                score_pm / 10, score_pm % 10);
+  if (changed) {
+    ESP_LOGI(TAG, "Enviado: %s", stressed ? "00 (LOW)" : "01 (HIGH)");
+  }
+}
+
+// Lector para el decodificador JPEG: copia desde el frame buffer de la cámara
+static size_t readJpeg(void* arg, size_t index, uint8_t* buf, size_t len) {
+  LumaDecoder* dec = (LumaDecoder*)arg;
+  if (index + len > dec->fb->len) {
+    len = dec->fb->len - index;
+  }
+  if (buf) {
+    memcpy(buf, dec->fb->buf + index, len);
+  }
+  return len;
+}
+
+// Escritor para el decodificador JPEG: recibe bloques RGB888 y guarda solo la
+// luminancia
+static bool writeLuma(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t* data) {
+  LumaDecoder* dec = (LumaDecoder*)arg;
+  if (!data) {
+    // Llamada de inicio (x = y = 0 con el tamaño de salida) o de fin
+    return !(x == 0 && y == 0) || (w == dec->width && h == dec->height);
+  }
+  if (x + w > dec->width || y + h > dec->height) {
+    return false;
+  }
 
-  // Enviar HIGH para "01" y LOW para "00"
-  if (result == "01") {
-    digitalWrite(OUTPUT_PIN, HIGH);
-    Serial.println("Resultado: Sin estrés hídrico (01)");
-    ESP_LOGI(TAG, "Enviado: 01 (HIGH)");
-  } else {
-    digitalWrite(OUTPUT_PIN, LOW);
-    Serial.println("Resultado: Con estrés hídrico (00)");
-    ESP_LOGI(TAG, "Enviado: 00 (LOW)");
+  for (uint16_t row = 0; row < h; row++, data += w * 3) {
+    rgbToLuma(data, dec->dst + (y + row) * dec->width + x, w);
   }
+  return true;
+}
+
+// Decodifica el JPEG VGA a la escala indicada (1/4 da 160x120) en grises
+static bool decodeLuma(const camera_fb_t* fb, jpg_scale_t scale, uint8_t* dst,
+                       uint16_t width, uint16_t height) {
+  if (!fb || fb->format != PIXFORMAT_JPEG) return false;
+
+  LumaDecoder dec = { fb, dst, width, height };
+  return esp_jpg_decode(fb->len, scale, readJpeg, writeLuma, &dec) == ESP_OK;
 }
 
-// Procesar imagen capturada y realizar inferencia
-void processImage(camera_fb_t* fb) {
-  if (!fb || fb->format != PIXFORMAT_JPEG) return;
+// Compara la miniatura del cuadro con la del último inferido. La miniatura sale
+// de decodificar a 1/8, que solo usa los coeficientes DC y cuesta mucho menos
+// que la decodificación a 1/4 que necesita el modelo.
+static bool sceneChanged(const camera_fb_t* fb, int64_t now_us) {
+  if (!decodeLuma(fb, JPG_SCALE_8X, thumb_source, THUMB_SOURCE_WIDTH, THUMB_SOURCE_HEIGHT)) {
+    return true;
+  }
+  makeThumbnail(thumb_source, thumb);
+  if (!has_reference || now_us - reference_us >= MAX_STALENESS_MS * 1000LL) {
+    return true;
+  }
+  last_mad = thumbnailMad(thumb, thumb_reference);
+  return last_mad >= CHANGE_THRESHOLD;
+}
 
-  Serial.println("Procesando imagen...");
-  uint8_t* rgb_buf = (uint8_t*)heap_caps_malloc(fb->width * fb->height * 3, MALLOC_CAP_SPIRAM);
-  if (!rgb_buf) {
-    ESP_LOGE(TAG, "RGB buffer allocation failed");
+// Responde a la solicitud pendiente solo con un cuadro capturado después de
+// recibirla, para que el resultado nunca sea anterior a la petición
+static void answerRequest(const FrameTiming& timing, uint16_t good_pm, uint16_t bad_pm,
+                          uint32_t inference_us) {
+  bool answer = false;
+  LinkResult result;
+  result.frame = timing.frame;
+  result.good_pm = good_pm;
+  result.bad_pm = bad_pm;
+  result.inference_us = inference_us;
+
+  portENTER_CRITICAL(&request_lock);
+  last_result = result;
+  has_last_result = true;
+  if (request_pending && timing.start_us >= request_us) {
+    answer = true;
+    result.request_seq = request_seq;
+    request_pending = false;
+  }
+  portEXIT_CRITICAL(&request_lock);
+  if (!answer) {
     return;
   }
 
-  bool converted = fmt2rgb888(fb->buf, fb->len, PIXFORMAT_JPEG, rgb_buf);
-  if (!converted) {
-    free(rgb_buf);
+  uint8_t frame[LINK_MAX_FRAME];
+  Serial1.write(frame, linkEncodeResult(result, frame));
+}
+
+// Responde con el último resultado cuando el cuadro capturado tras la solicitud
+// no ha cambiado lo bastante para volver a inferir
+static void answerFromCache(int64_t start_us) {
+  bool answer = false;
+  LinkResult result;
+
+  portENTER_CRITICAL(&request_lock);
+  if (request_pending && has_last_result && start_us >= request_us) {
+    answer = true;
+    result = last_result;
+    result.request_seq = request_seq;
+    request_pending = false;
+  }
+  portEXIT_CRITICAL(&request_lock);
+  if (!answer) {
     return;
   }
 
-  for (int i = 0; i < 96 * 96 && i < input->bytes; i++) {
-    int y = i / 96;
-    int x = i % 96;
-    int src_x = x * fb->width / 96;
-    int src_y = y * fb->height / 96;
-    int src_idx = (src_y * fb->width + src_x) * 3;
+  uint8_t frame[LINK_MAX_FRAME];
+  Serial1.write(frame, linkEncodeResult(result, frame));
+}
+
+// Tarea de captura: obtiene un cuadro, lo preprocesa en un buffer libre y lo
+// entrega a la tarea de inferencia
+static void captureTask(void* arg) {
+  (void)arg;
+  uint32_t frame = 0;
+
+  for (;;) {
+    uint8_t index;
+    xQueueReceive(free_buffers, &index, portMAX_DELAY);
+    InputBuffer* buf = &input_buffers[index];
+
+    buf->timing.frame = frame++;
+    buf->timing.start_us = esp_timer_get_time();
+    camera_fb_t* fb = esp_camera_fb_get();
+    buf->timing.captured_us = esp_timer_get_time();
+
+    bool changed = sceneChanged(fb, buf->timing.start_us);
+    bool decoded = changed && decodeLuma(fb, JPG_SCALE_4X, luma_buf, LUMA_WIDTH, LUMA_HEIGHT);
+    if (fb) {
+      esp_camera_fb_return(fb);
+    }
+    buf->timing.decoded_us = esp_timer_get_time();
+
+    if (fb && !changed) {
+      frames_skipped++;
+      Serial.printf("Cuadro %u omitido: diferencia %u.%u, inferidos %u, omitidos %u\n",
+                    (unsigned)buf->timing.frame, (unsigned)(last_mad / 10),
+                    (unsigned)(last_mad % 10), (unsigned)frames_inferred,
+                    (unsigned)frames_skipped);
+      answerFromCache(buf->timing.start_us);
+      xQueueSend(free_buffers, &index, portMAX_DELAY);
+    } else if (decoded) {
+      memcpy(thumb_reference, thumb, sizeof(thumb));
+      has_reference = true;
+      reference_us = buf->timing.start_us;
+      frames_inferred++;
+      downscaleToInput(luma_buf, buf->data);
+      buf->timing.ready_us = esp_timer_get_time();
+      xQueueSend(ready_buffers, &index, portMAX_DELAY);
+    } else {
+      ESP_LOGE(TAG, "Capture or JPEG decode failed");
+      xQueueSend(free_buffers, &index, portMAX_DELAY);
+    }
 
-    uint8_t gray = (rgb_buf[src_idx] * 0.299 + rgb_buf[src_idx + 1] * 0.587 + rgb_buf[src_idx + 2] * 0.114);
-    input->data.int8[i] = static_cast<int8_t>(gray - 127);
+    // Espera al siguiente intervalo o a una solicitud del nodo
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CAPTURE_INTERVAL));
   }
+}
 
-  if (interpreter->Invoke() == kTfLiteOk) {
-    float bad_prob = (output->data.int8[0] + 128) / 255.0f * 100;
-    float good_prob = (output->data.int8[1] + 128) / 255.0f * 100;
+// Recepción del UART: una solicitud válida queda pendiente y despierta a la
+// tarea de captura
+static void onLinkReceive() {
+  uint16_t seq;
+  while (Serial1.available()) {
+    if (linkFeed(Serial1.read(), &seq)) {
+      portENTER_CRITICAL(&request_lock);
+      request_pending = true;
+      request_seq = seq;
+      request_us = esp_timer_get_time();
+      portEXIT_CRITICAL(&request_lock);
+      xTaskNotifyGive(capture_task);
+    }
+  }
+}
 
-    Serial.print("Probabilidad de Sin Estrés: ");
-    Serial.print(good_prob);
-    Serial.print("%, Estrés: ");
-    Serial.print(bad_prob);
-    Serial.println("%");
+// Tarea de inferencia: copia la entrada al tensor, libera el buffer para la
+// siguiente captura y ejecuta el modelo
+static void inferenceTask(void* arg) {
+  (void)arg;
+
+  for (;;) {
+    uint8_t index;
+    xQueueReceive(ready_buffers, &index, portMAX_DELAY);
+    InputBuffer* buf = &input_buffers[index];
+
+    int64_t dequeued_us = esp_timer_get_time();
+    memcpy(input->data.int8, buf->data, sizeof(buf->data));
+    FrameTiming timing = buf->timing;
+    xQueueSend(free_buffers, &index, portMAX_DELAY);
+
+    int64_t invoke_start_us = esp_timer_get_time();
+    TfLiteStatus status = interpreter->Invoke();
+    int64_t done_us = esp_timer_get_time();
+
+    if (status == kTfLiteOk) {
+      float bad_prob = (output->data.int8[0] + 128) / 255.0f * 100;
+      float good_prob = (output->data.int8[1] + 128) / 255.0f * 100;
+
+      Serial.print("Probabilidad de Sin Estrés: ");
+      Serial.print(good_prob);
+      Serial.print("%, Estrés: ");
+      Serial.print(bad_prob);
+      Serial.println("%");
+
+      // El GPIO y el nodo reciben la clasificación suavizada, no la del cuadro
+      uint16_t bad_pm = (output->data.int8[0] + 128) * 1000 / 255;
+      portENTER_CRITICAL(&filter_lock);
+      bool changed = filterUpdate(&stress_filter, bad_pm, millis());
+      bool stressed = stress_filter.stressed;
+      uint16_t score_pm = stress_filter.score_pm;
+      portEXIT_CRITICAL(&filter_lock);
+
+      sendResults(stressed, score_pm, changed); // Enviar resultado al GPIO
+      answerRequest(timing, 1000 - score_pm, score_pm, done_us - invoke_start_us);
+    } else {
+      ESP_LOGE(TAG, "Invoke failed");
+    }
 
-    sendResults(good_prob, bad_prob); // Enviar resultado al GPIO
+    Serial.printf("Cuadro %u: captura %lld us, decodificación %lld us, escalado %lld us, "
+                  "cola %lld us, inferencia %lld us, total %lld us\n",
+                  (unsigned)timing.frame,
+                  timing.captured_us - timing.start_us,
+                  timing.decoded_us - timing.captured_us,
+                  timing.ready_us - timing.decoded_us,
+                  dequeued_us - timing.ready_us,
+                  done_us - invoke_start_us,
+                  done_us - timing.start_us);
   }
+}
 
-  free(rgb_buf);
+static void printFilter() {
+  portENTER_CRITICAL(&filter_lock);
+  StressFilter filter = stress_filter;
+  portEXIT_CRITICAL(&filter_lock);
+
+  Serial.printf("filtro modo=%s alfa=%u ventana=%u entrada=%u salida=%u permanencia=%u\n",
+                filter.config.mode == FILTER_EMA ? "ema" : "voto",
+                filter.config.alpha_pm, filter.config.window, filter.config.enter_pm,
+                filter.config.exit_pm, (unsigned)filter.config.min_dwell_ms);
+  Serial.printf("estado: %s, puntuación %u ‰, %u cambios\n",
+                filter.stressed ? "estrés" : "sin estrés", filter.score_pm,
+                (unsigned)filter.transitions);
+}
+
+// Órdenes de la consola por USB:
+//   filtro [clave=valor ...]  muestra o cambia el posprocesado
+//   cuadros                   cuadros inferidos y omitidos
+static void handleCommand(char* line) {
+  char* args = strchr(line, ' ');
+  if (args) {
+    *args++ = '\0';
+  }
+
+  if (strcmp(line, "filtro") == 0) {
+    if (args) {
+      portENTER_CRITICAL(&filter_lock);
+      bool ok = filterConfigure(&stress_filter, args);
+      portEXIT_CRITICAL(&filter_lock);
+      if (!ok) {
+        Serial.println("Uso: filtro [modo=ema|voto] [alfa=1..1000] [ventana=1..16] "
+                       "[entrada=‰] [salida=‰] [permanencia=ms], con salida < entrada");
+        return;
+      }
+    }
+    printFilter();
+  } else if (strcmp(line, "cuadros") == 0) {
+    Serial.printf("inferidos %u, omitidos %u\n", (unsigned)frames_inferred,
+                  (unsigned)frames_skipped);
+  } else if (line[0] != '\0') {
+    Serial.println("Órdenes: filtro [clave=valor ...], cuadros");
+  }
 }
 
 void setup() {
   Serial.begin(115200);
   pinMode(OUTPUT_PIN, OUTPUT); // Configurar el pin como salida
+  digitalWrite(OUTPUT_PIN, HIGH);
+
+  FilterConfig filter_config;
+  filterDefaults(&filter_config);
+  filterInit(&stress_filter, filter_config, millis());
 
   setCpuFrequencyMhz(240);
 
@@ -191,35 +588,51 @@ void setup() {
     return;
   }
 
-  tensor_arena = (uint8_t*)heap_caps_malloc(kTensorArenaSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-  if (!tensor_arena) {
-    ESP_LOGE(TAG, "Failed to allocate tensor arena");
+  if (!initPreprocessing() || !initCamera() || !initTensorFlow()) {
+    ESP_LOGE(TAG, "Init failed!");
     return;
   }
 
-  if (!initCamera() || !initTensorFlow()) {
-    ESP_LOGE(TAG, "Init failed!");
+  reportInferenceTime();
+
+  free_buffers = xQueueCreate(NUM_INPUT_BUFFERS, sizeof(uint8_t));
+  ready_buffers = xQueueCreate(NUM_INPUT_BUFFERS, sizeof(uint8_t));
+  if (!free_buffers || !ready_buffers) {
+    ESP_LOGE(TAG, "Failed to create pipeline queues");
     return;
   }
+  for (uint8_t i = 0; i < NUM_INPUT_BUFFERS; i++) {
+    xQueueSend(free_buffers, &i, 0);
+  }
+
+  xTaskCreatePinnedToCore(inferenceTask, "inferencia", INFERENCE_STACK_SIZE, nullptr,
+                          configMAX_PRIORITIES - 2, nullptr, INFERENCE_CORE);
+  xTaskCreatePinnedToCore(captureTask, "captura", CAPTURE_STACK_SIZE, nullptr,
+                          configMAX_PRIORITIES - 3, &capture_task, CAPTURE_CORE);
+
+  Serial1.begin(LINK_BAUD, SERIAL_8N1, LINK_RX_PIN, LINK_TX_PIN);
+  Serial1.onReceive(onLinkReceive);
 
   Serial.println("Sistema iniciado correctamente. Capturando imagen...");
-  camera_fb_t* fb = esp_camera_fb_get();
-  if (fb) {
-    processImage(fb);
-    esp_camera_fb_return(fb);
-  }
 }
 
 void loop() {
-  unsigned long currentTime = millis();
-  if (currentTime - lastCaptureTime >= CAPTURE_INTERVAL) {
-    Serial.println("Capturando imagen...");
-    camera_fb_t* fb = esp_camera_fb_get();
-    if (fb) {
-      processImage(fb);
-      esp_camera_fb_return(fb);
+  // Captura e inferencia van en sus tareas; aquí solo se atiende la consola
+  static char line[96];
+  static size_t length = 0;
+
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c == '\r') {
+      continue;
+    }
+    if (c == '\n') {
+      line[length] = '\0';
+      handleCommand(line);
+      length = 0;
+    } else if (length < sizeof(line) - 1) {
+      line[length++] = c;
     }
-    lastCaptureTime = currentTime;
   }
-  delay(10);
-}
\ No newline at end of file
+  delay(50);
+}
@@ -0,0 +1,344 @@
+// Banco de pruebas en el PC para model.tflite: ejecuta el mismo preprocesado
+// (preprocesado.cpp) y las mismas operaciones (operaciones.h) que el firmware
+// sobre un directorio de imágenes JPEG etiquetadas y mide latencia por
+// operación, tiempo de Invoke(), uso de la arena y matriz de confusión.
+//
+// Uso: banco <modelo.tflite> [dir_imagenes] [--arena bytes] [--repeticiones n]
+//
+// dir_imagenes contiene un subdirectorio por clase (estres/, sin_estres/) con
+// capturas VGA en JPEG. Sin directorio solo se mide la latencia con una
+// entrada vacía.
+
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "operaciones.h"
+#include "preprocesado.h"
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/micro_profiler_interface.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+// Índice de salida del modelo de cada clase (igual que en avocado_ia.ino)
+static const char* const kClases[] = { "estres", "sin_estres" };
+constexpr int kNumClases = 2;
+
+constexpr size_t kArenaPorDefecto = 128 * 1024;
+
+static double microsegundos(Clock::duration d) {
+  return std::chrono::duration<double, std::micro>(d).count();
+}
+
+// Acumula el tiempo de cada operación por su nombre (CONV_2D, ...)
+class OpProfiler : public tflite::MicroProfilerInterface {
+ public:
+  struct Stat {
+    uint32_t llamadas = 0;
+    double total_us = 0;
+  };
+
+  uint32_t BeginEvent(const char* tag) override {
+    eventos_.push_back({ tag, Clock::now() });
+    return eventos_.size() - 1;
+  }
+
+  void EndEvent(uint32_t handle) override {
+    const Evento& e = eventos_[handle];
+    Stat& st = stats_[e.tag];
+    st.llamadas++;
+    st.total_us += microsegundos(Clock::now() - e.inicio);
+  }
+
+  void nuevaInvocacion() { eventos_.clear(); }
+
+  const std::map<std::string, Stat>& stats() const { return stats_; }
+
+ private:
+  struct Evento {
+    const char* tag;
+    Clock::time_point inicio;
+  };
+  std::vector<Evento> eventos_;
+  std::map<std::string, Stat> stats_;
+};
+
+struct ErrorJpeg {
+  jpeg_error_mgr mgr;
+  jmp_buf salto;
+};
+
+static void salirErrorJpeg(j_common_ptr cinfo) {
+  longjmp(reinterpret_cast<ErrorJpeg*>(cinfo->err)->salto, 1);
+}
+
+// Decodifica a 1/4 de escala y convierte a luminancia, como el firmware con
+// esp_jpg_decode; solo se aceptan capturas VGA (160x120 tras escalar)
+static bool decodeJpegLuma(const fs::path& ruta, uint8_t* luma) {
+  FILE* f = fopen(ruta.c_str(), "rb");
+  if (!f) {
+    return false;
+  }
+
+  jpeg_decompress_struct cinfo;
+  ErrorJpeg err;
+  cinfo.err = jpeg_std_error(&err.mgr);
+  err.mgr.error_exit = salirErrorJpeg;
+  if (setjmp(err.salto)) {
+    jpeg_destroy_decompress(&cinfo);
+    fclose(f);
+    return false;
+  }
+
+  jpeg_create_decompress(&cinfo);
+  jpeg_stdio_src(&cinfo, f);
+  jpeg_read_header(&cinfo, TRUE);
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = 4;
+  cinfo.out_color_space = JCS_RGB;
+  jpeg_start_decompress(&cinfo);
+
+  bool ok = (cinfo.output_width == LUMA_WIDTH && cinfo.output_height == LUMA_HEIGHT);
+  if (ok) {
+    std::vector<uint8_t> fila(LUMA_WIDTH * 3);
+    while (cinfo.output_scanline < cinfo.output_height) {
+      JSAMPROW p = fila.data();
+      uint8_t* dst = luma + cinfo.output_scanline * LUMA_WIDTH;
+      jpeg_read_scanlines(&cinfo, &p, 1);
+      rgbToLuma(fila.data(), dst, LUMA_WIDTH);
+    }
+    jpeg_finish_decompress(&cinfo);
+  } else {
+    jpeg_abort_decompress(&cinfo);
+  }
+
+  jpeg_destroy_decompress(&cinfo);
+  fclose(f);
+  return ok;
+}
+
+static bool leerArchivo(const char* ruta, std::vector<uint8_t>& datos) {
+  std::ifstream f(ruta, std::ios::binary);
+  if (!f) {
+    return false;
+  }
+  datos.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+  return !datos.empty();
+}
+
+static int claseDeDirectorio(const std::string& nombre) {
+  for (int i = 0; i < kNumClases; i++) {
+    if (nombre == kClases[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int main(int argc, char** argv) {
+  const char* ruta_modelo = nullptr;
+  const char* dir_imagenes = nullptr;
+  size_t tam_arena = kArenaPorDefecto;
+  int repeticiones = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc) {
+      tam_arena = strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--repeticiones") == 0 && i + 1 < argc) {
+      repeticiones = std::max(1, atoi(argv[++i]));
+    } else if (!ruta_modelo) {
+      ruta_modelo = argv[i];
+    } else if (!dir_imagenes) {
+      dir_imagenes = argv[i];
+    } else {
+      ruta_modelo = nullptr;
+      break;
+    }
+  }
+  if (!ruta_modelo) {
+    fprintf(stderr, "uso: %s <modelo.tflite> [dir_imagenes] [--arena bytes] [--repeticiones n]\n",
+            argv[0]);
+    return 2;
+  }
+
+  // El flatbuffer se lee tal cual; los tensores constantes se usan en sitio
+  std::vector<uint8_t> datos_modelo;
+  if (!leerArchivo(ruta_modelo, datos_modelo)) {
+    fprintf(stderr, "error: no se puede leer %s\n", ruta_modelo);
+    return 1;
+  }
+  const tflite::Model* model = tflite::GetModel(datos_modelo.data());
+  if (model->version() != TFLITE_SCHEMA_VERSION) {
+    fprintf(stderr, "error: versión de esquema %u no soportada\n", (unsigned)model->version());
+    return 1;
+  }
+
+  if (!initPreprocessing()) {
+    fprintf(stderr, "error: geometría de preprocesado no soportada\n");
+    return 1;
+  }
+
+  AvocadoOpResolver resolver;
+  registerOps(resolver);
+
+  alignas(16) static uint8_t arena_max[4 * 1024 * 1024];
+  if (tam_arena > sizeof(arena_max)) {
+    fprintf(stderr, "error: arena máxima %zu bytes\n", sizeof(arena_max));
+    return 1;
+  }
+
+  OpProfiler profiler;
+  tflite::MicroInterpreter interpreter(model, resolver, arena_max, tam_arena, nullptr, &profiler);
+  if (interpreter.AllocateTensors() != kTfLiteOk) {
+    fprintf(stderr, "error: AllocateTensors falló con una arena de %zu bytes\n", tam_arena);
+    return 1;
+  }
+
+  TfLiteTensor* input = interpreter.input(0);
+  TfLiteTensor* output = interpreter.output(0);
+  if (input->bytes != MODEL_WIDTH * MODEL_HEIGHT) {
+    fprintf(stderr, "error: la entrada del modelo tiene %zu bytes, se esperaban %d\n",
+            input->bytes, MODEL_WIDTH * MODEL_HEIGHT);
+    return 1;
+  }
+
+  // Lista de imágenes con su clase esperada; sin directorio, una entrada vacía
+  std::vector<std::pair<fs::path, int>> imagenes;
+  if (dir_imagenes) {
+    for (const auto& dir : fs::directory_iterator(dir_imagenes)) {
+      if (!dir.is_directory()) continue;
+      int clase = claseDeDirectorio(dir.path().filename().string());
+      if (clase < 0) {
+        fprintf(stderr, "aviso: se ignora el directorio %s\n", dir.path().c_str());
+        continue;
+      }
+      for (const auto& f : fs::directory_iterator(dir.path())) {
+        std::string ext = f.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (ext == ".jpg" || ext == ".jpeg") {
+          imagenes.emplace_back(f.path(), clase);
+        }
+      }
+    }
+    std::sort(imagenes.begin(), imagenes.end());
+  } else {
+    imagenes.emplace_back(fs::path(), -1);
+  }
+
+  alignas(4) static uint8_t luma[LUMA_WIDTH * LUMA_HEIGHT];
+  static int8_t entrada_escalar[MODEL_WIDTH * MODEL_HEIGHT];
+  static int8_t entrada_swar[MODEL_WIDTH * MODEL_HEIGHT];
+
+  std::vector<double> tiempos_invoke;
+  double total_preprocesado_us = 0;
+  int confusion[kNumClases][kNumClases] = {};
+  int evaluadas = 0, omitidas = 0, diferencias = 0;
+
+  for (const auto& [ruta, clase] : imagenes) {
+    if (!ruta.empty()) {
+      if (!decodeJpegLuma(ruta, luma)) {
+        fprintf(stderr, "aviso: %s no es un JPEG VGA válido, se omite\n", ruta.c_str());
+        omitidas++;
+        continue;
+      }
+      auto t0 = Clock::now();
+      downscaleToInput(luma, input->data.int8);
+      total_preprocesado_us += microsegundos(Clock::now() - t0);
+
+      // Las dos rutas del preprocesado deben coincidir bit a bit
+      downscaleToInputScalar(luma, entrada_escalar);
+      downscaleToInputSwar(luma, entrada_swar);
+      if (memcmp(entrada_escalar, entrada_swar, sizeof(entrada_escalar)) != 0) {
+        fprintf(stderr, "error: el preprocesado escalar y el empaquetado difieren en %s\n",
+                ruta.c_str());
+        diferencias++;
+      }
+    } else {
+      memset(input->data.int8, 0, input->bytes);
+    }
+
+    for (int r = 0; r < repeticiones; r++) {
+      profiler.nuevaInvocacion();
+      auto t0 = Clock::now();
+      if (interpreter.Invoke() != kTfLiteOk) {
+        fprintf(stderr, "error: Invoke falló\n");
+        return 1;
+      }
+      tiempos_invoke.push_back(microsegundos(Clock::now() - t0));
+    }
+    evaluadas++;
+
+    if (clase >= 0) {
+      int prediccion = (output->data.int8[1] > output->data.int8[0]) ? 1 : 0;
+      confusion[clase][prediccion]++;
+    }
+  }
+
+  // Informe
+  printf("Modelo: %s (%zu bytes)\n", ruta_modelo, datos_modelo.size());
+  printf("Arena: %zu de %zu bytes usados (firmware: -DTENSOR_ARENA_SIZE=%zu)\n",
+         interpreter.arena_used_bytes(), tam_arena, interpreter.arena_used_bytes());
+  printf("Imágenes: %d evaluadas, %d omitidas\n", evaluadas, omitidas);
+  if (tiempos_invoke.empty()) {
+    return 1;
+  }
+
+  std::sort(tiempos_invoke.begin(), tiempos_invoke.end());
+  double suma_invoke = 0;
+  for (double t : tiempos_invoke) suma_invoke += t;
+  size_t n = tiempos_invoke.size();
+  printf("\nInvoke(): %zu ejecuciones, mín %.1f us, mediana %.1f us, media %.1f us, máx %.1f us\n",
+         n, tiempos_invoke.front(), tiempos_invoke[n / 2], suma_invoke / n, tiempos_invoke.back());
+  if (dir_imagenes && evaluadas > 0) {
+    printf("Preprocesado: media %.1f us por imagen\n", total_preprocesado_us / evaluadas);
+  }
+
+  std::vector<std::pair<std::string, OpProfiler::Stat>> ops(profiler.stats().begin(),
+                                                            profiler.stats().end());
+  std::sort(ops.begin(), ops.end(), [](const auto& a, const auto& b) {
+    return a.second.total_us > b.second.total_us;
+  });
+  double total_ops_us = 0;
+  for (const auto& op : ops) total_ops_us += op.second.total_us;
+  printf("\n%-24s %8s %14s %8s\n", "Operación", "Llamadas", "us/Invoke", "%");
+  for (const auto& [nombre, st] : ops) {
+    printf("%-24s %8.1f %14.1f %7.1f%%\n", nombre.c_str(), (double)st.llamadas / n,
+           st.total_us / n, total_ops_us > 0 ? 100.0 * st.total_us / total_ops_us : 0.0);
+  }
+
+  if (dir_imagenes) {
+    int aciertos = 0, total = 0;
+    printf("\nMatriz de confusión (filas: real, columnas: predicción)\n%-12s", "");
+    for (int j = 0; j < kNumClases; j++) printf(" %12s", kClases[j]);
+    printf("\n");
+    for (int i = 0; i < kNumClases; i++) {
+      printf("%-12s", kClases[i]);
+      for (int j = 0; j < kNumClases; j++) {
+        printf(" %12d", confusion[i][j]);
+        total += confusion[i][j];
+        if (i == j) aciertos += confusion[i][j];
+      }
+      printf("\n");
+    }
+    if (total > 0) {
+      printf("Exactitud: %.2f%% (%d/%d)\n", 100.0 * aciertos / total, aciertos, total);
+    }
+    printf("Preprocesado escalar y empaquetado idénticos en %d/%d imágenes\n",
+           evaluadas - diferencias, evaluadas);
+  }
+
+  return diferencias ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+// Prueba en el PC del preprocesado (preprocesado.cpp), sin TFLite Micro ni
+// imágenes: comprueba que la ruta empaquetada da exactamente lo mismo que la
+// escalar de referencia y que una imagen uniforme se conserva.
+//
+// Uso: make prueba
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "preprocesado.h"
+
+constexpr int kImagenesAleatorias = 200;
+
+alignas(4) static uint8_t luma[LUMA_WIDTH * LUMA_HEIGHT];
+static int8_t salida_escalar[MODEL_WIDTH * MODEL_HEIGHT];
+static int8_t salida_swar[MODEL_WIDTH * MODEL_HEIGHT];
+
+static int fallos = 0;
+
+// Generador congruencial: la misma secuencia en cualquier plataforma
+static uint32_t semilla = 12345;
+
+static uint8_t aleatorio() {
+  semilla = semilla * 1664525UL + 1013904223UL;
+  return semilla >> 24;
+}
+
+static void comprobar(const char* nombre, bool uniforme, int8_t esperado) {
+  downscaleToInputScalar(luma, salida_escalar);
+  downscaleToInputSwar(luma, salida_swar);
+
+  for (int i = 0; i < MODEL_WIDTH * MODEL_HEIGHT; i++) {
+    if (salida_swar[i] != salida_escalar[i]) {
+      printf("FALLO %s: píxel (%d, %d) escalar %d, empaquetada %d\n", nombre, i % MODEL_WIDTH,
+             i / MODEL_WIDTH, salida_escalar[i], salida_swar[i]);
+      fallos++;
+      return;
+    }
+    if (uniforme && salida_escalar[i] != esperado) {
+      printf("FALLO %s: píxel (%d, %d) vale %d, se esperaba %d\n", nombre, i % MODEL_WIDTH,
+             i / MODEL_WIDTH, salida_escalar[i], esperado);
+      fallos++;
+      return;
+    }
+  }
+}
+
+int main() {
+  if (!initPreprocessing()) {
+    puts("FALLO: la geometría no cabe en PREPROC_MAX_TAPS");
+    return 1;
+  }
+
+  // Imágenes uniformes: la media por área de un valor constante es ese valor
+  char nombre[32];
+  for (int v = 0; v <= 255; v++) {
+    memset(luma, v, sizeof(luma));
+    snprintf(nombre, sizeof(nombre), "uniforme %d", v);
+    comprobar(nombre, true, static_cast<int8_t>(v - 128));
+  }
+
+  // Imágenes aleatorias y la de máximo contraste (carriles al límite)
+  for (int n = 0; n < kImagenesAleatorias; n++) {
+    for (size_t i = 0; i < sizeof(luma); i++) {
+      luma[i] = aleatorio();
+    }
+    snprintf(nombre, sizeof(nombre), "aleatoria %d", n);
+    comprobar(nombre, false, 0);
+  }
+  for (size_t i = 0; i < sizeof(luma); i++) {
+    luma[i] = ((i + i / LUMA_WIDTH) & 1) ? 255 : 0;
+  }
+  comprobar("ajedrez", false, 0);
+
+  if (fallos > 0) {
+    printf("%d comprobaciones fallidas\n", fallos);
+    return 1;
+  }
+  printf("Preprocesado correcto: 256 uniformes, %d aleatorias y ajedrez, "
+         "rutas escalar y empaquetada idénticas\n", kImagenesAleatorias);
+  return 0;
+}
@@ -0,0 +1,103 @@
+#include "enlace_nodo.h"
+
+enum ParserState {
+  WAIT_SYNC,
+  WAIT_TYPE,
+  WAIT_LENGTH,
+  WAIT_DATA,
+  WAIT_CRC_LOW,
+  WAIT_CRC_HIGH,
+};
+
+static struct {
+  ParserState state = WAIT_SYNC;
+  uint8_t type;
+  uint8_t length;
+  uint8_t received;
+  uint8_t data[LINK_MAX_DATA];
+  uint16_t crc;
+} parser;
+
+static uint16_t crc16Byte(uint16_t crc, uint8_t byte) {
+  crc ^= (uint16_t)byte << 8;
+  for (int i = 0; i < 8; i++) {
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+bool linkFeed(uint8_t byte, uint16_t* request_seq) {
+  switch (parser.state) {
+    case WAIT_SYNC:
+      if (byte == LINK_SYNC) {
+        parser.crc = 0xFFFF;
+        parser.state = WAIT_TYPE;
+      }
+      break;
+    case WAIT_TYPE:
+      parser.type = byte;
+      parser.crc = crc16Byte(parser.crc, byte);
+      parser.state = WAIT_LENGTH;
+      break;
+    case WAIT_LENGTH:
+      if (byte > LINK_MAX_DATA) {
+        parser.state = WAIT_SYNC;
+        break;
+      }
+      parser.length = byte;
+      parser.received = 0;
+      parser.crc = crc16Byte(parser.crc, byte);
+      parser.state = byte ? WAIT_DATA : WAIT_CRC_LOW;
+      break;
+    case WAIT_DATA:
+      parser.data[parser.received++] = byte;
+      parser.crc = crc16Byte(parser.crc, byte);
+      if (parser.received == parser.length) {
+        parser.state = WAIT_CRC_LOW;
+      }
+      break;
+    case WAIT_CRC_LOW:
+      parser.crc ^= byte;
+      parser.state = WAIT_CRC_HIGH;
+      break;
+    case WAIT_CRC_HIGH:
+      parser.state = WAIT_SYNC;
+      if ((parser.crc ^ ((uint16_t)byte << 8)) != 0 ||
+          parser.type != LINK_REQUEST || parser.length != 2) {
+        return false;
+      }
+      *request_seq = parser.data[0] | (parser.data[1] << 8);
+      return true;
+  }
+  return false;
+}
+
+static uint8_t* putU16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+  return p + 2;
+}
+
+static uint8_t* putU32(uint8_t* p, uint32_t v) {
+  p = putU16(p, v & 0xFFFF);
+  return putU16(p, v >> 16);
+}
+
+size_t linkEncodeResult(const LinkResult& result, uint8_t* buf) {
+  uint8_t* p = buf;
+  *p++ = LINK_SYNC;
+  *p++ = LINK_RESULT;
+  *p++ = LINK_RESULT_DATA;
+  p = putU16(p, result.request_seq);
+  p = putU32(p, result.frame);
+  p = putU16(p, result.good_pm);
+  p = putU16(p, result.bad_pm);
+  p = putU32(p, result.inference_us);
+
+  uint16_t crc = 0xFFFF;
+  for (uint8_t* q = buf + 1; q < p; q++) {
+    crc = crc16Byte(crc, *q);
+  }
+  p = putU16(p, crc);
+  return p - buf;
+}
@@ -0,0 +1,34 @@
+#ifndef ENLACE_NODO_H
+#define ENLACE_NODO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Protocolo por UART con los nodos sensores (modulos/telemetria/include/enlace_ia.h)
+//
+// Trama: sync (0xA5) | tipo (u8) | longitud (u8) | datos | crc (u16)
+// CRC-16/CCITT (0x1021, inicial 0xFFFF) sobre tipo, longitud y datos, todo en
+// little-endian. El nodo envía una solicitud con su número de secuencia y la
+// XIAO responde con el resultado del primer cuadro capturado después.
+#define LINK_SYNC 0xA5
+#define LINK_REQUEST 0x01
+#define LINK_RESULT 0x81
+#define LINK_MAX_DATA 16
+#define LINK_RESULT_DATA 14
+#define LINK_MAX_FRAME (3 + LINK_MAX_DATA + 2)
+
+struct LinkResult {
+  uint16_t request_seq;
+  uint32_t frame;
+  uint16_t good_pm;       // Probabilidad de "sin estrés" en ‰
+  uint16_t bad_pm;        // Probabilidad de "estrés" en ‰
+  uint32_t inference_us;
+};
+
+// Procesa un byte recibido; devuelve true al completar una solicitud válida
+bool linkFeed(uint8_t byte, uint16_t* request_seq);
+
+// Codifica una respuesta en buf (LINK_MAX_FRAME bytes); devuelve su longitud
+size_t linkEncodeResult(const LinkResult& result, uint8_t* buf);
+
+#endif
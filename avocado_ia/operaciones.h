@@ -0,0 +1,26 @@
+#ifndef OPERACIONES_H
+#define OPERACIONES_H
+
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+
+// Operaciones que usa model.tflite. El firmware y el banco de pruebas
+// (banco_pruebas/) registran exactamente las mismas.
+constexpr int kNumOps = 12;
+using AvocadoOpResolver = tflite::MicroMutableOpResolver<kNumOps>;
+
+inline void registerOps(AvocadoOpResolver& resolver) {
+  resolver.AddQuantize();
+  resolver.AddConv2D();
+  resolver.AddDepthwiseConv2D();
+  resolver.AddPad();
+  resolver.AddLogistic();
+  resolver.AddShape();
+  resolver.AddStridedSlice();
+  resolver.AddPack();
+  resolver.AddReshape();
+  resolver.AddFullyConnected();
+  resolver.AddDequantize();
+  resolver.AddAveragePool2D();
+}
+
+#endif
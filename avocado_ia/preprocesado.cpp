@@ -0,0 +1,165 @@
+#include "preprocesado.h"
+
+#include <string.h>
+
+// Píxeles de origen que cubre un píxel de salida: el primero y el peso de cada
+// uno (solapamiento en unidades enteras; todos los pesos de un eje suman lo mismo)
+struct AxisTaps {
+  uint16_t start;
+  uint8_t count;
+  uint8_t weight[PREPROC_MAX_TAPS];
+};
+
+static AxisTaps col_taps[MODEL_WIDTH];
+static AxisTaps row_taps[MODEL_HEIGHT];
+static uint32_t norm_recip;   // 2^16 / (suma de pesos horizontal x vertical)
+
+static int gcd(int a, int b) {
+  while (b) {
+    int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Un píxel de origen mide d unidades y uno de salida s unidades, con s/d la
+// relación de escala reducida; el peso es el solapamiento entre ambos
+static int buildAxis(AxisTaps* taps, int src, int dst) {
+  int g = gcd(src, dst);
+  int s = src / g;
+  int d = dst / g;
+
+  for (int i = 0; i < dst; i++) {
+    int lo = i * s;
+    int hi = lo + s;
+    int j = lo / d;
+    AxisTaps* t = &taps[i];
+
+    t->start = j;
+    t->count = 0;
+    memset(t->weight, 0, sizeof(t->weight));
+    for (; j * d < hi; j++) {
+      if (t->count == PREPROC_MAX_TAPS) {
+        return -1;
+      }
+      int px_lo = j * d;
+      int px_hi = px_lo + d;
+      t->weight[t->count++] = (hi < px_hi ? hi : px_hi) - (lo > px_lo ? lo : px_lo);
+    }
+  }
+  return s;
+}
+
+bool initPreprocessing() {
+  int sum_x = buildAxis(col_taps, LUMA_WIDTH, MODEL_WIDTH);
+  int sum_y = buildAxis(row_taps, LUMA_HEIGHT, MODEL_HEIGHT);
+  // Las sumas verticales de la ruta empaquetada deben caber en 16 bits
+  if (sum_x < 0 || sum_y < 0 || 255 * sum_y > UINT16_MAX) {
+    return false;
+  }
+
+  uint32_t norm = sum_x * sum_y;
+  norm_recip = ((1UL << 16) + norm / 2) / norm;
+  return true;
+}
+
+void rgbToLuma(const uint8_t* rgb, uint8_t* luma, size_t n) {
+  for (size_t i = 0; i < n; i++, rgb += 3) {
+    luma[i] = (77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2]) >> 8;
+  }
+}
+
+// Pasada horizontal sobre una fila ya combinada verticalmente y escritura de
+// la fila de salida; común a ambas rutas
+static void reduceRow(const uint16_t* blended, int8_t* dst) {
+  for (int x = 0; x < MODEL_WIDTH; x++) {
+    const AxisTaps* t = &col_taps[x];
+    const uint16_t* src = blended + t->start;
+    uint32_t sum = 0;
+    for (int k = 0; k < t->count; k++) {
+      sum += t->weight[k] * src[k];
+    }
+    uint32_t value = (sum * norm_recip + (1UL << 15)) >> 16;
+    dst[x] = static_cast<int8_t>((value > 255 ? 255 : value) - 128);
+  }
+}
+
+void downscaleToInputScalar(const uint8_t* luma, int8_t* dst) {
+  uint16_t blended[LUMA_WIDTH];
+
+  for (int y = 0; y < MODEL_HEIGHT; y++) {
+    const AxisTaps* t = &row_taps[y];
+    memset(blended, 0, sizeof(blended));
+    for (int k = 0; k < t->count; k++) {
+      const uint8_t* row = luma + (t->start + k) * LUMA_WIDTH;
+      for (int x = 0; x < LUMA_WIDTH; x++) {
+        blended[x] += t->weight[k] * row[x];
+      }
+    }
+    reduceRow(blended, dst + y * MODEL_WIDTH);
+  }
+}
+
+// Igual que la escalar, pero la combinación vertical procesa cuatro píxeles
+// por palabra: los pares y los impares van en dos carriles de 16 bits que no
+// se desbordan (255 x suma de pesos < 2^16). Supone little-endian.
+void downscaleToInputSwar(const uint8_t* luma, int8_t* dst) {
+  static_assert(LUMA_WIDTH % 4 == 0, "LUMA_WIDTH debe ser múltiplo de 4");
+  uint32_t even[LUMA_WIDTH / 4];
+  uint32_t odd[LUMA_WIDTH / 4];
+  uint16_t blended[LUMA_WIDTH];
+
+  for (int y = 0; y < MODEL_HEIGHT; y++) {
+    const AxisTaps* t = &row_taps[y];
+    memset(even, 0, sizeof(even));
+    memset(odd, 0, sizeof(odd));
+    for (int k = 0; k < t->count; k++) {
+      const uint32_t* row = reinterpret_cast<const uint32_t*>(luma + (t->start + k) * LUMA_WIDTH);
+      uint32_t w = t->weight[k];
+      for (int i = 0; i < LUMA_WIDTH / 4; i++) {
+        uint32_t p = row[i];
+        even[i] += (p & 0x00FF00FFUL) * w;
+        odd[i] += ((p >> 8) & 0x00FF00FFUL) * w;
+      }
+    }
+    for (int i = 0; i < LUMA_WIDTH / 4; i++) {
+      blended[4 * i + 0] = even[i] & 0xFFFF;
+      blended[4 * i + 1] = odd[i] & 0xFFFF;
+      blended[4 * i + 2] = even[i] >> 16;
+      blended[4 * i + 3] = odd[i] >> 16;
+    }
+    reduceRow(blended, dst + y * MODEL_WIDTH);
+  }
+}
+
+void downscaleToInput(const uint8_t* luma, int8_t* dst) {
+#if PREPROC_USE_SWAR
+  downscaleToInputSwar(luma, dst);
+#else
+  downscaleToInputScalar(luma, dst);
+#endif
+}
+
+void makeThumbnail(const uint8_t* small, uint8_t* thumb) {
+  for (int ty = 0; ty < THUMB_HEIGHT; ty++) {
+    for (int tx = 0; tx < THUMB_WIDTH; tx++) {
+      const uint8_t* block = small + ty * THUMB_BLOCK * THUMB_SOURCE_WIDTH + tx * THUMB_BLOCK;
+      uint32_t sum = 0;
+      for (int y = 0; y < THUMB_BLOCK; y++, block += THUMB_SOURCE_WIDTH) {
+        for (int x = 0; x < THUMB_BLOCK; x++) {
+          sum += block[x];
+        }
+      }
+      *thumb++ = (sum + THUMB_BLOCK * THUMB_BLOCK / 2) / (THUMB_BLOCK * THUMB_BLOCK);
+    }
+  }
+}
+
+uint32_t thumbnailMad(const uint8_t* a, const uint8_t* b) {
+  uint32_t sum = 0;
+  for (int i = 0; i < THUMB_WIDTH * THUMB_HEIGHT; i++) {
+    sum += (a[i] > b[i]) ? a[i] - b[i] : b[i] - a[i];
+  }
+  return sum * 10 / (THUMB_WIDTH * THUMB_HEIGHT);
+}
@@ -0,0 +1,54 @@
+#ifndef PREPROCESADO_H
+#define PREPROCESADO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Imagen decodificada (VGA a 1/4) y entrada del modelo
+#define LUMA_WIDTH 160
+#define LUMA_HEIGHT 120
+#define MODEL_WIDTH 96
+#define MODEL_HEIGHT 96
+
+// Miniatura para detectar cambios de escena: la imagen decodificada a 1/8
+// (80x60) promediada en bloques de 4x4
+#define THUMB_SOURCE_WIDTH (LUMA_WIDTH / 2)
+#define THUMB_SOURCE_HEIGHT (LUMA_HEIGHT / 2)
+#define THUMB_BLOCK 4
+#define THUMB_WIDTH (THUMB_SOURCE_WIDTH / THUMB_BLOCK)
+#define THUMB_HEIGHT (THUMB_SOURCE_HEIGHT / THUMB_BLOCK)
+
+// Píxeles de origen que puede cubrir como máximo un píxel de salida por eje
+#define PREPROC_MAX_TAPS 3
+
+// Ruta empaquetada para la reducción: SWAR con dos píxeles por palabra de 32
+// bits en los registros normales del núcleo, no las instrucciones vectoriales
+// PIE (ee.*) del ESP32-S3. Con 0 se usa siempre la versión escalar de
+// referencia; banco_pruebas/ comprueba con 'make prueba' que ambas coinciden.
+#ifndef PREPROC_USE_SWAR
+#define PREPROC_USE_SWAR 1
+#endif
+
+// Calcula las tablas de coordenadas y pesos; devuelve false si la geometría
+// no cabe en PREPROC_MAX_TAPS
+bool initPreprocessing();
+
+// Luminancia BT.601 en punto fijo (77, 150, 29) / 256 de n píxeles RGB888
+void rgbToLuma(const uint8_t* rgb, uint8_t* luma, size_t n);
+
+// Reduce la imagen en grises LUMA_WIDTH x LUMA_HEIGHT a la entrada del modelo
+// promediando por área, con punto cero -128. luma debe estar alineado a 4 bytes.
+void downscaleToInput(const uint8_t* luma, int8_t* dst);
+
+// Las dos implementaciones dan exactamente el mismo resultado; se exponen por
+// separado para poder compararlas fuera del dispositivo
+void downscaleToInputScalar(const uint8_t* luma, int8_t* dst);
+void downscaleToInputSwar(const uint8_t* luma, int8_t* dst);
+
+// Promedia la imagen a 1/8 en la miniatura THUMB_WIDTH x THUMB_HEIGHT
+void makeThumbnail(const uint8_t* small, uint8_t* thumb);
+
+// Diferencia absoluta media entre dos miniaturas, en décimas de nivel de gris
+uint32_t thumbnailMad(const uint8_t* a, const uint8_t* b);
+
+#endif
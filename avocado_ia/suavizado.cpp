@@ -0,0 +1,127 @@
+#include "suavizado.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void filterDefaults(FilterConfig* config) {
+  config->mode = FILTER_EMA;
+  config->alpha_pm = 300;
+  config->window = 5;
+  config->enter_pm = 650;
+  config->exit_pm = 350;
+  config->min_dwell_ms = 10000;
+}
+
+static void filterReset(StressFilter* filter) {
+  filter->score_pm = 0;
+  filter->has_score = false;
+  filter->votes = 0;
+  filter->frames = 0;
+}
+
+void filterInit(StressFilter* filter, const FilterConfig& config, uint32_t now_ms) {
+  filter->config = config;
+  filterReset(filter);
+  filter->stressed = false;
+  filter->changed_ms = now_ms;
+  filter->transitions = 0;
+}
+
+static uint8_t countVotes(uint16_t votes, uint8_t n) {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    count += (votes >> i) & 1;
+  }
+  return count;
+}
+
+bool filterUpdate(StressFilter* filter, uint16_t bad_pm, uint32_t now_ms) {
+  const FilterConfig& config = filter->config;
+
+  if (config.mode == FILTER_EMA) {
+    if (!filter->has_score) {
+      filter->score_pm = bad_pm;
+    } else {
+      int32_t delta = (int32_t)bad_pm - filter->score_pm;
+      filter->score_pm += (delta * config.alpha_pm + (delta >= 0 ? 500 : -500)) / 1000;
+    }
+  } else {
+    filter->votes = (filter->votes << 1) | (bad_pm > 500 ? 1 : 0);
+    if (filter->frames < config.window) {
+      filter->frames++;
+    }
+    filter->score_pm = countVotes(filter->votes, filter->frames) * 1000 / filter->frames;
+  }
+  filter->has_score = true;
+
+  // En votación no se decide hasta tener la ventana completa
+  if (config.mode == FILTER_VOTE && filter->frames < config.window) {
+    return false;
+  }
+  if (now_ms - filter->changed_ms < config.min_dwell_ms) {
+    return false;
+  }
+  bool stressed = filter->stressed ? filter->score_pm > config.exit_pm
+                                   : filter->score_pm >= config.enter_pm;
+  if (stressed == filter->stressed) {
+    return false;
+  }
+  filter->stressed = stressed;
+  filter->changed_ms = now_ms;
+  filter->transitions++;
+  return true;
+}
+
+bool filterConfigure(StressFilter* filter, char* line) {
+  FilterConfig config = filter->config;
+
+  for (char* token = strtok(line, " "); token; token = strtok(nullptr, " ")) {
+    char* value = strchr(token, '=');
+    if (!value) {
+      return false;
+    }
+    *value++ = '\0';
+
+    if (strcmp(token, "modo") == 0) {
+      if (strcmp(value, "ema") == 0) {
+        config.mode = FILTER_EMA;
+      } else if (strcmp(value, "voto") == 0) {
+        config.mode = FILTER_VOTE;
+      } else {
+        return false;
+      }
+      continue;
+    }
+
+    char* end;
+    long number = strtol(value, &end, 10);
+    if (*end != '\0' || number < 0) {
+      return false;
+    }
+    if (strcmp(token, "alfa") == 0 && number >= 1 && number <= 1000) {
+      config.alpha_pm = number;
+    } else if (strcmp(token, "ventana") == 0 && number >= 1 && number <= FILTER_MAX_WINDOW) {
+      config.window = number;
+    } else if (strcmp(token, "entrada") == 0 && number <= 1000) {
+      config.enter_pm = number;
+    } else if (strcmp(token, "salida") == 0 && number <= 1000) {
+      config.exit_pm = number;
+    } else if (strcmp(token, "permanencia") == 0) {
+      config.min_dwell_ms = number;
+    } else {
+      return false;
+    }
+  }
+
+  // Sin banda de histéresis el estado volvería a oscilar
+  if (config.exit_pm >= config.enter_pm) {
+    return false;
+  }
+
+  bool reset = config.mode != filter->config.mode || config.window != filter->config.window;
+  filter->config = config;
+  if (reset) {
+    filterReset(filter);
+  }
+  return true;
+}
@@ -0,0 +1,58 @@
+#ifndef SUAVIZADO_H
+#define SUAVIZADO_H
+
+#include <stdint.h>
+
+// Posprocesado de la clasificación: suaviza la probabilidad de estrés de los
+// últimos cuadros y decide el estado con histéresis y un tiempo mínimo de
+// permanencia, para que un cambio de luz no haga oscilar la salida.
+//
+// - FILTER_EMA: media móvil exponencial con peso alpha_pm (‰) para el cuadro
+//   nuevo
+// - FILTER_VOTE: fracción (‰) de los últimos window cuadros clasificados como
+//   estrés; con enter_pm = 600 y window = 5 hacen falta 3 de 5
+//
+// Se entra en estrés cuando la puntuación llega a enter_pm y se sale cuando
+// baja a exit_pm, siempre que el estado actual dure ya min_dwell_ms.
+#define FILTER_MAX_WINDOW 16
+
+enum FilterMode {
+  FILTER_EMA,
+  FILTER_VOTE,
+};
+
+struct FilterConfig {
+  FilterMode mode;
+  uint16_t alpha_pm;
+  uint8_t window;
+  uint16_t enter_pm;
+  uint16_t exit_pm;
+  uint32_t min_dwell_ms;
+};
+
+struct StressFilter {
+  FilterConfig config;
+  uint16_t score_pm;      // Probabilidad de estrés suavizada en ‰
+  bool has_score;
+  uint16_t votes;         // Un bit por cuadro, el más reciente en el bit 0
+  uint8_t frames;
+  bool stressed;
+  uint32_t changed_ms;    // Último cambio de estado
+  uint32_t transitions;
+};
+
+// Valores por defecto: EMA con alfa 300 ‰, histéresis 650/350 ‰ y 10 s
+void filterDefaults(FilterConfig* config);
+
+// Reinicia el filtro (estado "sin estrés") con la configuración dada
+void filterInit(StressFilter* filter, const FilterConfig& config, uint32_t now_ms);
+
+// Añade la probabilidad de estrés de un cuadro; devuelve true si el estado cambia
+bool filterUpdate(StressFilter* filter, uint16_t bad_pm, uint32_t now_ms);
+
+// Aplica pares "clave=valor" separados por espacios (modo=ema|voto, alfa,
+// ventana, entrada, salida, permanencia). Devuelve false, sin tocar el filtro,
+// si alguno no es válido. Un cambio de modo o ventana reinicia el historial.
+bool filterConfigure(StressFilter* filter, char* line);
+
+#endif
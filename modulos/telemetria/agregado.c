@@ -0,0 +1,117 @@
+#include <string.h>
+#include "agregado.h"
+
+static void acumular(acumulador_t *a, int32_t valor) {
+    if (a->cuenta == UINT16_MAX) {
+        return;
+    }
+    if (a->cuenta == 0 || valor < a->min) {
+        a->min = (int16_t)valor;
+    }
+    if (a->cuenta == 0 || valor > a->max) {
+        a->max = (int16_t)valor;
+    }
+    a->cuenta++;
+    a->suma += valor;
+    a->suma_cuadrados += (uint64_t)((int64_t)valor * valor);
+}
+
+// Raíz cuadrada entera (por defecto) bit a bit
+static uint32_t raiz_entera(uint64_t x) {
+    uint64_t resultado = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (x >= resultado + bit) {
+            x -= resultado + bit;
+            resultado = (resultado >> 1) + bit;
+        } else {
+            resultado >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)resultado;
+}
+
+// Media redondeada al entero más cercano
+static int32_t media(const acumulador_t *a) {
+    int32_t mitad = a->cuenta / 2;
+    return (a->suma >= 0) ? (a->suma + mitad) / a->cuenta : (a->suma - mitad) / a->cuenta;
+}
+
+// Desviación típica poblacional: sqrt((n·Σx² - (Σx)²) / n²), todo en enteros
+static uint16_t desviacion(const acumulador_t *a) {
+    int64_t n = a->cuenta;
+    int64_t var_n2 = n * (int64_t)a->suma_cuadrados - (int64_t)a->suma * a->suma;
+    if (var_n2 <= 0) {
+        return 0;
+    }
+    uint32_t desv = raiz_entera((uint64_t)var_n2) / (uint32_t)n;
+    return (desv > UINT16_MAX) ? UINT16_MAX : (uint16_t)desv;
+}
+
+static void resumir(const acumulador_t *a, dispersion_t *d) {
+    if (a->cuenta == 0) {
+        d->min = TRAMA_TEMP_AUSENTE;
+        d->max = TRAMA_TEMP_AUSENTE;
+        d->desv = TRAMA_VALOR_AUSENTE;
+        return;
+    }
+    d->min = a->min;
+    d->max = a->max;
+    d->desv = desviacion(a);
+}
+
+void ventana_reiniciar(ventana_t *v) {
+    memset(v, 0, sizeof(*v));
+}
+
+void ventana_agregar(ventana_t *v, const muestra_t *lectura) {
+    if (v->lecturas == 0) {
+        v->inicio = lectura->tiempo;
+    }
+    v->fin = lectura->tiempo;
+    if (v->lecturas < UINT16_MAX) {
+        v->lecturas++;
+    }
+
+    if (lectura->temperatura != TRAMA_TEMP_AUSENTE) {
+        acumular(&v->temperatura, lectura->temperatura);
+    }
+    if (lectura->humedad != TRAMA_VALOR_AUSENTE) {
+        acumular(&v->humedad, lectura->humedad);
+    }
+    if (lectura->humedad_suelo != TRAMA_VALOR_AUSENTE) {
+        acumular(&v->suelo, lectura->humedad_suelo);
+    }
+    if (lectura->estres != TRAMA_ESTRES_AUSENTE) {
+        acumular(&v->estres, lectura->estres);
+    }
+}
+
+uint32_t ventana_duracion_s(const ventana_t *v) {
+    return (v->lecturas == 0) ? 0 : v->fin - v->inicio;
+}
+
+bool ventana_cerrar(ventana_t *v, muestra_t *resumen) {
+    if (v->lecturas == 0) {
+        return false;
+    }
+
+    resumen->tiempo = v->fin;
+    resumen->cuenta = v->lecturas;
+    resumen->temperatura = v->temperatura.cuenta ? (int16_t)media(&v->temperatura)
+                                                 : TRAMA_TEMP_AUSENTE;
+    resumen->humedad = v->humedad.cuenta ? (uint16_t)media(&v->humedad) : TRAMA_VALOR_AUSENTE;
+    resumen->humedad_suelo = v->suelo.cuenta ? (uint16_t)media(&v->suelo) : TRAMA_VALOR_AUSENTE;
+    resumen->estres = v->estres.cuenta ? (uint8_t)media(&v->estres) : TRAMA_ESTRES_AUSENTE;
+    resumir(&v->temperatura, &resumen->disp_temperatura);
+    resumir(&v->humedad, &resumen->disp_humedad);
+    resumir(&v->suelo, &resumen->disp_suelo);
+
+    ventana_reiniciar(v);
+    return true;
+}
@@ -0,0 +1,83 @@
+#include "cola_muestras.h"
+
+void cola_muestras_init(cola_muestras_t *cola) {
+    cola->inicio = 0;
+    cola->cantidad = 0;
+    cola->encoladas = 0;
+    cola->descartadas = 0;
+    cola->enviadas = 0;
+    mutex_init(&cola->lock);
+}
+
+int cola_muestras_agregar(cola_muestras_t *cola, const muestra_t *muestra) {
+    int descartada = 0;
+
+    mutex_lock(&cola->lock);
+    if (cola->cantidad == COLA_MUESTRAS_TAM) {
+        // Cola llena: se sobrescribe la muestra más antigua
+        cola->inicio = (cola->inicio + 1) % COLA_MUESTRAS_TAM;
+        cola->cantidad--;
+        cola->descartadas++;
+        descartada = 1;
+    }
+    cola->muestras[(cola->inicio + cola->cantidad) % COLA_MUESTRAS_TAM] = *muestra;
+    cola->cantidad++;
+    cola->encoladas++;
+    mutex_unlock(&cola->lock);
+
+    return descartada;
+}
+
+size_t cola_muestras_ver(cola_muestras_t *cola, muestra_t *destino, size_t max) {
+    mutex_lock(&cola->lock);
+    size_t num = (cola->cantidad < max) ? cola->cantidad : max;
+    for (size_t i = 0; i < num; i++) {
+        destino[i] = cola->muestras[(cola->inicio + i) % COLA_MUESTRAS_TAM];
+    }
+    mutex_unlock(&cola->lock);
+
+    return num;
+}
+
+size_t cola_muestras_ver_tras(cola_muestras_t *cola, uint16_t ultima_secuencia,
+                              muestra_t *destino, size_t max) {
+    mutex_lock(&cola->lock);
+    unsigned salto = 0;
+    while (salto < cola->cantidad) {
+        uint16_t secuencia = cola->muestras[(cola->inicio + salto) % COLA_MUESTRAS_TAM].secuencia;
+        if ((int16_t)(secuencia - ultima_secuencia) > 0) {
+            break;
+        }
+        salto++;
+    }
+    size_t num = (cola->cantidad - salto < max) ? cola->cantidad - salto : max;
+    for (size_t i = 0; i < num; i++) {
+        destino[i] = cola->muestras[(cola->inicio + salto + i) % COLA_MUESTRAS_TAM];
+    }
+    mutex_unlock(&cola->lock);
+
+    return num;
+}
+
+void cola_muestras_confirmar(cola_muestras_t *cola, uint16_t ultima_secuencia) {
+    mutex_lock(&cola->lock);
+    while (cola->cantidad > 0) {
+        uint16_t secuencia = cola->muestras[cola->inicio].secuencia;
+        // Comparación con signo para tolerar el desborde del contador de 16 bits
+        if ((int16_t)(secuencia - ultima_secuencia) > 0) {
+            break;
+        }
+        cola->inicio = (cola->inicio + 1) % COLA_MUESTRAS_TAM;
+        cola->cantidad--;
+        cola->enviadas++;
+    }
+    mutex_unlock(&cola->lock);
+}
+
+unsigned cola_muestras_cantidad(cola_muestras_t *cola) {
+    mutex_lock(&cola->lock);
+    unsigned cantidad = cola->cantidad;
+    mutex_unlock(&cola->lock);
+
+    return cantidad;
+}
@@ -0,0 +1,194 @@
+#include <errno.h>
+#include <string.h>
+#include "enlace_ia.h"
+#include "simulacion.h"
+#include "mutex.h"
+#include "tsrb.h"
+#include "xtimer.h"
+#include "ztimer.h"
+
+// En la placa native se compila enlace_ia_sim.c en su lugar
+#if !SIMULACION
+
+// Recepción por interrupción: la ISR solo guarda el byte y despierta al lector
+static uint8_t memoria_rx[64];
+static tsrb_t buffer_rx = TSRB_INIT(memoria_rx);
+static mutex_t hay_datos = MUTEX_INIT_LOCKED;
+
+static uart_t uart_ia;
+static uint16_t secuencia_solicitud;
+static uint32_t inicio_solicitud_us;
+static enlace_ia_stats_t stats;
+
+typedef enum {
+    ESPERA_SYNC,
+    ESPERA_TIPO,
+    ESPERA_LONGITUD,
+    ESPERA_DATOS,
+    ESPERA_CRC_BAJO,
+    ESPERA_CRC_ALTO,
+} estado_parser_t;
+
+static struct {
+    estado_parser_t estado;
+    uint8_t tipo;
+    uint8_t longitud;
+    uint8_t recibidos;
+    uint8_t datos[ENLACE_IA_MAX_DATOS];
+    uint16_t crc;
+} parser;
+
+static void al_recibir(void *arg, uint8_t byte) {
+    (void)arg;
+    if (tsrb_add_one(&buffer_rx, byte) < 0) {
+        stats.desbordes++;
+    }
+    mutex_unlock(&hay_datos);
+}
+
+static uint16_t crc16_byte(uint16_t crc, uint8_t byte) {
+    crc ^= (uint16_t)byte << 8;
+    for (int i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static uint16_t leer_u16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t leer_u32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Avanza el parser un byte; devuelve true al completar una trama con CRC válido
+static bool procesar_byte(uint8_t byte) {
+    switch (parser.estado) {
+    case ESPERA_SYNC:
+        if (byte == ENLACE_IA_SYNC) {
+            parser.crc = 0xFFFF;
+            parser.estado = ESPERA_TIPO;
+        }
+        break;
+    case ESPERA_TIPO:
+        parser.tipo = byte;
+        parser.crc = crc16_byte(parser.crc, byte);
+        parser.estado = ESPERA_LONGITUD;
+        break;
+    case ESPERA_LONGITUD:
+        if (byte > ENLACE_IA_MAX_DATOS) {
+            parser.estado = ESPERA_SYNC;
+            break;
+        }
+        parser.longitud = byte;
+        parser.recibidos = 0;
+        parser.crc = crc16_byte(parser.crc, byte);
+        parser.estado = byte ? ESPERA_DATOS : ESPERA_CRC_BAJO;
+        break;
+    case ESPERA_DATOS:
+        parser.datos[parser.recibidos++] = byte;
+        parser.crc = crc16_byte(parser.crc, byte);
+        if (parser.recibidos == parser.longitud) {
+            parser.estado = ESPERA_CRC_BAJO;
+        }
+        break;
+    case ESPERA_CRC_BAJO:
+        parser.crc ^= byte;
+        parser.estado = ESPERA_CRC_ALTO;
+        break;
+    case ESPERA_CRC_ALTO:
+        parser.estado = ESPERA_SYNC;
+        if ((parser.crc ^ ((uint16_t)byte << 8)) != 0) {
+            stats.errores_crc++;
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+static void escribir_trama(uint8_t tipo, const uint8_t *datos, uint8_t longitud) {
+    uint8_t trama[3 + ENLACE_IA_MAX_DATOS + 2];
+    uint16_t crc = 0xFFFF;
+
+    trama[0] = ENLACE_IA_SYNC;
+    trama[1] = tipo;
+    trama[2] = longitud;
+    memcpy(&trama[3], datos, longitud);
+    for (unsigned i = 1; i < 3U + longitud; i++) {
+        crc = crc16_byte(crc, trama[i]);
+    }
+    trama[3 + longitud] = crc & 0xFF;
+    trama[4 + longitud] = crc >> 8;
+    uart_write(uart_ia, trama, 5U + longitud);
+}
+
+int enlace_ia_init(uart_t uart, uint32_t baudios) {
+    uart_ia = uart;
+    parser.estado = ESPERA_SYNC;
+    return uart_init(uart, baudios, al_recibir, NULL);
+}
+
+int enlace_ia_solicitar(void) {
+    // Lo recibido antes de la solicitud ya no interesa. Se descarta leyendo:
+    // tsrb_clear también toca el índice de escritura y la ISR puede estar
+    // añadiendo un byte a la vez
+    while (tsrb_get_one(&buffer_rx) >= 0) {}
+    parser.estado = ESPERA_SYNC;
+
+    secuencia_solicitud++;
+    uint8_t datos[2] = { secuencia_solicitud & 0xFF, secuencia_solicitud >> 8 };
+    inicio_solicitud_us = xtimer_now_usec();
+    escribir_trama(ENLACE_IA_SOLICITUD, datos, sizeof(datos));
+    stats.solicitudes++;
+    return 0;
+}
+
+int enlace_ia_esperar(resultado_ia_t *resultado, uint32_t espera_ms) {
+    uint32_t limite = ztimer_now(ZTIMER_MSEC) + espera_ms;
+
+    while (1) {
+        int byte;
+        while ((byte = tsrb_get_one(&buffer_rx)) >= 0) {
+            if (!procesar_byte((uint8_t)byte)) {
+                continue;
+            }
+            if (parser.tipo != ENLACE_IA_RESULTADO || parser.longitud != ENLACE_IA_TAM_RESULTADO ||
+                leer_u16(&parser.datos[0]) != secuencia_solicitud) {
+                stats.ajenas++;
+                continue;
+            }
+
+            resultado->secuencia = leer_u16(&parser.datos[0]);
+            resultado->cuadro = leer_u32(&parser.datos[2]);
+            resultado->sin_estres = leer_u16(&parser.datos[6]);
+            resultado->estres = leer_u16(&parser.datos[8]);
+            resultado->inferencia_us = leer_u32(&parser.datos[10]);
+            resultado->latencia_us = xtimer_now_usec() - inicio_solicitud_us;
+
+            stats.respuestas++;
+            stats.latencia_ultima_us = resultado->latencia_us;
+            if (resultado->latencia_us > stats.latencia_max_us) {
+                stats.latencia_max_us = resultado->latencia_us;
+            }
+            return 0;
+        }
+
+        int32_t restante = (int32_t)(limite - ztimer_now(ZTIMER_MSEC));
+        if (restante <= 0 ||
+            ztimer_mutex_lock_timeout(ZTIMER_MSEC, &hay_datos, (uint32_t)restante) != 0) {
+            if (tsrb_empty(&buffer_rx)) {
+                if (espera_ms > 0) {
+                    stats.timeouts++;
+                }
+                return -ETIMEDOUT;
+            }
+        }
+    }
+}
+
+const enlace_ia_stats_t *enlace_ia_stats(void) {
+    return &stats;
+}
+#endif
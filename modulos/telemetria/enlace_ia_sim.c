@@ -0,0 +1,64 @@
+#include "simulacion.h"
+
+#if SIMULACION
+#include <errno.h>
+#include <stdbool.h>
+#include "enlace_ia.h"
+#include "xtimer.h"
+
+// XIAO simulada para la placa native: cada solicitud se responde al momento
+// con la confianza de la traza, como si la cámara hubiera clasificado un
+// cuadro nuevo
+#define ENLACE_IA_SIM_INFERENCIA_US (180000U)  // Invoke() típico en la XIAO
+
+static uint16_t secuencia_solicitud;
+static uint32_t cuadro;
+static uint32_t inicio_solicitud_us;
+static bool pendiente;
+static enlace_ia_stats_t stats;
+
+int enlace_ia_init(uart_t uart, uint32_t baudios) {
+    (void)uart;
+    (void)baudios;
+    return UART_OK;
+}
+
+int enlace_ia_solicitar(void) {
+    secuencia_solicitud++;
+    inicio_solicitud_us = xtimer_now_usec();
+    pendiente = true;
+    stats.solicitudes++;
+    return 0;
+}
+
+int enlace_ia_esperar(resultado_ia_t *resultado, uint32_t espera_ms) {
+    sim_valores_t valores;
+
+    if (!pendiente) {
+        if (espera_ms > 0) {
+            stats.timeouts++;
+        }
+        return -ETIMEDOUT;
+    }
+    pendiente = false;
+
+    sim_leer(&valores);
+    resultado->secuencia = secuencia_solicitud;
+    resultado->cuadro = ++cuadro;
+    resultado->sin_estres = valores.sin_estres;
+    resultado->estres = 1000 - valores.sin_estres;
+    resultado->inferencia_us = ENLACE_IA_SIM_INFERENCIA_US;
+    resultado->latencia_us = xtimer_now_usec() - inicio_solicitud_us;
+
+    stats.respuestas++;
+    stats.latencia_ultima_us = resultado->latencia_us;
+    if (resultado->latencia_us > stats.latencia_max_us) {
+        stats.latencia_max_us = resultado->latencia_us;
+    }
+    return 0;
+}
+
+const enlace_ia_stats_t *enlace_ia_stats(void) {
+    return &stats;
+}
+#endif
@@ -0,0 +1,41 @@
+#ifndef AGREGADO_H
+#define AGREGADO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "trama.h"
+
+// Agregación por ventanas: las lecturas se acumulan en enteros (décimas) y al
+// cerrar la ventana se obtienen mínimo, máximo, media y desviación típica sin
+// guardar las lecturas individuales
+typedef struct {
+    uint16_t cuenta;
+    int16_t min;
+    int16_t max;
+    int32_t suma;
+    uint64_t suma_cuadrados;
+} acumulador_t;
+
+typedef struct {
+    acumulador_t temperatura;
+    acumulador_t humedad;
+    acumulador_t suelo;
+    acumulador_t estres;
+    uint16_t lecturas;
+    uint32_t inicio;            // Tiempo de la primera lectura de la ventana
+    uint32_t fin;               // Tiempo de la última lectura de la ventana
+} ventana_t;
+
+void ventana_reiniciar(ventana_t *v);
+
+// Suma una lectura; los campos ausentes no cuentan para su magnitud
+void ventana_agregar(ventana_t *v, const muestra_t *lectura);
+
+// Segundos cubiertos por la ventana desde su primera lectura
+uint32_t ventana_duracion_s(const ventana_t *v);
+
+// Escribe el resumen en muestra (sin secuencia) y vacía la ventana; devuelve
+// false si la ventana no tenía lecturas
+bool ventana_cerrar(ventana_t *v, muestra_t *resumen);
+
+#endif
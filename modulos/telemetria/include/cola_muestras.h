@@ -0,0 +1,46 @@
+#ifndef COLA_MUESTRAS_H
+#define COLA_MUESTRAS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "mutex.h"
+#include "trama.h"
+
+// Capacidad de la cola en muestras (64 muestras = ~10 min a una muestra cada 10 s)
+#ifndef COLA_MUESTRAS_TAM
+#define COLA_MUESTRAS_TAM   (64U)
+#endif
+
+// Cola circular en RAM de muestras pendientes de publicar. Si se llena se
+// descarta la muestra más antigua para conservar siempre las más recientes.
+typedef struct {
+    muestra_t muestras[COLA_MUESTRAS_TAM];
+    unsigned inicio;            // Índice de la muestra más antigua
+    unsigned cantidad;          // Muestras almacenadas
+    uint32_t encoladas;         // Total de muestras agregadas
+    uint32_t descartadas;       // Muestras perdidas por desbordamiento
+    uint32_t enviadas;          // Muestras retiradas tras publicarse
+    mutex_t lock;
+} cola_muestras_t;
+
+void cola_muestras_init(cola_muestras_t *cola);
+
+// Agrega una muestra; devuelve 1 si hubo que descartar la más antigua
+int cola_muestras_agregar(cola_muestras_t *cola, const muestra_t *muestra);
+
+// Copia hasta max muestras, empezando por la más antigua, sin retirarlas
+size_t cola_muestras_ver(cola_muestras_t *cola, muestra_t *destino, size_t max);
+
+// Como cola_muestras_ver, pero saltando las muestras hasta ultima_secuencia
+// (inclusive), que ya están enviadas a la espera de confirmación
+size_t cola_muestras_ver_tras(cola_muestras_t *cola, uint16_t ultima_secuencia,
+                              muestra_t *destino, size_t max);
+
+// Retira las muestras más antiguas hasta la secuencia indicada (inclusive),
+// ya publicadas. Usar la secuencia y no una cantidad evita retirar muestras
+// equivocadas si la cola se desbordó mientras se publicaba.
+void cola_muestras_confirmar(cola_muestras_t *cola, uint16_t ultima_secuencia);
+
+unsigned cola_muestras_cantidad(cola_muestras_t *cola);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef ENLACE_IA_H
+#define ENLACE_IA_H
+
+#include <stdint.h>
+#include "periph/uart.h"
+
+// Protocolo por UART con la XIAO ESP32-S3 (avocado_ia/enlace_nodo.h)
+//
+// Trama: sync (0xA5) | tipo (u8) | longitud (u8) | datos | crc (u16)
+// El CRC-16/CCITT (0x1021, inicial 0xFFFF) cubre tipo, longitud y datos; los
+// campos multibyte van en little-endian.
+//
+// Solicitud (nodo -> XIAO), 2 bytes de datos:
+//   secuencia (u16)
+// Resultado (XIAO -> nodo), 14 bytes de datos:
+//   secuencia (u16) | cuadro (u32) | sin_estres (u16, ‰) | estres (u16, ‰) |
+//   inferencia_us (u32)
+#define ENLACE_IA_SYNC              (0xA5U)
+#define ENLACE_IA_SOLICITUD         (0x01U)
+#define ENLACE_IA_RESULTADO         (0x81U)
+#define ENLACE_IA_MAX_DATOS         (16U)
+#define ENLACE_IA_TAM_RESULTADO     (14U)
+
+typedef struct {
+    uint16_t secuencia;         // Solicitud a la que responde
+    uint32_t cuadro;            // Número de cuadro clasificado en la XIAO
+    uint16_t sin_estres;        // Probabilidad de "sin estrés" en ‰
+    uint16_t estres;            // Probabilidad de "estrés" en ‰
+    uint32_t inferencia_us;     // Tiempo de Invoke() en la XIAO
+    uint32_t latencia_us;       // Desde la solicitud hasta la respuesta
+} resultado_ia_t;
+
+typedef struct {
+    uint32_t solicitudes;
+    uint32_t respuestas;
+    uint32_t timeouts;
+    uint32_t errores_crc;
+    uint32_t ajenas;            // Tramas válidas que no responden a la solicitud en curso
+    uint32_t desbordes;         // Bytes perdidos con el buffer de recepción lleno
+    uint32_t latencia_ultima_us;
+    uint32_t latencia_max_us;
+} enlace_ia_stats_t;
+
+int enlace_ia_init(uart_t uart, uint32_t baudios);
+
+// Envía una solicitud; la XIAO captura y clasifica un cuadro nuevo
+int enlace_ia_solicitar(void);
+
+// Espera la respuesta a la última solicitud; 0 si llegó, <0 si no. Con
+// espera_ms 0 solo mira lo ya recibido y no cuenta como timeout.
+int enlace_ia_esperar(resultado_ia_t *resultado, uint32_t espera_ms);
+
+const enlace_ia_stats_t *enlace_ia_stats(void);
+
+#endif
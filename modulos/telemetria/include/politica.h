@@ -0,0 +1,57 @@
+#ifndef POLITICA_H
+#define POLITICA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "trama.h"
+
+// Política de reporte por cambio (send-on-delta) con intervalo adaptativo.
+// Una muestra solo se publica si algún valor se movió más que su banda
+// muerta respecto a lo último publicado, o si venció el latido.
+typedef struct {
+    bool activa;                // false: se publica todo cada intervalo_base_s
+    uint16_t banda_temp;        // Décimas de °C
+    uint16_t banda_hum;         // Décimas de % de humedad relativa
+    uint16_t banda_suelo;       // Décimas de % de humedad del suelo
+    uint16_t latido_s;          // Tiempo máximo sin publicar
+    uint16_t intervalo_base_s;  // Intervalo de muestreo sin política
+    uint16_t intervalo_min_s;   // Muestreo más rápido (valores cambiando)
+    uint16_t intervalo_max_s;   // Muestreo más lento (valores estables)
+} politica_config_t;
+
+typedef struct {
+    uint32_t evaluadas;
+    uint32_t por_cambio;        // Publicadas por superar la banda muerta
+    uint32_t por_latido;        // Publicadas por vencer el latido
+    uint32_t suprimidas;        // Descartadas por no aportar información
+} politica_stats_t;
+
+// Estado completo de la política; lo guarda quien la usa (puede vivir en la
+// RAM del RTC para sobrevivir al sueño profundo)
+typedef struct {
+    politica_config_t config;
+    politica_stats_t stats;
+    muestra_t ultima_publicada;
+    muestra_t ultima_muestra;
+    bool hay_publicada;
+    bool hay_muestra;
+    uint32_t tiempo_publicacion_s;
+    uint16_t intervalo_actual_s;
+} politica_t;
+
+void politica_init(politica_t *p, bool activa, uint16_t intervalo_base_s);
+
+// Decide si la muestra debe publicarse y ajusta el intervalo de muestreo
+bool politica_evaluar(politica_t *p, const muestra_t *muestra, uint32_t ahora_s);
+
+// Segundos hasta la próxima muestra
+uint16_t politica_intervalo_s(const politica_t *p);
+
+// Cambia un parámetro por nombre ("banda_temp", "latido", ...). Los valores
+// de banda se expresan en unidades del sensor con un decimal ("0.5").
+int politica_configurar(politica_t *p, const char *clave, const char *valor);
+
+// Aplica una cadena "clave=valor clave=valor ..." (mensajes de bajada)
+int politica_configurar_texto(politica_t *p, char *texto);
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef PUBLICADOR_H
+#define PUBLICADOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "net/sock/udp.h"
+#include "thread.h"
+
+// Publicación MQTT-SN con QoS 1 y una ventana de mensajes en vuelo (modo fiable)
+//
+// Cliente propio, aparte de emcute (cuyo emcute_pub con QoS 1 espera cada
+// PUBACK antes de volver), con su propia sesión en el gateway. Enviar no
+// espera: el mensaje queda en la ventana con su msg_id y el hilo de
+// recepción lo marca al llegar el PUBACK correspondiente. Si vence su plazo
+// se reenvía con la bandera DUP; el plazo (RTO) se calcula como en TCP
+// (RFC 6298) con el RTT de los mensajes que no hubo que reenviar, y se
+// duplica una vez por pérdida: solo lo enviado después del último retroceso
+// puede provocar otro. Tras PUBLICADOR_INTENTOS reenvíos sin respuesta
+// se da la sesión por perdida y se vacía la ventana.
+//
+// Las confirmaciones se entregan en el orden de envío: publicador_confirmadas
+// da la etiqueta del último mensaje confirmado cuyos anteriores también lo
+// están, de modo que el llamador puede retirar de su cola todo hasta ahí.
+//
+// Todo salvo el hilo de recepción debe llamarse desde un único hilo, que es
+// el que recibe los avisos. publicador_conectar y el registro de un tema
+// nuevo (dentro de publicador_enviar) sí esperan la respuesta del gateway.
+#define PUBLICADOR_VENTANA          (4U)
+#define PUBLICADOR_TAM_MENSAJE      (320U)
+#define PUBLICADOR_MAX_TEMAS        (4U)
+#define PUBLICADOR_LONGITUD_TEMA    (48U)
+#define PUBLICADOR_INTENTOS         (4U)    // Reenvíos antes de dar la sesión por perdida
+#define PUBLICADOR_ESPERA_MS        (1000U) // Por intento de CONNECT o REGISTER
+#define PUBLICADOR_KEEPALIVE_S      (600U)
+
+// Plazo de retransmisión
+#define PUBLICADOR_RTO_INICIAL_MS   (1000U)
+#define PUBLICADOR_RTO_MIN_MS       (200U)
+#define PUBLICADOR_RTO_MAX_MS       (8000U)
+#define PUBLICADOR_GRANULARIDAD_MS  (10U)
+#define PUBLICADOR_MUESTRAS_RTT     (32U)   // Últimos RTT guardados para los percentiles
+
+#define PUBLICADOR_SIN_ETIQUETA     (UINT32_MAX)    // Mensaje que no confirma nada
+#define PUBLICADOR_SIN_PLAZO        (UINT32_MAX)
+#define PUBLICADOR_MSG_AVISO        (0x4D02)        // Confirmaciones nuevas o sesión perdida
+
+typedef struct {
+    uint32_t enviados;          // Mensajes distintos puestos en vuelo
+    uint32_t confirmados;
+    uint32_t reenvios;
+    uint32_t perdidos;          // Sin PUBACK al perderse la sesión
+    uint32_t rechazados;        // PUBACK con código de error
+    uint32_t ventana_llena;     // Envíos rechazados por no quedar hueco
+    uint32_t sesiones;
+    uint32_t srtt_ms;
+    uint32_t rttvar_ms;
+    uint32_t rto_ms;
+    unsigned en_vuelo;
+    unsigned en_vuelo_max;
+    bool conectado;
+} publicador_stats_t;
+
+// Abre el socket hacia el gateway y arranca el hilo de recepción; los avisos
+// (PUBLICADOR_MSG_AVISO) van al hilo avisar
+int publicador_iniciar(const sock_udp_ep_t *gateway, const char *id_cliente, kernel_pid_t avisar);
+
+// Abre una sesión limpia; devuelve 0 con CONNACK aceptado
+int publicador_conectar(void);
+
+bool publicador_conectado(void);
+
+// Huecos libres en la ventana
+unsigned publicador_libres(void);
+
+// Pone un PUBLISH con QoS 1 en vuelo sin esperar el PUBACK. Devuelve 0, o
+// -EAGAIN con la ventana llena, -ENOTCONN sin sesión, -EMSGSIZE si no cabe o
+// -EIO si no se pudo registrar el tema.
+int publicador_enviar(const char *tema, const void *datos, size_t len, uint32_t etiqueta);
+
+// Reenvía lo que ha vencido; devuelve los ms hasta el próximo plazo o
+// PUBLICADOR_SIN_PLAZO si no hay nada en vuelo
+uint32_t publicador_revisar(void);
+
+// true si hay confirmaciones nuevas; etiqueta es la de la última en orden
+bool publicador_confirmadas(uint32_t *etiqueta);
+
+void publicador_stats(publicador_stats_t *stats);
+
+// Percentiles 50 y 90 y máximo de los últimos RTT; devuelve cuántos hay
+unsigned publicador_rtt(uint32_t *p50, uint32_t *p90, uint32_t *max);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef RELOJ_H
+#define RELOJ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "net/sock/udp.h"
+
+// Hora real a partir del servicio de hora del router de borde (router_borde/hora.h)
+//
+// Un solo intercambio UDP da el desfase entre la hora Unix y el reloj del
+// nodo (que sigue contando durante el sueño profundo). Con él se convierte
+// cualquier tiempo del nodo, también el de muestras tomadas antes de
+// sincronizar o que esperaron en la cola.
+#define RELOJ_PUERTO                (12346U)
+#define RELOJ_VERSION               (1U)
+#define RELOJ_TAM_PETICION          (5U)
+#define RELOJ_TAM_RESPUESTA         (14U)
+#define RELOJ_SINCRONIZADO          (1U)    // Estado del router con hora válida
+
+#define RELOJ_INTENTOS              (3U)
+#define RELOJ_ESPERA_MS             (300U)  // Por intento
+#define RELOJ_RTT_MAX_MS            (1000U) // Error máximo aceptado: la mitad
+#ifndef RELOJ_PERIODO_S
+#define RELOJ_PERIODO_S             (3600U) // Entre sincronizaciones con hora válida
+#endif
+#define RELOJ_REINTENTO_S           (60U)   // Tras un fallo sin hora válida
+
+typedef struct {
+    int64_t desfase_ms;         // Hora Unix menos reloj del nodo
+    bool valido;
+    bool intentado;
+    uint32_t ultimo_intento_s;  // Reloj del nodo
+    uint32_t ultima_sync_s;
+    uint32_t rtt_ms;            // Ida y vuelta de la última sincronización
+    int32_t correccion_ms;      // Cambio del desfase en la última sincronización
+    uint32_t sincronizaciones;
+    uint32_t fallos;
+} reloj_t;
+
+void reloj_init(reloj_t *reloj);
+
+// Indica si toca sincronizar; ahora_s es el reloj del nodo
+bool reloj_vencido(const reloj_t *reloj, uint32_t ahora_s);
+
+// Pide la hora al servidor; ahora_ms da el reloj del nodo en ms. Devuelve 0
+// si el desfase quedó actualizado.
+int reloj_sincronizar(reloj_t *reloj, const sock_udp_ep_t *servidor,
+                      uint64_t (*ahora_ms)(void));
+
+// Segundos que hay que sumar al reloj del nodo para tener hora Unix; 0 si
+// todavía no hay hora válida
+uint32_t reloj_desfase_s(const reloj_t *reloj);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SIMULACION_H
+#define SIMULACION_H
+
+#include <stdint.h>
+
+// Simulación del nodo en la placa native de RIOT (make BOARD=native)
+//
+// Los drivers del DHT11, del HW080 y el enlace con la XIAO se sustituyen por
+// versiones que leen de una traza, así se pueden lanzar muchas instancias en
+// un mismo equipo (simulacion/lanzar.py). Cada instancia se configura con
+// variables de entorno:
+//   NODO_ID          número del nodo (por defecto, ID_NODO)
+//   SIM_INTERVALO_S  intervalo de muestreo (por defecto, RETRASO_SENSOR)
+//   SIM_TRAZA        CSV con "segundos,temperatura,humedad,humedad_suelo,sin_estres"
+//                    (°C, %, %, % y % de confianza); sin ella se genera una
+//                    traza sintética con ciclo diario y ruido
+// La traza se repite en bucle y cada nodo la empieza desfasado según su
+// número para que no publiquen todos los mismos valores.
+#ifndef SIMULACION
+#define SIMULACION                  0
+#endif
+
+#define SIM_MAX_PUNTOS              (2048U)
+#define SIM_DESFASE_NODO_S          (997U)  // Desfase de la traza entre nodos consecutivos
+
+typedef struct {
+    int16_t temperatura;        // Décimas de °C
+    uint16_t humedad;           // Décimas de %
+    uint16_t humedad_suelo;     // Décimas de %
+    uint16_t sin_estres;        // Confianza de "sin estrés" en ‰
+} sim_valores_t;
+
+// Lee el entorno y carga la traza; llamar antes de arrancar los hilos
+void sim_iniciar(const char *id_por_defecto, uint16_t intervalo_por_defecto);
+
+const char *sim_id_nodo(void);
+uint16_t sim_intervalo_s(void);
+
+// Valores de la traza en el instante actual, con ruido de lectura
+void sim_leer(sim_valores_t *valores);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef TRAMA_H
+#define TRAMA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Trama compacta de telemetría (modo compacto)
+//
+// Todos los campos multibyte van en little-endian.
+//
+// Cabecera (9 bytes):
+//   version (u8) | banderas (u8) | id_nodo (u16) | num_registros (u8) | tiempo_envio (u32)
+//
+// Registro (13 bytes, uno por muestra):
+//   secuencia (u16) | tiempo (u32) | temperatura (i16) | humedad (u16) |
+//   humedad_suelo (u16) | estres (u8)
+//
+// Con TRAMA_BANDERA_RESUMEN cada registro resume una ventana de lecturas: los
+// campos anteriores llevan la media y se añaden 20 bytes más:
+//   cuenta (u16) | temp_min (i16) | temp_max (i16) | temp_desv (u16) |
+//   hum_min (i16) | hum_max (i16) | hum_desv (u16) |
+//   suelo_min (i16) | suelo_max (i16) | suelo_desv (u16)
+//
+// Los tiempos son segundos desde el arranque del nodo; el servidor los
+// convierte a hora real usando tiempo_envio como referencia. Con
+// TRAMA_BANDERA_HORA el nodo ya tiene hora del router y todos los tiempos,
+// también tiempo_envio, son segundos Unix.
+#define TRAMA_VERSION               (1U)
+#define TRAMA_TAM_CABECERA          (9U)
+#define TRAMA_TAM_REGISTRO          (13U)
+#define TRAMA_TAM_RESUMEN           (20U)
+#define TRAMA_BANDERA_RESUMEN       (0x01U)
+#define TRAMA_BANDERA_HORA          (0x02U)
+
+// Valores que indican que el sensor no aporta ese campo
+#define TRAMA_TEMP_AUSENTE          (INT16_MIN)
+#define TRAMA_VALOR_AUSENTE         (UINT16_MAX)
+#define TRAMA_ESTRES_AUSENTE        (UINT8_MAX)
+
+// Dispersión de una magnitud dentro de una ventana, en las mismas unidades
+typedef struct {
+    int16_t min;
+    int16_t max;
+    uint16_t desv;              // Desviación típica
+} dispersion_t;
+
+typedef struct {
+    uint16_t secuencia;         // Número de muestra del nodo
+    uint32_t tiempo;            // Segundos desde el arranque al tomar la muestra
+    int16_t temperatura;        // Décimas de °C
+    uint16_t humedad;           // Décimas de % de humedad relativa
+    uint16_t humedad_suelo;     // Décimas de % de humedad del suelo
+    uint8_t estres;             // Confianza de "sin estrés" en % (0-100)
+    uint16_t cuenta;            // Lecturas resumidas; 0 si es una lectura suelta
+    dispersion_t disp_temperatura;
+    dispersion_t disp_humedad;
+    dispersion_t disp_suelo;
+} muestra_t;
+
+// Codifica num muestras en buf; devuelve el tamaño de la trama o 0 si no cabe.
+// desfase_s se suma a todos los tiempos para pasarlos a hora Unix; con 0 se
+// envían relativos al arranque.
+size_t trama_codificar(uint8_t *buf, size_t tam, uint16_t id_nodo, uint32_t tiempo_envio,
+                       uint32_t desfase_s, const muestra_t *muestras, size_t num);
+
+#endif
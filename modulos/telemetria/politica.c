@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "politica.h"
+
+static uint32_t distancia(int32_t a, int32_t b) {
+    return (a > b) ? (uint32_t)(a - b) : (uint32_t)(b - a);
+}
+
+// Un campo cambió si está presente en ambas muestras y se movió más que la banda
+static bool supera_banda(int32_t a, int32_t b, int32_t ausente, uint16_t banda) {
+    if (a == ausente || b == ausente) {
+        return a != b;
+    }
+    return distancia(a, b) > banda;
+}
+
+static bool hubo_cambio(const politica_config_t *config, const muestra_t *a, const muestra_t *b) {
+    return supera_banda(a->temperatura, b->temperatura, TRAMA_TEMP_AUSENTE, config->banda_temp) ||
+           supera_banda(a->humedad, b->humedad, TRAMA_VALOR_AUSENTE, config->banda_hum) ||
+           supera_banda(a->humedad_suelo, b->humedad_suelo, TRAMA_VALOR_AUSENTE, config->banda_suelo) ||
+           ((a->estres >= 50) != (b->estres >= 50));
+}
+
+void politica_init(politica_t *p, bool activa, uint16_t intervalo_base_s) {
+    memset(p, 0, sizeof(*p));
+    p->config = (politica_config_t){
+        .activa = activa,
+        .banda_temp = 5,
+        .banda_hum = 20,
+        .banda_suelo = 20,
+        .latido_s = 300,
+        .intervalo_base_s = intervalo_base_s,
+        .intervalo_min_s = 5,
+        .intervalo_max_s = 60,
+    };
+    p->intervalo_actual_s = intervalo_base_s;
+}
+
+bool politica_evaluar(politica_t *p, const muestra_t *muestra, uint32_t ahora_s) {
+    p->stats.evaluadas++;
+
+    if (!p->config.activa) {
+        p->intervalo_actual_s = p->config.intervalo_base_s;
+        return true;
+    }
+
+    // Intervalo adaptativo: se reduce a la mitad si los valores se mueven
+    // entre muestras consecutivas y se duplica mientras estén estables
+    uint32_t intervalo = p->intervalo_actual_s;
+    if (p->hay_muestra && hubo_cambio(&p->config, muestra, &p->ultima_muestra)) {
+        intervalo /= 2;
+    } else {
+        intervalo *= 2;
+    }
+    if (intervalo < p->config.intervalo_min_s) {
+        intervalo = p->config.intervalo_min_s;
+    }
+    if (intervalo > p->config.intervalo_max_s) {
+        intervalo = p->config.intervalo_max_s;
+    }
+    p->intervalo_actual_s = (uint16_t)intervalo;
+    p->ultima_muestra = *muestra;
+    p->hay_muestra = true;
+
+    bool publicar;
+    if (!p->hay_publicada || hubo_cambio(&p->config, muestra, &p->ultima_publicada)) {
+        p->stats.por_cambio++;
+        publicar = true;
+    } else if (ahora_s - p->tiempo_publicacion_s >= p->config.latido_s) {
+        p->stats.por_latido++;
+        publicar = true;
+    } else {
+        p->stats.suprimidas++;
+        publicar = false;
+    }
+
+    if (publicar) {
+        p->ultima_publicada = *muestra;
+        p->hay_publicada = true;
+        p->tiempo_publicacion_s = ahora_s;
+    }
+    return publicar;
+}
+
+uint16_t politica_intervalo_s(const politica_t *p) {
+    return p->config.activa ? p->intervalo_actual_s : p->config.intervalo_base_s;
+}
+
+// Convierte "1.5" en 15 décimas; -1 si no es un valor válido
+static int leer_decimas(const char *texto) {
+    char *fin;
+    long decimas = strtol(texto, &fin, 10) * 10;
+
+    if (fin == texto || decimas < 0) {
+        return -1;
+    }
+    if (*fin == '.' && fin[1] >= '0' && fin[1] <= '9') {
+        decimas += fin[1] - '0';
+    }
+    return (decimas > UINT16_MAX) ? -1 : (int)decimas;
+}
+
+int politica_configurar(politica_t *p, const char *clave, const char *valor) {
+    if (strcmp(clave, "activa") == 0) {
+        p->config.activa = (strcmp(valor, "on") == 0 || strcmp(valor, "1") == 0);
+        p->hay_publicada = false;
+        return 0;
+    }
+
+    if (strncmp(clave, "banda_", 6) == 0) {
+        int decimas = leer_decimas(valor);
+        if (decimas < 0) {
+            return -1;
+        }
+        if (strcmp(clave, "banda_temp") == 0) {
+            p->config.banda_temp = decimas;
+        } else if (strcmp(clave, "banda_hum") == 0) {
+            p->config.banda_hum = decimas;
+        } else if (strcmp(clave, "banda_suelo") == 0) {
+            p->config.banda_suelo = decimas;
+        } else {
+            return -1;
+        }
+        return 0;
+    }
+
+    int segundos = atoi(valor);
+    if (segundos <= 0 || segundos > UINT16_MAX) {
+        return -1;
+    }
+    if (strcmp(clave, "latido") == 0) {
+        p->config.latido_s = segundos;
+    } else if (strcmp(clave, "intervalo") == 0) {
+        p->config.intervalo_base_s = segundos;
+    } else if (strcmp(clave, "intervalo_min") == 0 && segundos <= p->config.intervalo_max_s) {
+        p->config.intervalo_min_s = segundos;
+    } else if (strcmp(clave, "intervalo_max") == 0 && segundos >= p->config.intervalo_min_s) {
+        p->config.intervalo_max_s = segundos;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int politica_configurar_texto(politica_t *p, char *texto) {
+    int errores = 0;
+    char *resto = texto;
+    char *par;
+
+    while ((par = strtok_r(resto, " ,;\n", &resto)) != NULL) {
+        char *igual = strchr(par, '=');
+        if (igual == NULL) {
+            errores++;
+            continue;
+        }
+        *igual = '\0';
+        if (politica_configurar(p, par, igual + 1) != 0) {
+            printf("Política: parámetro no válido '%s'\n", par);
+            errores++;
+        }
+    }
+    return errores ? -1 : 0;
+}
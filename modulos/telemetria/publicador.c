@@ -0,0 +1,510 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "msg.h"
+#include "mutex.h"
+#include "ztimer.h"
+
+#include "publicador.h"
+
+#define MQTTSN_CONNECT          (0x04)
+#define MQTTSN_CONNACK          (0x05)
+#define MQTTSN_REGISTER         (0x0A)
+#define MQTTSN_REGACK           (0x0B)
+#define MQTTSN_PUBLISH          (0x0C)
+#define MQTTSN_PUBACK           (0x0D)
+#define MQTTSN_DISCONNECT       (0x18)
+
+#define MQTTSN_ACEPTADO         (0x00)
+#define MQTTSN_TEMA_INVALIDO    (0x02)
+
+#define MQTTSN_DUP              (0x80)
+#define MQTTSN_QOS_1            (0x20)
+#define MQTTSN_SESION_LIMPIA    (0x04)
+#define MQTTSN_PROTOCOLO        (0x01)
+
+#define TAM_RESPUESTA           (16U)   // CONNACK, REGACK y PUBACK son cortos
+
+typedef struct {
+    bool confirmado;
+    uint8_t reenvios;
+    uint16_t msg_id;
+    uint32_t etiqueta;
+    uint32_t enviado_ms;
+    uint32_t plazo_ms;
+    size_t pos_banderas;        // Donde poner DUP al reenviar
+    size_t len;
+    uint8_t mensaje[PUBLICADOR_TAM_MENSAJE];
+} en_vuelo_t;
+
+typedef struct {
+    char nombre[PUBLICADOR_LONGITUD_TEMA];
+    uint16_t id;
+} tema_t;
+
+static char pila_recepcion[THREAD_STACKSIZE_DEFAULT];
+static sock_udp_t sock;
+static const char *cliente;
+static kernel_pid_t pid_aviso = KERNEL_PID_UNDEF;
+static bool iniciado = false;
+
+// Compartido con el hilo de recepción
+static mutex_t lock = MUTEX_INIT;
+static en_vuelo_t ventana[PUBLICADOR_VENTANA];     // En orden de envío
+static unsigned primero = 0;
+static unsigned cantidad = 0;
+static bool hay_confirmadas = false;
+static uint32_t confirmada_hasta;
+static uint16_t siguiente_id = 1;
+static bool hay_rtt = false;
+static uint16_t rtts[PUBLICADOR_MUESTRAS_RTT];
+static unsigned num_rtts = 0;
+static unsigned siguiente_rtt = 0;
+static publicador_stats_t stats = { .rto_ms = PUBLICADOR_RTO_INICIAL_MS };
+static bool hay_retroceso = false;
+static uint32_t retroceso_ms;       // Último vencimiento que duplicó el RTO
+
+// Respuesta que espera publicador_conectar o el registro de un tema
+static mutex_t respuesta = MUTEX_INIT_LOCKED;
+static uint8_t esperado = 0;
+static uint16_t esperado_id;
+static uint8_t codigo;
+static uint16_t id_registrado;
+
+// Solo los usa el hilo que publica
+static tema_t temas[PUBLICADOR_MAX_TEMAS];
+static unsigned num_temas = 0;
+
+static uint16_t nuevo_id(void) {
+    uint16_t id = siguiente_id++;
+    if (siguiente_id == 0) {
+        siguiente_id = 1;
+    }
+    return id;
+}
+
+static void avisar(void) {
+    msg_t msg = { .type = PUBLICADOR_MSG_AVISO };
+    msg_try_send(&msg, pid_aviso);
+}
+
+// Con lock tomado. Lo que quedaba en vuelo se da por perdido: el llamador
+// lo volverá a enviar en la próxima sesión.
+static void vaciar_ventana(void) {
+    for (unsigned i = 0; i < cantidad; i++) {
+        if (!ventana[(primero + i) % PUBLICADOR_VENTANA].confirmado) {
+            stats.perdidos++;
+        }
+    }
+    cantidad = 0;
+    stats.en_vuelo = 0;
+    stats.conectado = false;
+}
+
+// Con lock tomado. Los temas se vuelven a registrar al reconectar.
+static void perder_sesion(void) {
+    vaciar_ventana();
+    avisar();
+}
+
+// RFC 6298: SRTT y RTTVAR con pesos 1/8 y 1/4, RTO = SRTT + 4 * RTTVAR
+static void anotar_rtt(uint32_t rtt_ms) {
+    if (!hay_rtt) {
+        stats.srtt_ms = rtt_ms;
+        stats.rttvar_ms = rtt_ms / 2;
+        hay_rtt = true;
+    } else {
+        uint32_t dif = (stats.srtt_ms > rtt_ms) ? stats.srtt_ms - rtt_ms : rtt_ms - stats.srtt_ms;
+        stats.rttvar_ms = (3 * stats.rttvar_ms + dif) / 4;
+        stats.srtt_ms = (7 * stats.srtt_ms + rtt_ms) / 8;
+    }
+
+    uint32_t margen = 4 * stats.rttvar_ms;
+    uint32_t rto = stats.srtt_ms + (margen > PUBLICADOR_GRANULARIDAD_MS ? margen
+                                                                        : PUBLICADOR_GRANULARIDAD_MS);
+    if (rto < PUBLICADOR_RTO_MIN_MS) {
+        rto = PUBLICADOR_RTO_MIN_MS;
+    } else if (rto > PUBLICADOR_RTO_MAX_MS) {
+        rto = PUBLICADOR_RTO_MAX_MS;
+    }
+    stats.rto_ms = rto;
+
+    rtts[siguiente_rtt] = (rtt_ms > UINT16_MAX) ? UINT16_MAX : rtt_ms;
+    siguiente_rtt = (siguiente_rtt + 1) % PUBLICADOR_MUESTRAS_RTT;
+    if (num_rtts < PUBLICADOR_MUESTRAS_RTT) {
+        num_rtts++;
+    }
+}
+
+static void al_confirmar(uint16_t msg_id, uint8_t rc, uint32_t ahora) {
+    mutex_lock(&lock);
+    for (unsigned i = 0; i < cantidad; i++) {
+        en_vuelo_t *m = &ventana[(primero + i) % PUBLICADOR_VENTANA];
+        if (m->msg_id != msg_id || m->confirmado) {
+            continue;
+        }
+
+        if (rc != MQTTSN_ACEPTADO) {
+            // Con el tema olvidado por el gateway no sirve reenviar; ante
+            // congestión se reenvía al vencer el plazo
+            stats.rechazados++;
+            if (rc == MQTTSN_TEMA_INVALIDO) {
+                perder_sesion();
+            }
+            break;
+        }
+
+        // Algoritmo de Karn: el RTT de un mensaje reenviado es ambiguo
+        if (m->reenvios == 0) {
+            anotar_rtt(ahora - m->enviado_ms);
+        }
+        m->confirmado = true;
+        stats.confirmados++;
+        break;
+    }
+
+    // Solo avanzan las confirmaciones consecutivas desde el más antiguo
+    bool avance = false;
+    while (cantidad > 0 && ventana[primero].confirmado) {
+        if (ventana[primero].etiqueta != PUBLICADOR_SIN_ETIQUETA) {
+            confirmada_hasta = ventana[primero].etiqueta;
+            hay_confirmadas = true;
+        }
+        primero = (primero + 1) % PUBLICADOR_VENTANA;
+        cantidad--;
+        avance = true;
+    }
+    stats.en_vuelo = cantidad;
+    if (avance) {
+        avisar();
+    }
+    mutex_unlock(&lock);
+}
+
+static void al_responder(uint8_t tipo, uint16_t id, uint8_t rc, uint16_t tema) {
+    mutex_lock(&lock);
+    if (esperado == tipo && (tipo == MQTTSN_CONNACK || esperado_id == id)) {
+        esperado = 0;
+        codigo = rc;
+        id_registrado = tema;
+        mutex_unlock(&respuesta);
+    }
+    mutex_unlock(&lock);
+}
+
+static void *hilo_recepcion(void *arg) {
+    (void)arg;
+    uint8_t buf[TAM_RESPUESTA];
+
+    while (1) {
+        ssize_t len = sock_udp_recv(&sock, buf, sizeof(buf), SOCK_NO_TIMEOUT, NULL);
+        if (len < 2 || buf[0] != len) {
+            continue;
+        }
+        uint32_t ahora = ztimer_now(ZTIMER_MSEC);
+
+        switch (buf[1]) {
+        case MQTTSN_CONNACK:
+            if (len == 3) {
+                al_responder(MQTTSN_CONNACK, 0, buf[2], 0);
+            }
+            break;
+        case MQTTSN_REGACK:
+            if (len == 7) {
+                al_responder(MQTTSN_REGACK, byteorder_bebuftohs(&buf[4]), buf[6],
+                             byteorder_bebuftohs(&buf[2]));
+            }
+            break;
+        case MQTTSN_PUBACK:
+            if (len == 7) {
+                al_confirmar(byteorder_bebuftohs(&buf[4]), buf[6], ahora);
+            }
+            break;
+        case MQTTSN_DISCONNECT:
+            mutex_lock(&lock);
+            if (stats.conectado) {
+                perder_sesion();
+            }
+            mutex_unlock(&lock);
+            break;
+        default:
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Envía msg y espera su respuesta, reintentando; devuelve el código recibido
+// o -ETIMEDOUT
+static int esperar_respuesta(const uint8_t *msg, size_t len, uint8_t tipo, uint16_t id) {
+    for (unsigned i = 0; i < PUBLICADOR_INTENTOS; i++) {
+        mutex_lock(&lock);
+        esperado = tipo;
+        esperado_id = id;
+        mutex_unlock(&lock);
+        // Descarta una respuesta que llegara tarde a un intento anterior
+        mutex_trylock(&respuesta);
+
+        sock_udp_send(&sock, msg, len, NULL);
+        if (ztimer_mutex_lock_timeout(ZTIMER_MSEC, &respuesta, PUBLICADOR_ESPERA_MS) == 0) {
+            return codigo;
+        }
+    }
+
+    mutex_lock(&lock);
+    esperado = 0;
+    mutex_unlock(&lock);
+    return -ETIMEDOUT;
+}
+
+int publicador_iniciar(const sock_udp_ep_t *gateway, const char *id_cliente, kernel_pid_t avisar_a) {
+    if (iniciado) {
+        return 0;
+    }
+
+    sock_udp_ep_t local = SOCK_IPV6_EP_ANY;
+    if (sock_udp_create(&sock, &local, gateway, 0) < 0) {
+        return -1;
+    }
+    cliente = id_cliente;
+    pid_aviso = avisar_a;
+    iniciado = true;
+
+    thread_create(pila_recepcion, sizeof(pila_recepcion), THREAD_PRIORITY_MAIN - 2, 0,
+                  hilo_recepcion, NULL, "publicador");
+    return 0;
+}
+
+int publicador_conectar(void) {
+    uint8_t msg[6 + PUBLICADOR_LONGITUD_TEMA];
+    size_t len_id = strlen(cliente);
+    if (len_id > PUBLICADOR_LONGITUD_TEMA) {
+        return -EINVAL;
+    }
+
+    msg[0] = 6 + len_id;
+    msg[1] = MQTTSN_CONNECT;
+    msg[2] = MQTTSN_SESION_LIMPIA;
+    msg[3] = MQTTSN_PROTOCOLO;
+    byteorder_htobebufs(&msg[4], PUBLICADOR_KEEPALIVE_S);
+    memcpy(&msg[6], cliente, len_id);
+
+    mutex_lock(&lock);
+    vaciar_ventana();
+    mutex_unlock(&lock);
+    num_temas = 0;
+
+    int res = esperar_respuesta(msg, msg[0], MQTTSN_CONNACK, 0);
+    if (res != MQTTSN_ACEPTADO) {
+        return (res < 0) ? res : -ECONNREFUSED;
+    }
+
+    mutex_lock(&lock);
+    stats.conectado = true;
+    stats.sesiones++;
+    mutex_unlock(&lock);
+    return 0;
+}
+
+bool publicador_conectado(void) {
+    mutex_lock(&lock);
+    bool conectado = stats.conectado;
+    mutex_unlock(&lock);
+    return conectado;
+}
+
+unsigned publicador_libres(void) {
+    mutex_lock(&lock);
+    unsigned libres = PUBLICADOR_VENTANA - cantidad;
+    mutex_unlock(&lock);
+    return libres;
+}
+
+// Devuelve el ID del tema, registrándolo la primera vez en la sesión
+static int obtener_tema(const char *nombre, uint16_t *id) {
+    for (unsigned i = 0; i < num_temas; i++) {
+        if (strcmp(temas[i].nombre, nombre) == 0) {
+            *id = temas[i].id;
+            return 0;
+        }
+    }
+
+    size_t len_nombre = strlen(nombre);
+    if (num_temas == PUBLICADOR_MAX_TEMAS || len_nombre >= PUBLICADOR_LONGITUD_TEMA) {
+        return -ENOSPC;
+    }
+
+    uint8_t msg[6 + PUBLICADOR_LONGITUD_TEMA];
+    mutex_lock(&lock);
+    uint16_t msg_id = nuevo_id();
+    mutex_unlock(&lock);
+    msg[0] = 6 + len_nombre;
+    msg[1] = MQTTSN_REGISTER;
+    byteorder_htobebufs(&msg[2], 0);
+    byteorder_htobebufs(&msg[4], msg_id);
+    memcpy(&msg[6], nombre, len_nombre);
+
+    if (esperar_respuesta(msg, msg[0], MQTTSN_REGACK, msg_id) != MQTTSN_ACEPTADO) {
+        return -EIO;
+    }
+
+    strcpy(temas[num_temas].nombre, nombre);
+    temas[num_temas].id = id_registrado;
+    num_temas++;
+    *id = id_registrado;
+    return 0;
+}
+
+int publicador_enviar(const char *tema, const void *datos, size_t len, uint32_t etiqueta) {
+    if (!publicador_conectado()) {
+        return -ENOTCONN;
+    }
+    if (publicador_libres() == 0) {
+        mutex_lock(&lock);
+        stats.ventana_llena++;
+        mutex_unlock(&lock);
+        return -EAGAIN;
+    }
+    // Longitud de 1 byte hasta 255 y, por encima, 0x01 seguido de 2 bytes
+    size_t total = 7 + len;
+    size_t cabecera = (total > UINT8_MAX) ? 3 : 1;
+    if (total + cabecera - 1 > PUBLICADOR_TAM_MENSAJE) {
+        return -EMSGSIZE;
+    }
+
+    uint16_t id_tema;
+    if (obtener_tema(tema, &id_tema) != 0) {
+        return -EIO;
+    }
+
+    mutex_lock(&lock);
+    // El registro pudo tardar: la sesión pudo caerse mientras tanto
+    if (!stats.conectado) {
+        mutex_unlock(&lock);
+        return -ENOTCONN;
+    }
+
+    en_vuelo_t *m = &ventana[(primero + cantidad) % PUBLICADOR_VENTANA];
+    uint8_t *p = m->mensaje;
+    if (cabecera == 1) {
+        *p++ = (uint8_t)total;
+    } else {
+        total += 2;
+        *p++ = 0x01;
+        byteorder_htobebufs(p, (uint16_t)total);
+        p += 2;
+    }
+    *p++ = MQTTSN_PUBLISH;
+    m->pos_banderas = p - m->mensaje;
+    *p++ = MQTTSN_QOS_1;
+    byteorder_htobebufs(p, id_tema);
+    m->msg_id = nuevo_id();
+    byteorder_htobebufs(p + 2, m->msg_id);
+    memcpy(p + 4, datos, len);
+
+    m->len = total;
+    m->etiqueta = etiqueta;
+    m->confirmado = false;
+    m->reenvios = 0;
+    m->enviado_ms = ztimer_now(ZTIMER_MSEC);
+    m->plazo_ms = m->enviado_ms + stats.rto_ms;
+    cantidad++;
+    stats.enviados++;
+    stats.en_vuelo = cantidad;
+    if (cantidad > stats.en_vuelo_max) {
+        stats.en_vuelo_max = cantidad;
+    }
+
+    // Si no sale ahora, el plazo de retransmisión se encarga
+    sock_udp_send(&sock, m->mensaje, m->len, NULL);
+    mutex_unlock(&lock);
+    return 0;
+}
+
+uint32_t publicador_revisar(void) {
+    uint32_t proximo = PUBLICADOR_SIN_PLAZO;
+
+    mutex_lock(&lock);
+    uint32_t ahora = ztimer_now(ZTIMER_MSEC);
+    for (unsigned i = 0; i < cantidad; i++) {
+        en_vuelo_t *m = &ventana[(primero + i) % PUBLICADOR_VENTANA];
+        if (m->confirmado) {
+            continue;
+        }
+
+        if ((int32_t)(m->plazo_ms - ahora) <= 0) {
+            if (m->reenvios == PUBLICADOR_INTENTOS) {
+                perder_sesion();
+                proximo = PUBLICADOR_SIN_PLAZO;
+                break;
+            }
+
+            // Sin respuesta se supone congestión: el plazo se duplica una vez
+            // por pérdida. Lo enviado antes del último retroceso ya quedó
+            // cubierto por él; si no, cuatro mensajes en vuelo que vencen
+            // juntos multiplicarían el RTO por 16.
+            if (!hay_retroceso || (int32_t)(m->enviado_ms - retroceso_ms) >= 0) {
+                stats.rto_ms = (stats.rto_ms * 2 > PUBLICADOR_RTO_MAX_MS) ? PUBLICADOR_RTO_MAX_MS
+                                                                          : stats.rto_ms * 2;
+                hay_retroceso = true;
+                retroceso_ms = ahora;
+            }
+            m->mensaje[m->pos_banderas] |= MQTTSN_DUP;
+            m->reenvios++;
+            m->enviado_ms = ahora;
+            m->plazo_ms = ahora + stats.rto_ms;
+            stats.reenvios++;
+            sock_udp_send(&sock, m->mensaje, m->len, NULL);
+        }
+
+        uint32_t falta = m->plazo_ms - ahora;
+        if (falta < proximo) {
+            proximo = falta;
+        }
+    }
+    mutex_unlock(&lock);
+
+    return proximo;
+}
+
+bool publicador_confirmadas(uint32_t *etiqueta) {
+    mutex_lock(&lock);
+    bool hay = hay_confirmadas;
+    *etiqueta = confirmada_hasta;
+    hay_confirmadas = false;
+    mutex_unlock(&lock);
+    return hay;
+}
+
+void publicador_stats(publicador_stats_t *s) {
+    mutex_lock(&lock);
+    *s = stats;
+    mutex_unlock(&lock);
+}
+
+unsigned publicador_rtt(uint32_t *p50, uint32_t *p90, uint32_t *max) {
+    uint16_t orden[PUBLICADOR_MUESTRAS_RTT];
+
+    mutex_lock(&lock);
+    unsigned n = num_rtts;
+    memcpy(orden, rtts, n * sizeof(orden[0]));
+    mutex_unlock(&lock);
+
+    // Inserción: son pocas muestras
+    for (unsigned i = 1; i < n; i++) {
+        uint16_t v = orden[i];
+        unsigned j = i;
+        while (j > 0 && orden[j - 1] > v) {
+            orden[j] = orden[j - 1];
+            j--;
+        }
+        orden[j] = v;
+    }
+
+    *p50 = n ? orden[(n - 1) * 50 / 100] : 0;
+    *p90 = n ? orden[(n - 1) * 90 / 100] : 0;
+    *max = n ? orden[n - 1] : 0;
+    return n;
+}
@@ -0,0 +1,110 @@
+#include <string.h>
+
+#include "reloj.h"
+
+static uint32_t leer_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+static uint64_t leer_u64(const uint8_t *p) {
+    return (uint64_t)leer_u32(p) | ((uint64_t)leer_u32(p + 4) << 32);
+}
+
+void reloj_init(reloj_t *reloj) {
+    memset(reloj, 0, sizeof(*reloj));
+}
+
+bool reloj_vencido(const reloj_t *reloj, uint32_t ahora_s) {
+    if (!reloj->intentado) {
+        return true;
+    }
+    if (!reloj->valido) {
+        return ahora_s - reloj->ultimo_intento_s >= RELOJ_REINTENTO_S;
+    }
+    return ahora_s - reloj->ultima_sync_s >= RELOJ_PERIODO_S;
+}
+
+// Un intercambio: devuelve 0 y rellena unix_ms, t1 y t4 si hubo respuesta válida
+static int consultar(sock_udp_t *sock, const sock_udp_ep_t *servidor, uint64_t (*ahora_ms)(void),
+                     uint64_t *unix_ms, uint64_t *t1, uint64_t *t4) {
+    uint8_t peticion[RELOJ_TAM_PETICION];
+    uint8_t respuesta[RELOJ_TAM_RESPUESTA + 1];
+
+    *t1 = ahora_ms();
+    uint32_t origen = (uint32_t)*t1;
+    peticion[0] = RELOJ_VERSION;
+    for (unsigned i = 0; i < 4; i++) {
+        peticion[1 + i] = (origen >> (8 * i)) & 0xFF;
+    }
+    if (sock_udp_send(sock, peticion, sizeof(peticion), servidor) < 0) {
+        return -1;
+    }
+
+    // Las respuestas a intentos anteriores que lleguen tarde se descartan
+    // por el origen
+    while (1) {
+        ssize_t len = sock_udp_recv(sock, respuesta, sizeof(respuesta),
+                                    RELOJ_ESPERA_MS * US_PER_MS, NULL);
+        *t4 = ahora_ms();
+        if (len < 0) {
+            return -1;
+        }
+        if (len == RELOJ_TAM_RESPUESTA && respuesta[0] == RELOJ_VERSION &&
+            leer_u32(&respuesta[2]) == origen) {
+            if (respuesta[1] != RELOJ_SINCRONIZADO) {
+                return -1;
+            }
+            *unix_ms = leer_u64(&respuesta[6]);
+            return 0;
+        }
+        if (*t4 - *t1 >= RELOJ_ESPERA_MS) {
+            return -1;
+        }
+    }
+}
+
+int reloj_sincronizar(reloj_t *reloj, const sock_udp_ep_t *servidor,
+                      uint64_t (*ahora_ms)(void)) {
+    sock_udp_ep_t local = SOCK_IPV6_EP_ANY;
+    sock_udp_t sock;
+
+    reloj->intentado = true;
+    reloj->ultimo_intento_s = ahora_ms() / 1000;
+    if (sock_udp_create(&sock, &local, NULL, 0) < 0) {
+        reloj->fallos++;
+        return -1;
+    }
+
+    int res = -1;
+    for (unsigned i = 0; i < RELOJ_INTENTOS && res != 0; i++) {
+        uint64_t unix_ms, t1, t4;
+        if (consultar(&sock, servidor, ahora_ms, &unix_ms, &t1, &t4) != 0 ||
+            t4 - t1 > RELOJ_RTT_MAX_MS) {
+            continue;
+        }
+
+        // El router tomó la hora a mitad del intercambio, más o menos
+        int64_t desfase_ms = (int64_t)unix_ms - (int64_t)((t1 + t4) / 2);
+        reloj->correccion_ms = reloj->valido ? (int32_t)(desfase_ms - reloj->desfase_ms) : 0;
+        reloj->desfase_ms = desfase_ms;
+        reloj->valido = true;
+        reloj->ultima_sync_s = t4 / 1000;
+        reloj->rtt_ms = (uint32_t)(t4 - t1);
+        reloj->sincronizaciones++;
+        res = 0;
+    }
+    sock_udp_close(&sock);
+
+    if (res != 0) {
+        reloj->fallos++;
+    }
+    return res;
+}
+
+uint32_t reloj_desfase_s(const reloj_t *reloj) {
+    if (!reloj->valido || reloj->desfase_ms <= 0) {
+        return 0;
+    }
+    return (uint32_t)(reloj->desfase_ms / 1000);
+}
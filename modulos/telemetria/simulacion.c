@@ -0,0 +1,168 @@
+#include "simulacion.h"
+
+#if SIMULACION
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xtimer.h"
+
+#define DIA_S                   (86400UL)
+#define CICLO_RIEGO_S           (3 * DIA_S)
+
+typedef struct {
+    uint32_t t;
+    sim_valores_t valores;
+} punto_t;
+
+static const char *id_nodo;
+static uint16_t intervalo_s;
+static uint32_t desfase_s;
+static uint32_t estado_ruido;
+static punto_t traza[SIM_MAX_PUNTOS];
+static unsigned num_puntos = 0;
+static unsigned ultimo_tramo = 0;
+
+// xorshift32: ruido reproducible, distinto por nodo
+static int32_t ruido(int32_t amplitud) {
+    estado_ruido ^= estado_ruido << 13;
+    estado_ruido ^= estado_ruido >> 17;
+    estado_ruido ^= estado_ruido << 5;
+    return (int32_t)(estado_ruido % (2 * amplitud + 1)) - amplitud;
+}
+
+static uint16_t porcentaje(int32_t decimas) {
+    return (uint16_t)((decimas < 0) ? 0 : (decimas > 1000) ? 1000 : decimas);
+}
+
+static int16_t decimas(double v) {
+    return (int16_t)(v * 10 + (v >= 0 ? 0.5 : -0.5));
+}
+
+static void cargar_traza(const char *ruta) {
+    FILE *f = fopen(ruta, "r");
+    if (f == NULL) {
+        printf("sim: no se puede abrir la traza '%s', se usa la sintética\n", ruta);
+        return;
+    }
+
+    char linea[128];
+    while (num_puntos < SIM_MAX_PUNTOS && fgets(linea, sizeof(linea), f) != NULL) {
+        double t;
+        float temp, hum, suelo, sin_estres;
+        // Cabecera y comentarios no empiezan por un número
+        if (sscanf(linea, "%lf,%f,%f,%f,%f", &t, &temp, &hum, &suelo, &sin_estres) != 5) {
+            continue;
+        }
+        punto_t *p = &traza[num_puntos];
+        p->t = (uint32_t)t;
+        p->valores.temperatura = decimas(temp);
+        p->valores.humedad = (uint16_t)decimas(hum);
+        p->valores.humedad_suelo = (uint16_t)decimas(suelo);
+        p->valores.sin_estres = (uint16_t)decimas(sin_estres);
+        // Solo se admiten tiempos crecientes
+        if (num_puntos == 0 || p->t > traza[num_puntos - 1].t) {
+            num_puntos++;
+        }
+    }
+    fclose(f);
+    printf("sim: traza '%s' con %u puntos\n", ruta, num_puntos);
+}
+
+void sim_iniciar(const char *id_por_defecto, uint16_t intervalo_por_defecto) {
+    const char *valor;
+
+    id_nodo = getenv("NODO_ID");
+    if (id_nodo == NULL || atoi(id_nodo) <= 0) {
+        id_nodo = id_por_defecto;
+    }
+
+    intervalo_s = intervalo_por_defecto;
+    valor = getenv("SIM_INTERVALO_S");
+    if (valor != NULL && atoi(valor) > 0) {
+        intervalo_s = (uint16_t)atoi(valor);
+    }
+
+    unsigned numero = (unsigned)atoi(id_nodo);
+    desfase_s = numero * SIM_DESFASE_NODO_S;
+    estado_ruido = 0x9E3779B9UL ^ numero;
+
+    valor = getenv("SIM_TRAZA");
+    if (valor != NULL && valor[0] != '\0') {
+        cargar_traza(valor);
+    }
+    printf("sim: nodo %s, muestra cada %u s, traza %s\n", id_nodo, (unsigned)intervalo_s,
+           num_puntos ? "grabada" : "sintética");
+}
+
+const char *sim_id_nodo(void) {
+    return id_nodo;
+}
+
+uint16_t sim_intervalo_s(void) {
+    return intervalo_s;
+}
+
+// Onda triangular de periodo p entre -1000 y 1000
+static int32_t onda(uint32_t t, uint32_t p) {
+    int32_t v = (int32_t)((uint64_t)(t % p) * 4000 / p);
+    return (v < 2000) ? v - 1000 : 3000 - v;
+}
+
+// Ciclo diario de temperatura y humedad; el suelo se seca durante tres días
+// hasta el siguiente riego y el estrés aparece cuando está seco
+static void sintetica(uint32_t t, sim_valores_t *v) {
+    int32_t dia = onda(t, DIA_S);
+    int32_t seco = (int32_t)((uint64_t)(t % CICLO_RIEGO_S) * 300 / CICLO_RIEGO_S);
+
+    v->temperatura = (int16_t)(220 + 60 * dia / 1000);
+    v->humedad = (uint16_t)(600 - 150 * dia / 1000);
+    v->humedad_suelo = (uint16_t)(600 - seco);
+    v->sin_estres = (v->humedad_suelo < 380) ? 300 : 900;
+}
+
+static int32_t interpolar(int32_t a, int32_t b, uint32_t x, uint32_t dx) {
+    return a + (int32_t)(((int64_t)(b - a) * x) / dx);
+}
+
+static void grabada(uint32_t t, sim_valores_t *v) {
+    uint32_t inicio = traza[0].t;
+    uint32_t duracion = traza[num_puntos - 1].t - inicio;
+    if (duracion == 0) {
+        *v = traza[0].valores;
+        return;
+    }
+
+    uint32_t tt = inicio + t % duracion;
+    if (tt < traza[ultimo_tramo].t) {
+        ultimo_tramo = 0;
+    }
+    while (ultimo_tramo + 1 < num_puntos - 1 && traza[ultimo_tramo + 1].t <= tt) {
+        ultimo_tramo++;
+    }
+
+    const punto_t *a = &traza[ultimo_tramo];
+    const punto_t *b = &traza[ultimo_tramo + 1];
+    uint32_t x = tt - a->t;
+    uint32_t dx = b->t - a->t;
+    v->temperatura = (int16_t)interpolar(a->valores.temperatura, b->valores.temperatura, x, dx);
+    v->humedad = (uint16_t)interpolar(a->valores.humedad, b->valores.humedad, x, dx);
+    v->humedad_suelo = (uint16_t)interpolar(a->valores.humedad_suelo,
+                                            b->valores.humedad_suelo, x, dx);
+    v->sin_estres = (uint16_t)interpolar(a->valores.sin_estres, b->valores.sin_estres, x, dx);
+}
+
+void sim_leer(sim_valores_t *v) {
+    uint32_t t = (uint32_t)(xtimer_now_usec64() / US_PER_SEC) + desfase_s;
+
+    if (num_puntos > 0) {
+        grabada(t, v);
+    } else {
+        sintetica(t, v);
+    }
+
+    // Ruido de lectura del orden de la resolución de cada sensor
+    v->temperatura += ruido(3);
+    v->humedad = porcentaje((int32_t)v->humedad + ruido(10));
+    v->humedad_suelo = porcentaje((int32_t)v->humedad_suelo + ruido(5));
+}
+#endif
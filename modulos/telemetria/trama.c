@@ -0,0 +1,67 @@
+#include "trama.h"
+
+static uint8_t *escribir_u16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *escribir_u32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+static uint8_t *escribir_dispersion(uint8_t *p, const dispersion_t *d) {
+    p = escribir_u16(p, (uint16_t)d->min);
+    p = escribir_u16(p, (uint16_t)d->max);
+    return escribir_u16(p, d->desv);
+}
+
+size_t trama_codificar(uint8_t *buf, size_t tam, uint16_t id_nodo, uint32_t tiempo_envio,
+                       uint32_t desfase_s, const muestra_t *muestras, size_t num) {
+    // Basta una muestra resumida para que todos los registros lleven resumen
+    uint8_t banderas = desfase_s ? TRAMA_BANDERA_HORA : 0;
+    for (size_t i = 0; i < num; i++) {
+        if (muestras[i].cuenta > 0) {
+            banderas |= TRAMA_BANDERA_RESUMEN;
+        }
+    }
+
+    size_t tam_registro = TRAMA_TAM_REGISTRO;
+    if (banderas & TRAMA_BANDERA_RESUMEN) {
+        tam_registro += TRAMA_TAM_RESUMEN;
+    }
+    size_t total = TRAMA_TAM_CABECERA + num * tam_registro;
+    if (num == 0 || num > UINT8_MAX || total > tam) {
+        return 0;
+    }
+
+    uint8_t *p = buf;
+    *p++ = TRAMA_VERSION;
+    *p++ = banderas;
+    p = escribir_u16(p, id_nodo);
+    *p++ = (uint8_t)num;
+    p = escribir_u32(p, tiempo_envio + desfase_s);
+
+    for (size_t i = 0; i < num; i++) {
+        const muestra_t *m = &muestras[i];
+        p = escribir_u16(p, m->secuencia);
+        p = escribir_u32(p, m->tiempo + desfase_s);
+        p = escribir_u16(p, (uint16_t)m->temperatura);
+        p = escribir_u16(p, m->humedad);
+        p = escribir_u16(p, m->humedad_suelo);
+        *p++ = m->estres;
+
+        if (banderas & TRAMA_BANDERA_RESUMEN) {
+            p = escribir_u16(p, m->cuenta);
+            p = escribir_dispersion(p, &m->disp_temperatura);
+            p = escribir_dispersion(p, &m->disp_humedad);
+            p = escribir_dispersion(p, &m->disp_suelo);
+        }
+    }
+
+    return total;
+}
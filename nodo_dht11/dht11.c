@@ -1,54 +1,127 @@
+
 #include "periph/gpio.h"
 #include "xtimer.h"
+#include "mutex.h"
 #include <stdio.h>
 #include "dht11.h"
+#include "simulacion.h"
 
-int dht11_read(uint8_t pin, int *temperature, int *humidity) {
-    uint8_t data[5] = {0};
-    int i, j;
+// En la placa native se compila dht11_sim.c en su lugar
+#if !SIMULACION
+
+// Tras liberar la línea el sensor genera un flanco de bajada al iniciar su
+// respuesta (80 us bajo + 80 us alto), otro al empezar el primer bit y uno al
+// final de cada bit: 42 flancos en total
+#define DHT11_BITS              (40U)
+#define DHT11_FLANCOS           (DHT11_BITS + 2U)
+
+// Cada bit son 50 us en bajo seguidos de 26-28 us (0) o 70 us (1) en alto,
+// así que el periodo entre flancos de bajada es ~77 us o ~120 us
+#define DHT11_UMBRAL_BIT_US     (100U)
+
+// La transferencia completa dura ~4.5 ms; pasado este tiempo se aborta
+#define DHT11_TIMEOUT_US        (10000U)
+
+// Pulso de inicio: el sensor necesita la línea en bajo al menos 18 ms
+#define DHT11_INICIO_US         (20000U)
+
+static volatile uint32_t flancos[DHT11_FLANCOS];
+static volatile unsigned num_flancos;
+static mutex_t fin_captura = MUTEX_INIT_LOCKED;
+static dht11_stats_t stats;
+
+// Rutina de interrupción: solo guarda la marca de tiempo del flanco
+static void flanco_cb(void *arg) {
+    (void)arg;
 
+    if (num_flancos < DHT11_FLANCOS) {
+        flancos[num_flancos++] = xtimer_now_usec();
+        if (num_flancos == DHT11_FLANCOS) {
+            mutex_unlock(&fin_captura);
+        }
+    }
+}
+
+int dht11_init(gpio_t pin) {
+    if (gpio_init_int(pin, GPIO_OD_PU, GPIO_FALLING, flanco_cb, NULL) < 0) {
+        puts("Error: No se pudo configurar la interrupción del pin del DHT11.");
+        return -1;
+    }
+    gpio_irq_disable(pin);
     gpio_set(pin);
+
+    return 0;
+}
+
+int dht11_read(gpio_t pin, int16_t *temperature, int16_t *humidity) {
+    uint8_t data[5] = {0};
+    uint32_t inicio = xtimer_now_usec();
+
+    stats.lecturas++;
+
+    // Pulso de inicio con la interrupción deshabilitada para no capturar
+    // nuestro propio flanco
+    gpio_irq_disable(pin);
     gpio_clear(pin);
-    xtimer_usleep(20000); // 20 ms para iniciar comunicación
-    gpio_set(pin);
-    xtimer_usleep(40); // Pausa mínima después del inicio
+    xtimer_usleep(DHT11_INICIO_US);
 
-    // Esperar respuesta del sensor
-    if (!gpio_read(pin)) {
-        puts("Error: No se detectó respuesta del sensor.");
-        return -1;
+    num_flancos = 0;
+    mutex_trylock(&fin_captura);
+    gpio_irq_enable(pin);
+    gpio_set(pin); // Liberar la línea, el sensor responde en 20-40 us
+
+    int res = xtimer_mutex_lock_timeout(&fin_captura, DHT11_TIMEOUT_US);
+    gpio_irq_disable(pin);
+
+    if (res < 0) {
+        unsigned capturados = num_flancos;
+        if (capturados == 0) {
+            stats.sin_respuesta++;
+            puts("Error: No se detectó respuesta del sensor.");
+            return DHT11_ERR_SIN_RESPUESTA;
+        }
+        stats.timeouts++;
+        printf("Error: Tiempo de espera agotado (%u de %u flancos).\n",
+               capturados, (unsigned)DHT11_FLANCOS);
+        return DHT11_ERR_TIMEOUT;
     }
 
-    for (j = 0; j < 5; j++) {
-        for (i = 7; i >= 0; i--) {
-            int timeout = 10000;
-            while (!gpio_read(pin) && timeout-- > 0) {
-                xtimer_usleep(1); // Verificar señal
-            }
-            if (timeout <= 0) {
-                puts("Error: Tiempo de espera agotado.");
-                return -1;
-            }
-
-            xtimer_usleep(30); // Leer bit
-            if (gpio_read(pin)) {
-                data[j] |= (1 << i);
-            }
-            while (gpio_read(pin)) {} // Esperar a que baje
+    // El bit i ocupa el intervalo entre los flancos i+1 e i+2
+    for (unsigned i = 0; i < DHT11_BITS; i++) {
+        uint32_t periodo = flancos[i + 2] - flancos[i + 1];
+        data[i / 8] <<= 1;
+        if (periodo > DHT11_UMBRAL_BIT_US) {
+            data[i / 8] |= 1;
         }
     }
 
     // Verificación de datos
     if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) {
+        stats.fallos_checksum++;
         puts("Error: Fallo en la verificación de datos.");
-        return -1;
+        return DHT11_ERR_CHECKSUM;
     }
 
-    *humidity = (data[0] << 8) | data[1];
-    *temperature = (data[2] << 8) | data[3];
-
-    return 0; // Éxito
-}
+    // El DHT11 envía parte entera y decimal; el bit 7 del decimal de la
+    // temperatura indica valores bajo cero
+    *humidity = data[0] * 10 + data[1];
+    *temperature = data[2] * 10 + (data[3] & 0x0F);
+    if (data[3] & 0x80) {
+        *temperature = -*temperature;
+    }
 
+    uint32_t latencia = xtimer_now_usec() - inicio;
+    stats.exitosas++;
+    stats.latencia_ultima_us = latencia;
+    stats.latencia_total_us += latencia;
+    if (latencia > stats.latencia_max_us) {
+        stats.latencia_max_us = latencia;
+    }
 
+    return DHT11_OK; // Éxito
+}
 
+const dht11_stats_t *dht11_get_stats(void) {
+    return &stats;
+}
+#endif
@@ -2,9 +2,34 @@
 #define DHT11_H
 
 #include <stdint.h>
+#include "periph/gpio.h"
 
-int dht11_read(uint8_t pin, int *temperature, int *humidity);
+// Códigos de retorno de dht11_read()
+#define DHT11_OK                    (0)
+#define DHT11_ERR_SIN_RESPUESTA     (-1)
+#define DHT11_ERR_TIMEOUT           (-2)
+#define DHT11_ERR_CHECKSUM          (-3)
 
-#endif
+// Contadores acumulados desde el arranque
+typedef struct {
+    uint32_t lecturas;              // Lecturas intentadas
+    uint32_t exitosas;              // Lecturas con checksum correcto
+    uint32_t sin_respuesta;         // El sensor no generó ningún flanco
+    uint32_t timeouts;              // La transferencia quedó incompleta
+    uint32_t fallos_checksum;       // Se recibieron los 40 bits pero no cuadran
+    uint32_t latencia_ultima_us;    // Duración de la última lectura exitosa
+    uint32_t latencia_max_us;
+    uint64_t latencia_total_us;     // Suma de latencias de las lecturas exitosas
+} dht11_stats_t;
+
+// Configura el pin como open-drain con interrupción en flanco de bajada
+int dht11_init(gpio_t pin);
 
+// Lee temperatura y humedad en décimas (°C y %). La lectura se decodifica
+// a partir de los tiempos entre flancos capturados por interrupción, con un
+// tiempo máximo fijo, así que nunca bloquea el hilo más de ~30 ms.
+int dht11_read(gpio_t pin, int16_t *temperature, int16_t *humidity);
 
+const dht11_stats_t *dht11_get_stats(void);
+
+#endif
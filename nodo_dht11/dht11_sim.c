@@ -0,0 +1,40 @@
+#include "simulacion.h"
+
+#if SIMULACION
+#include "xtimer.h"
+#include "dht11.h"
+
+// DHT11 simulado para la placa native: devuelve los valores de la traza con
+// la resolución del sensor real (décimas de grado, % entero) y lleva las
+// mismas estadísticas que el driver por interrupción
+#define DHT11_SIM_LATENCIA_US   (4500U) // Lo que tarda una transferencia real
+
+static dht11_stats_t stats;
+
+int dht11_init(gpio_t pin) {
+    (void)pin;
+    return 0;
+}
+
+int dht11_read(gpio_t pin, int16_t *temperature, int16_t *humidity) {
+    sim_valores_t valores;
+    (void)pin;
+
+    stats.lecturas++;
+    sim_leer(&valores);
+    *temperature = valores.temperatura;
+    *humidity = (int16_t)((valores.humedad + 5) / 10 * 10);
+
+    stats.exitosas++;
+    stats.latencia_ultima_us = DHT11_SIM_LATENCIA_US;
+    stats.latencia_total_us += DHT11_SIM_LATENCIA_US;
+    if (DHT11_SIM_LATENCIA_US > stats.latencia_max_us) {
+        stats.latencia_max_us = DHT11_SIM_LATENCIA_US;
+    }
+    return DHT11_OK;
+}
+
+const dht11_stats_t *dht11_get_stats(void) {
+    return &stats;
+}
+#endif
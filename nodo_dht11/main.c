@@ -9,8 +9,23 @@
 #include "net/ipv6/addr.h"
 #include "thread.h"
 #include "xtimer.h"
-#include "dht.h"
-#include "dht_params.h"
+#include "ztimer.h"
+#include "trama.h"
+#include "cola_muestras.h"
+#include "politica.h"
+#include "agregado.h"
+#include "enlace_ia.h"
+#include "reloj.h"
+#include "publicador.h"
+#include "simulacion.h"
+
+#if IS_USED(MODULE_PM_LAYERED)
+#include "pm_layered.h"
+#endif
+#if IS_USED(MODULE_PERIPH_RTT)
+#include "periph/rtt.h"
+#endif
+#include "dht11.h"
 #include "net/gnrc.h"
 #include "net/gnrc/icmpv6.h"
 #include "net/gnrc/ipv6.h"
@@ -18,33 +33,192 @@
 #define EMCUTE_ID           ("gertrud")
 #define EMCUTE_PRIO         (THREAD_PRIORITY_MAIN - 1)
 #define PUERTO_BROKER       (1885U)
+#ifndef DIRECCION_BROKER
 #define DIRECCION_BROKER    "2001:db8:a::1"
+#endif
+// Servicio de hora del router de borde (router_borde/hora.h)
+#ifndef DIRECCION_HORA
+#define DIRECCION_HORA      "2001:db8:a::2"
+#endif
 #define ID_NODO             "4"     		// Número del nodo
 #define NOMBRE_NODO         "Anthony Ibujes"	// Nombre del nodo
 
 // Configuración del DHT11
 #define PIN_DHT             GPIO_PIN(0, 25)
-#define TIPO_DHT            DHT11
 #define RETRASO_SENSOR      10		// Retraso entre lecturas en segundos
 
 // Configuración del pin para leer el estado de estrés
 #define ESTADO_PIN          GPIO_PIN(0, 35) // Pin donde se recibe el estado (0 o 1)
 
-// Configuración UART para comunicación con Xiao Sense
-#define UART_USED           UART_DEV(0)  // Usar UART0 (GPIO 1 y GPIO 3)
+// Configuración UART para comunicación con Xiao Sense; UART0 es la consola,
+// los pines de UART1 se fijan en el Makefile
+#define UART_USED           UART_DEV(1)
 #define UART_BAUD           115200
+#define ESPERA_IA_MS        (2000U) // Espera máxima al resultado de la XIAO
 #define REQUEST_PIN         GPIO_PIN(0, 22)
 
+// Vaciado de la cola de muestras pendientes (store-and-forward)
+#define LOTE_MAX            (8U)    // Muestras por trama al vaciar la cola
+// Trama de LOTE_MAX muestras, todas con resumen en el modo agregado
+#define TAM_TRAMA_MAX       (TRAMA_TAM_CABECERA + LOTE_MAX * (TRAMA_TAM_REGISTRO + TRAMA_TAM_RESUMEN))
+#define TANDAS_DRENADO      (4U)    // Publicaciones máximas por ciclo de vaciado
+#define RETARDO_DRENADO_MS  (200U)  // Pausa entre publicaciones para no saturar el canal
+#define MSG_MUESTRA_NUEVA   (0x4D01)
+
+// Planificador de muestreo: qué hace el SoC entre ciclos
+#define SUENO_CONTINUO      (0)     // Siempre despierto (comportamiento original)
+#define SUENO_LIGERO        (1)     // Sueño ligero entre ciclos, la sesión MQTT-SN se mantiene
+#define SUENO_PROFUNDO      (2)     // Sueño profundo, el estado se conserva en la RAM del RTC
+#ifndef MODO_SUENO
+#define MODO_SUENO          SUENO_CONTINUO
+#endif
+#define ESPERA_RED_MAX_MS   (5000U) // Espera máxima al hilo de red antes de dormir
+
+// Consumo aproximado del ESP32 para estimar la corriente media
+#define CORRIENTE_ACTIVO_UA         (120000UL)  // CPU y Wi-Fi activos
+#define CORRIENTE_SUENO_LIGERO_UA   (800UL)
+#define CORRIENTE_SUENO_PROFUNDO_UA (10UL)
+
+// Variables que sobreviven al sueño profundo (RAM del RTC); sin soporte de
+// backup_ram el sueño profundo no está disponible
+#ifdef BACKUP_RAM
+#define RETENIDO            BACKUP_RAM
+#else
+#define RETENIDO
+#endif
+#define MAGIA_RETENIDA      (0x53554E4FUL)
+#define VERSION_RETENIDA    (1U)    // Subir si lo retenido cambia de significado
+#if defined(BACKUP_RAM) && IS_USED(MODULE_PM_LAYERED) && IS_USED(MODULE_PERIPH_RTT)
+#define SUENO_PROFUNDO_DISPONIBLE   1
+#include "esp_system.h"
+#else
+#define SUENO_PROFUNDO_DISPONIBLE   0
+#endif
+
+// Modo compacto: una sola trama binaria por ciclo en lugar de un tema por campo
+#ifndef MODO_COMPACTO
+#define MODO_COMPACTO       0
+#endif
+
+// Modo fiable: tramas con QoS 1 y varias en vuelo a la vez (ver publicador.h)
+#ifndef MODO_FIABLE
+#define MODO_FIABLE         0
+#endif
+
+// Reporte por cambio: solo se publica lo que supera la banda muerta o el latido
+#ifndef REPORTE_ADAPTATIVO
+#define REPORTE_ADAPTATIVO  0
+#endif
+#define LONGITUD_CONFIG     (128U)  // Mensaje de configuración más largo aceptado
+
+// Agregación: lecturas cada PERIODO_LECTURA_MS y un resumen (mín, máx, media,
+// desviación) por cada intervalo de reporte
+#ifndef AGREGACION
+#define AGREGACION          0
+#endif
+#define PERIODO_LECTURA_MS  (1000U)
+#define ESPERA_IA_AGREGADO_MS (PERIODO_LECTURA_MS / 2)  // Cabe en el periodo de lectura
+
+// Identidad del nodo; en simulación cada instancia toma la suya del entorno
+static const char *id_nodo = ID_NODO;
+static const char *nombre_nodo = NOMBRE_NODO;
+static const char *id_emcute = EMCUTE_ID;
+static const char *id_fiable = "nodo_" ID_NODO;
+
 static char pila[THREAD_STACKSIZE_DEFAULT];
 static char pila_icmp[THREAD_STACKSIZE_DEFAULT];
 static msg_t cola[8];
-static dht_t dht;
 static bool sensor_inicializado = false;
 static bool envio_automatico_activo = false;
 static char pila_envio_automatico[THREAD_STACKSIZE_DEFAULT];
 static kernel_pid_t pid_envio_automatico = KERNEL_PID_UNDEF;
 static kernel_pid_t pid_icmp;
-static char ultimo_estado_estres[3] = "01";  // Buffer para estado
+static uint8_t confianza_sin_estres = 100;  // Última confianza de "sin estrés" en %
+static resultado_ia_t ultimo_resultado_ia;
+static bool ia_pendiente = false;   // Solicitud de la ventana aún sin respuesta
+
+// Muestras pendientes de publicar y estado de la conexión
+static RETENIDO cola_muestras_t cola_envio;
+static bool conectado = false;
+static char pila_red[THREAD_STACKSIZE_DEFAULT];
+static kernel_pid_t pid_red = KERNEL_PID_UNDEF;
+static uint32_t muestras_drenadas = 0;
+static uint64_t tiempo_drenado_us = 0;
+
+// Caché de temas MQTT-SN registrados en la sesión actual
+#define MAX_TEMAS           (6U)
+#define LONGITUD_TEMA       (64U)
+
+typedef struct {
+    char nombre[LONGITUD_TEMA];
+    emcute_topic_t tema;
+} tema_cache_t;
+
+static RETENIDO tema_cache_t cache_temas[MAX_TEMAS];
+static RETENIDO unsigned num_temas;
+static unsigned aciertos_cache = 0;
+static unsigned fallos_cache = 0;
+
+static bool modo_compacto = MODO_COMPACTO;
+static bool nombre_publicado = false;
+
+// Modo fiable: la última muestra puesta en vuelo; las siguientes tramas
+// empiezan detrás de ella sin esperar a que se confirme
+static bool modo_fiable = MODO_FIABLE;
+static bool nombre_fiable = false;
+static bool hay_en_vuelo = false;
+static uint16_t ultima_en_vuelo;
+static RETENIDO uint16_t secuencia_muestra;
+
+// Estado del planificador; lo marcado RETENIDO se inicializa solo en arranque en frío
+static RETENIDO uint32_t magia_retenida;
+static RETENIDO uint8_t modo_sueno;
+static RETENIDO uint64_t tiempo_base_ms;        // Tiempo transcurrido antes de este arranque
+static RETENIDO reloj_t reloj;                  // Desfase con la hora Unix, sigue valiendo al despertar
+static RETENIDO uint32_t proxima_alarma_rtt;    // Plazo absoluto del próximo ciclo en sueño profundo
+static RETENIDO uint32_t ciclos_planificados;
+static RETENIDO uint64_t tiempo_activo_ms;
+static RETENIDO uint64_t tiempo_dormido_ms;
+static RETENIDO uint32_t activo_ultimo_ms;
+static RETENIDO uint32_t dormido_ultimo_ms;
+static bool reanudando = false;                 // Arranque tras sueño profundo
+
+// Política de reporte; se ajusta desde la shell o por el tema de bajada
+static RETENIDO politica_t politica;
+static mutex_t lock_politica = MUTEX_INIT;
+
+// Ventana de agregación en curso
+static RETENIDO bool modo_agregado;
+static RETENIDO ventana_t ventana;
+static emcute_sub_t sub_config;
+static bool config_suscrita = false;            // sub_config enlazada en la lista de emcute
+static char tema_config[LONGITUD_TEMA];
+static mutex_t red_libre = MUTEX_INIT_LOCKED;   // Se libera al terminar cada vuelta del hilo de red
+
+// Firma del estado retenido: la magia mezclada (FNV-1a) con la versión y el
+// tamaño de lo retenido, para que un firmware con otra disposición no lo
+// tome por suyo
+static uint32_t firma_retenida(void) {
+    const uint32_t disposicion[] = {
+        VERSION_RETENIDA, sizeof(cola_envio), sizeof(cache_temas), sizeof(secuencia_muestra),
+        sizeof(tiempo_base_ms), sizeof(reloj), sizeof(politica), sizeof(ventana),
+    };
+    uint32_t firma = MAGIA_RETENIDA;
+    for (unsigned i = 0; i < ARRAY_SIZE(disposicion); i++) {
+        firma = (firma ^ disposicion[i]) * 16777619UL;
+    }
+    return firma;
+}
+
+// La RAM del RTC sobrevive también al watchdog, a un pánico y al reinicio que
+// sigue a una grabación; solo al despertar de un sueño profundo sigue valiendo
+static bool despierta_de_sueno(void) {
+#if SUENO_PROFUNDO_DISPONIBLE
+    return esp_reset_reason() == ESP_RST_DEEPSLEEP;
+#else
+    return false;
+#endif
+}
 
 // Prototipo de la función
 static int iniciar_envio_automatico(void);
@@ -68,19 +242,37 @@ static void *hilo_icmp(void *arg)
     return NULL;
 }
 
+// Respuesta de la XIAO a la solicitud pendiente; 0 si llegó
+static int recoger_resultado_ia(uint32_t espera_ms) {
+    resultado_ia_t resultado;
+    if (enlace_ia_esperar(&resultado, espera_ms) != 0) {
+        return -1;
+    }
+
+    ia_pendiente = false;
+    ultimo_resultado_ia = resultado;
+    confianza_sin_estres = (resultado.sin_estres + 5) / 10;
+    printf("Resultado IA: cuadro %lu, sin estrés %u.%u%%, estrés %u.%u%%, "
+           "inferencia %lu us, latencia %lu us\n",
+           (unsigned long)resultado.cuadro, resultado.sin_estres / 10, resultado.sin_estres % 10,
+           resultado.estres / 10, resultado.estres % 10,
+           (unsigned long)resultado.inferencia_us, (unsigned long)resultado.latencia_us);
+    return 0;
+}
+
 // Función para solicitar y leer datos del Xiao Sense
-static int leer_estado_estres(void) {
-    // Leer el estado del pin
-    int estado = gpio_read(ESTADO_PIN); // Leer el estado del pin (0 o 1)
+static int leer_estado_estres(uint32_t espera_ms) {
+    // Respuesta de la XIAO a la solicitud hecha al empezar el ciclo
+    if (recoger_resultado_ia(espera_ms) == 0) {
+        return 0;
+    }
 
-    // Asegúrate de que el dato recibido sea "0" o "1"
+    // Sin respuesta por UART se usa el pin de estado (XIAO sin el protocolo)
+    int estado = gpio_read(ESTADO_PIN); // Leer el estado del pin (0 o 1)
     if (estado == 0 || estado == 1) {
-        ultimo_estado_estres[0] = '0' + estado; // Convertir a char
-        ultimo_estado_estres[1] = '\0'; // Asegúrate de que esté terminado en null
-        printf("Estado de estrés recibido: %s\n", ultimo_estado_estres);
-        return 0; // Éxito
-    } else {
-        printf("Error: Estado no válido leído del pin\n");
+        confianza_sin_estres = estado ? 100 : 0;
+        printf("Sin respuesta de la XIAO, estado leído del pin: %d\n", estado);
+        return 0;
     }
 
     printf("Error al leer estado de estrés\n");
@@ -89,12 +281,8 @@ static int leer_estado_estres(void) {
 
 // Inicializar sensor DHT11
 static void inicializar_dht_silencioso(void) {
-    dht_params_t parametros = {
-        .pin = PIN_DHT,
-        .type = TIPO_DHT
-    };
     for (int i = 0; i < 5; i++) {
-        if (dht_init(&dht, &parametros) == DHT_OK) {
+        if (dht11_init(PIN_DHT) == 0) {
             sensor_inicializado = true;
             puts("Sensor DHT11 inicializado correctamente");
             return;
@@ -107,10 +295,122 @@ static void inicializar_dht_silencioso(void) {
 
 static void *hilo_emcute(void *arg) {
     (void)arg;
-    emcute_run(CONFIG_EMCUTE_DEFAULT_PORT, EMCUTE_ID);
+    emcute_run(CONFIG_EMCUTE_DEFAULT_PORT, id_emcute);
     return NULL;
 }
 
+// Milisegundos desde el primer arranque, contando los periodos de sueño profundo
+static uint64_t tiempo_nodo_ms(void) {
+    return tiempo_base_ms + xtimer_now_usec64() / US_PER_MS;
+}
+
+static uint32_t tiempo_nodo_s(void) {
+    return (uint32_t)(tiempo_nodo_ms() / MS_PER_SEC);
+}
+
+// Pide la hora al router cuando toca; casi siempre no hace nada, así que
+// cuesta un intercambio cada RELOJ_PERIODO_S aunque el nodo despierte a menudo
+static void sincronizar_hora(void) {
+    if (!reloj_vencido(&reloj, tiempo_nodo_s())) {
+        return;
+    }
+
+    sock_udp_ep_t servidor = { .family = AF_INET6, .port = RELOJ_PUERTO };
+    if (ipv6_addr_from_str((ipv6_addr_t *)&servidor.addr.ipv6, DIRECCION_HORA) == NULL) {
+        puts("error: no se puede analizar la dirección del servicio de hora");
+        return;
+    }
+
+    if (reloj_sincronizar(&reloj, &servidor, tiempo_nodo_ms) != 0) {
+        printf("Advertencia: sin hora del router en [%s]%s\n", DIRECCION_HORA,
+               reloj.valido ? ", se mantiene el desfase anterior" : "");
+        return;
+    }
+    printf("Hora sincronizada: ida y vuelta %lu ms, corrección %ld ms\n",
+           (unsigned long)reloj.rtt_ms, (long)reloj.correccion_ms);
+}
+
+// Con hora válida cada valor publicado lleva su marca Unix: "valor@segundos"
+static void marcar_hora(char *datos, size_t tam, const muestra_t *muestra) {
+    uint32_t desfase = reloj_desfase_s(&reloj);
+    if (desfase != 0) {
+        size_t len = strlen(datos);
+        snprintf(datos + len, tam - len, "@%lu", (unsigned long)(muestra->tiempo + desfase));
+    }
+}
+
+// Impide (o vuelve a permitir) el sueño ligero mientras hay trabajo en curso;
+// cada llamada con true debe tener su par con false
+static void retener_despierto(bool retener) {
+#if IS_USED(MODULE_PM_LAYERED)
+    if (retener) {
+        pm_block(ESP_PM_LIGHT_SLEEP);
+    } else {
+        pm_unblock(ESP_PM_LIGHT_SLEEP);
+    }
+#else
+    (void)retener;
+#endif
+}
+
+// Mensajes de bajada en control/nodo_<ID>/config con pares "clave=valor"
+static void al_recibir_config(const emcute_topic_t *tema, void *datos, size_t len) {
+    char texto[LONGITUD_CONFIG];
+
+    if (len >= sizeof(texto)) {
+        printf("error: configuración demasiado larga en '%s' (%u bytes)\n",
+               tema->name, (unsigned)len);
+        return;
+    }
+    memcpy(texto, datos, len);
+    texto[len] = '\0';
+
+    printf("Configuración recibida: %s\n", texto);
+    mutex_lock(&lock_politica);
+    int res = politica_configurar_texto(&politica, texto);
+    mutex_unlock(&lock_politica);
+    if (res != 0) {
+        puts("Advertencia: parte de la configuración no se aplicó");
+    }
+}
+
+// El gateway no responde o ya no reconoce la sesión: los IDs de tema dejan de
+// valer y la próxima conexión empieza con sesión limpia
+static void perder_sesion(void) {
+    emcute_discon();
+    num_temas = 0;
+    nombre_publicado = false;
+    conectado = false;
+}
+
+// Devuelve 1 si no se pudo quitar la suscripción anterior; la sesión se da
+// entonces por perdida y la siguiente conexión lo vuelve a intentar
+static int suscribir_config(void) {
+    // emcute enlaza la suscripción en su lista: volver a suscribir la misma
+    // estructura sin quitarla antes haría que la lista apuntara a sí misma.
+    // Si no se puede quitar sigue enlazada, así que config_suscrita se
+    // mantiene para reintentarlo con la sesión nueva
+    if (config_suscrita) {
+        if (emcute_unsub(&sub_config) != EMCUTE_OK) {
+            printf("error: no se puede renovar la suscripción a '%s', se reconecta\n", tema_config);
+            perder_sesion();
+            return 1;
+        }
+        config_suscrita = false;
+    }
+
+    snprintf(tema_config, sizeof(tema_config), "control/nodo_%s/config", id_nodo);
+    sub_config.cb = al_recibir_config;
+    sub_config.topic.name = tema_config;
+    if (emcute_sub(&sub_config, EMCUTE_QOS_0) != EMCUTE_OK) {
+        printf("error: no se puede suscribir a '%s'\n", tema_config);
+        return 0;
+    }
+    config_suscrita = true;
+    printf("Suscrito a '%s'\n", tema_config);
+    return 0;
+}
+
 static int conectar_broker(void) {
     sock_udp_ep_t gw = { .family = AF_INET6, .port = PUERTO_BROKER };
 
@@ -120,26 +420,90 @@ static int conectar_broker(void) {
         return 1;
     }
 
-    if (emcute_con(&gw, true, NULL, NULL, 0, 0) != EMCUTE_OK) {
+    // Al volver del sueño profundo se retoma la sesión anterior (sin limpiarla)
+    // para reutilizar los IDs de tema guardados en la RAM del RTC
+    bool sesion_limpia = !reanudando;
+    if (emcute_con(&gw, sesion_limpia, NULL, NULL, 0, 0) != EMCUTE_OK) {
         printf("error: no se puede conectar a [%s]:%i\n", DIRECCION_BROKER, (int)PUERTO_BROKER);
+        reanudando = false;
         return 1;
     }
 
+    // Los IDs de tema solo son válidos dentro de una sesión: una nueva conexión
+    // obliga a registrarlos otra vez
+    if (sesion_limpia) {
+        num_temas = 0;
+        nombre_publicado = false;
+    }
+    reanudando = false;
+    conectado = true;
+
     printf("Conectado exitosamente al broker en [%s]:%i\n", DIRECCION_BROKER, (int)PUERTO_BROKER);
-    return 0;
+
+    // La suscripción local de emcute no sobrevive al sueño profundo y la del
+    // gateway no sobrevive a una sesión limpia: se renueva en cada conexión
+    return suscribir_config();
 }
 
-static int publicar_datos_sensor(const char *nombre_tema, const char *datos) {
-    emcute_topic_t t;
-    t.name = nombre_tema;
+// Devuelve el tema registrado, registrándolo solo la primera vez en la sesión
+static emcute_topic_t *obtener_tema(const char *nombre_tema) {
+    for (unsigned i = 0; i < num_temas; i++) {
+        if (strcmp(cache_temas[i].nombre, nombre_tema) == 0) {
+            aciertos_cache++;
+            return &cache_temas[i].tema;
+        }
+    }
+
+    fallos_cache++;
+    if (num_temas >= MAX_TEMAS) {
+        printf("error: caché de temas llena, no se puede agregar '%s'\n", nombre_tema);
+        return NULL;
+    }
 
-    if (emcute_reg(&t) != EMCUTE_OK) {
+    tema_cache_t *entrada = &cache_temas[num_temas];
+    strncpy(entrada->nombre, nombre_tema, sizeof(entrada->nombre) - 1);
+    entrada->nombre[sizeof(entrada->nombre) - 1] = '\0';
+    entrada->tema.name = entrada->nombre;
+
+    int res = emcute_reg(&entrada->tema);
+    if (res != EMCUTE_OK) {
         printf("error: no se puede registrar el tema '%s'\n", nombre_tema);
+        if (res == EMCUTE_NOGW || res == EMCUTE_TIMEOUT) {
+            perder_sesion();
+        }
+        return NULL;
+    }
+
+    num_temas++;
+    return &entrada->tema;
+}
+
+static int publicar_en_tema(const char *nombre_tema, const void *datos, size_t len) {
+    emcute_topic_t *t = obtener_tema(nombre_tema);
+    if (t == NULL) {
         return 1;
     }
 
-    if (emcute_pub(&t, datos, strlen(datos), EMCUTE_QOS_0) != EMCUTE_OK) {
-        printf("error: no se puede publicar datos en el tema '%s [%i]'\n", t.name, (int)t.id);
+    // Con QoS 1 emcute_pub vuelve con el PUBACK del gateway. Con QoS 0 daría
+    // EMCUTE_OK con solo tener guardada su dirección, sin ida y vuelta que
+    // delate un broker o un router caídos.
+    int res = emcute_pub(t, datos, len, EMCUTE_QOS_1);
+    if (res != EMCUTE_OK) {
+        printf("error: no se puede publicar datos en el tema '%s [%i]'\n", t->name, (int)t->id);
+        // Un rechazo suele ser un ID que el gateway ya no reconoce (se
+        // reinició el router): la sesión se da por perdida igual que sin
+        // respuesta, y al reconectar se registran los temas de nuevo
+        if (res == EMCUTE_NOGW || res == EMCUTE_TIMEOUT || res == EMCUTE_REJECT) {
+            perder_sesion();
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+static int publicar_datos_sensor(const char *nombre_tema, const char *datos) {
+    if (publicar_en_tema(nombre_tema, datos, strlen(datos)) != 0) {
         return 1;
     }
 
@@ -147,27 +511,85 @@ static int publicar_datos_sensor(const char *nombre_tema, const char *datos) {
     return 0;
 }
 
-static int enviar_lectura_unica(void) {
+// Codifica las muestras con la hora real si el nodo ya la tiene. Que no
+// quepan todas es un error de tamaños: se avisa y se codifican las que
+// quepan, para no reintentar siempre el mismo lote y atascar la cola. Deja
+// en *num las muestras codificadas; devuelve 0 si no cabe ni una.
+static size_t codificar_trama(uint8_t *trama, size_t tam, const muestra_t *muestras, size_t *num) {
+    for (size_t n = *num; n > 0; n /= 2) {
+        size_t len = trama_codificar(trama, tam, (uint16_t)atoi(id_nodo), tiempo_nodo_s(),
+                                     reloj_desfase_s(&reloj), muestras, n);
+        if (len > 0) {
+            if (n < *num) {
+                printf("error: %u muestras no caben en %u bytes, se envían %u\n",
+                       (unsigned)*num, (unsigned)tam, (unsigned)n);
+                *num = n;
+            }
+            return len;
+        }
+    }
+    return 0;
+}
+
+// Publica varias muestras como una única trama binaria en sensores/nodo_<ID>/trama
+// y deja en *num las que caben en ella
+static int publicar_trama(const muestra_t *muestras, size_t *num) {
     char tema[64];
-    char datos[64];
-    float temp_c = 0.0;
-    float hum_perc = 0.0;
+    uint8_t trama[TAM_TRAMA_MAX];
+
+    // El nombre no cambia, basta con enviarlo una vez por sesión
+    if (!nombre_publicado) {
+        char datos[64];
+        snprintf(tema, sizeof(tema), "sensores/nodo_%s/nombre", id_nodo);
+        snprintf(datos, sizeof(datos), "\"%s\"", nombre_nodo);
+        nombre_publicado = (publicar_datos_sensor(tema, datos) == 0);
+        if (!conectado) {
+            return 1;
+        }
+    }
 
+    size_t len = codificar_trama(trama, sizeof(trama), muestras, num);
+    if (len == 0) {
+        puts("error: no se pudo codificar la trama");
+        return 1;
+    }
+
+    snprintf(tema, sizeof(tema), "sensores/nodo_%s/trama", id_nodo);
+    if (publicar_en_tema(tema, trama, len) != 0) {
+        return 1;
+    }
+
+    printf("Publicada trama de %u bytes en tema '%s' (muestras #%u a #%u)\n",
+           (unsigned)len, tema, (unsigned)muestras[0].secuencia,
+           (unsigned)muestras[*num - 1].secuencia);
+    return 0;
+}
+
+// Lee el DHT11 y el estado de estrés y arma la muestra con su marca de tiempo
+static int tomar_muestra(muestra_t *muestra) {
     if (!sensor_inicializado) {
         puts("Error: Sensor no inicializado.");
         return 1;
     }
 
+    // Una clasificación por ventana de reporte: sin agregación cada lectura es
+    // una ventana; con ella la primera lectura la pide y las demás reutilizan
+    // el último resultado, así la XIAO no clasifica un cuadro por segundo
+    bool clasificar = !modo_agregado || ventana.lecturas == 0;
+    if (clasificar) {
+        // La XIAO captura y clasifica mientras se lee el sensor
+        enlace_ia_solicitar();
+        ia_pendiente = true;
+    }
+
     printf("\n------------------------------------------------------------------\n");
     
     // Leer DHT11
     int intentos = 3;
     int16_t temp, hum;
     while (intentos--) {
-        if (dht_read(&dht, &temp, &hum) == DHT_OK) {
-            temp_c = temp / 10.0;
-            hum_perc = hum / 10.0;
-            printf("Lectura DHT11 exitosa: Temp=%.1f°C, Hum=%.1f%%\n", temp_c, hum_perc);
+        if (dht11_read(PIN_DHT, &temp, &hum) == DHT11_OK) {
+            printf("Lectura DHT11 exitosa: Temp=%.1f°C, Hum=%.1f%%\n", temp / 10.0, hum / 10.0);
             break;
         }
         puts("Error al leer el sensor DHT11, reintentando...");
@@ -179,44 +601,347 @@ static int enviar_lectura_unica(void) {
         return 1;
     }
 
-    // Leer estado de estrés del Xiao Sense
-    if (leer_estado_estres() != 0) {
+    // Leer estado de estrés del Xiao Sense; con agregación la espera cabe en
+    // el periodo de lectura para no romper el ritmo de 1 Hz
+    if (clasificar &&
+        leer_estado_estres(modo_agregado ? ESPERA_IA_AGREGADO_MS : ESPERA_IA_MS) != 0) {
         puts("Error al leer el estado de estrés.");
+    } else if (!clasificar && ia_pendiente) {
+        // La clasificación (captura, decodificación e Invoke()) puede tardar
+        // más que la espera de la primera lectura: el resto de la ventana
+        // recoge la respuesta sin esperar en cuanto llegue
+        recoger_resultado_ia(0);
+    }
+
+    muestra->tiempo = tiempo_nodo_s();
+    muestra->temperatura = temp;
+    muestra->humedad = (uint16_t)hum;
+    muestra->humedad_suelo = TRAMA_VALOR_AUSENTE;
+    muestra->estres = confianza_sin_estres;
+    muestra->cuenta = 0;
+
+    // Log en consola
+    printf("\nNodo %s (%s) - Temp: %.1f°C, Humedad: %.1f%%, Sin estrés: %u%%\n",
+           id_nodo, nombre_nodo, temp / 10.0, hum / 10.0, confianza_sin_estres);
+    printf("------------------------------------------------------------------\n");
+
+    return 0;
+}
+
+// Publica una muestra en los subtemas de siempre, un tema por campo
+static int publicar_muestra_legado(const muestra_t *muestra) {
+    char tema[64];
+    char datos[64];
+
+    snprintf(tema, sizeof(tema), "sensores/nodo_%s/nombre", id_nodo);
+    snprintf(datos, sizeof(datos), "\"%s\"", nombre_nodo);
+    if (publicar_datos_sensor(tema, datos) != 0) {
+        return 1;
     }
 
-    // Publicar datos en subtemas
-    snprintf(tema, sizeof(tema), "sensores/nodo_%s/nombre", ID_NODO);
-    snprintf(datos, sizeof(datos), "\"%s\"", NOMBRE_NODO);
-    publicar_datos_sensor(tema, datos);
+    // Confianza de "sin estrés" antes que las medidas, para que el servidor la
+    // guarde con ellas; el estado se deriva de ella
+    snprintf(tema, sizeof(tema), "sensores/nodo_%s/confianza_sin_estres", id_nodo);
+    snprintf(datos, sizeof(datos), "%u", (unsigned)muestra->estres);
+    marcar_hora(datos, sizeof(datos), muestra);
+    if (publicar_datos_sensor(tema, datos) != 0) {
+        return 1;
+    }
 
-    snprintf(tema, sizeof(tema), "sensores/nodo_%s/temperatura", ID_NODO);
-    snprintf(datos, sizeof(datos), "%.1f", temp_c);
-    publicar_datos_sensor(tema, datos);
+    // Una muestra resumida envía su dispersión antes que las medias, para que
+    // el servidor la guarde junto con ellas
+    if (muestra->cuenta > 0) {
+        const dispersion_t *t = &muestra->disp_temperatura;
+        const dispersion_t *h = &muestra->disp_humedad;
+        char resumen[128];
+        snprintf(tema, sizeof(tema), "sensores/nodo_%s/resumen", id_nodo);
+        snprintf(resumen, sizeof(resumen),
+                 "{\"n\":%u,\"temperatura\":[%.1f,%.1f,%.1f],\"humedad\":[%.1f,%.1f,%.1f]}",
+                 (unsigned)muestra->cuenta, t->min / 10.0, t->max / 10.0, t->desv / 10.0,
+                 h->min / 10.0, h->max / 10.0, h->desv / 10.0);
+        if (publicar_datos_sensor(tema, resumen) != 0) {
+            return 1;
+        }
+    }
 
-    snprintf(tema, sizeof(tema), "sensores/nodo_%s/humedad", ID_NODO);
-    snprintf(datos, sizeof(datos), "%.1f", hum_perc);
-    publicar_datos_sensor(tema, datos);
+    snprintf(tema, sizeof(tema), "sensores/nodo_%s/temperatura", id_nodo);
+    snprintf(datos, sizeof(datos), "%.1f", muestra->temperatura / 10.0);
+    marcar_hora(datos, sizeof(datos), muestra);
+    if (publicar_datos_sensor(tema, datos) != 0) {
+        return 1;
+    }
 
-    // Publicar estado de estrés
-    snprintf(tema, sizeof(tema), "sensores/nodo_%s/estado_estres", ID_NODO);
-    snprintf(datos, sizeof(datos), "%s", ultimo_estado_estres);
-    publicar_datos_sensor(tema, datos);
+    snprintf(tema, sizeof(tema), "sensores/nodo_%s/humedad", id_nodo);
+    snprintf(datos, sizeof(datos), "%.1f", muestra->humedad / 10.0);
+    marcar_hora(datos, sizeof(datos), muestra);
+    return publicar_datos_sensor(tema, datos);
+}
 
-    // Log en consola
-    printf("\nNodo %s (%s) - Temp: %.1f°C, Humedad: %.1f%%, Estado: %s\n",
-           ID_NODO, NOMBRE_NODO, temp_c, hum_perc, ultimo_estado_estres);
-    printf("------------------------------------------------------------------\n");
+// Publica las muestras pendientes en tandas limitadas; una muestra sale de la
+// cola solo cuando el gateway confirmó todas sus publicaciones y lo que no se
+// pueda publicar queda para el siguiente intento
+static void drenar_cola(void) {
+    muestra_t lote[LOTE_MAX];
+    uint64_t inicio = xtimer_now_usec64();
+    unsigned enviadas = 0;
+
+    for (unsigned tanda = 0; tanda < TANDAS_DRENADO && conectado; tanda++) {
+        size_t num = cola_muestras_ver(&cola_envio, lote, modo_compacto ? LOTE_MAX : 1);
+        if (num == 0) {
+            break;
+        }
+
+        if (tanda > 0) {
+            xtimer_usleep(RETARDO_DRENADO_MS * US_PER_MS);
+        }
+
+        int res = modo_compacto ? publicar_trama(lote, &num) : publicar_muestra_legado(&lote[0]);
+        if (res != 0) {
+            break;
+        }
+
+        cola_muestras_confirmar(&cola_envio, lote[num - 1].secuencia);
+        enviadas += num;
+    }
+
+    if (enviadas > 0) {
+        muestras_drenadas += enviadas;
+        tiempo_drenado_us += xtimer_now_usec64() - inicio;
+    }
+
+    unsigned pendientes = cola_muestras_cantidad(&cola_envio);
+    if (pendientes > 0) {
+        printf("Muestras pendientes en cola: %u\n", pendientes);
+    }
+}
+
+// Modo fiable: retira lo confirmado y pone tramas en vuelo hasta llenar la
+// ventana, sin esperar a los PUBACK. Una muestra solo sale de la cola cuando
+// se confirman en orden todas las tramas hasta la suya.
+static void llenar_ventana(void) {
+    char tema[64];
+    uint8_t trama[TAM_TRAMA_MAX];
+    muestra_t lote[LOTE_MAX];
+
+    uint32_t etiqueta;
+    if (publicador_confirmadas(&etiqueta)) {
+        cola_muestras_confirmar(&cola_envio, (uint16_t)etiqueta);
+    }
 
+    if (!publicador_conectado()) {
+        sock_udp_ep_t gw = { .family = AF_INET6, .port = PUERTO_BROKER };
+        if (ipv6_addr_from_str((ipv6_addr_t *)&gw.addr.ipv6, DIRECCION_BROKER) == NULL ||
+            publicador_iniciar(&gw, id_fiable, thread_getpid()) != 0) {
+            puts("error: no se puede iniciar el publicador fiable");
+            return;
+        }
+        if (publicador_conectar() != 0) {
+            printf("Sin sesión fiable con [%s]:%i, %u muestras en cola\n", DIRECCION_BROKER,
+                   PUERTO_BROKER, cola_muestras_cantidad(&cola_envio));
+            return;
+        }
+        // Lo que estaba en vuelo se perdió con la sesión anterior
+        hay_en_vuelo = false;
+        nombre_fiable = false;
+    }
+
+    if (!nombre_fiable) {
+        char datos[64];
+        snprintf(tema, sizeof(tema), "sensores/nodo_%s/nombre", id_nodo);
+        snprintf(datos, sizeof(datos), "\"%s\"", nombre_nodo);
+        nombre_fiable = (publicador_enviar(tema, datos, strlen(datos),
+                                           PUBLICADOR_SIN_ETIQUETA) == 0);
+    }
+
+    snprintf(tema, sizeof(tema), "sensores/nodo_%s/trama", id_nodo);
+    while (publicador_libres() > 0) {
+        size_t num = hay_en_vuelo
+                     ? cola_muestras_ver_tras(&cola_envio, ultima_en_vuelo, lote, LOTE_MAX)
+                     : cola_muestras_ver(&cola_envio, lote, LOTE_MAX);
+        if (num == 0) {
+            break;
+        }
+
+        size_t len = codificar_trama(trama, sizeof(trama), lote, &num);
+        if (len == 0 || publicador_enviar(tema, trama, len, lote[num - 1].secuencia) != 0) {
+            break;
+        }
+        hay_en_vuelo = true;
+        ultima_en_vuelo = lote[num - 1].secuencia;
+        printf("Trama en vuelo: muestras #%u a #%u, %u huecos libres\n",
+               (unsigned)lote[0].secuencia, (unsigned)ultima_en_vuelo, publicador_libres());
+    }
+}
+
+// Hilo de red: reconecta con el broker y vacía la cola sin frenar el muestreo
+static void *hilo_red(void *arg) {
+    (void)arg;
+    msg_t msg;
+    msg_t cola_red[4];
+    msg_init_queue(cola_red, ARRAY_SIZE(cola_red));
+
+    while (1) {
+        // Con tramas en vuelo se despierta también para reenviarlas a tiempo
+        uint32_t plazo = publicador_revisar();
+        if (plazo == PUBLICADOR_SIN_PLAZO) {
+            msg_receive(&msg);
+        } else if (ztimer_msg_receive_timeout(ZTIMER_MSEC, &msg, plazo) < 0) {
+            continue;
+        }
+
+        bool retenido = (modo_sueno == SUENO_LIGERO);
+        if (retenido) {
+            retener_despierto(true);
+        }
+
+        // Los avisos del publicador (PUBACK recibidos) solo mueven la ventana;
+        // la hora y la sesión de emcute se atienden una vez por muestra
+        if (msg.type == MSG_MUESTRA_NUEVA) {
+            // La hora la da el router aunque el broker no responda
+            sincronizar_hora();
+
+            if (!conectado && conectar_broker() != 0) {
+                printf("Sin conexión con el broker, %u muestras en cola\n",
+                       cola_muestras_cantidad(&cola_envio));
+            }
+        }
+
+        if (modo_fiable) {
+            llenar_ventana();
+        } else if (conectado) {
+            drenar_cola();
+        }
+
+        if (retenido) {
+            retener_despierto(false);
+        }
+        // El muestreo puede dormir en cuanto no queda nada en vuelo
+        if (publicador_libres() == PUBLICADOR_VENTANA) {
+            mutex_unlock(&red_libre);
+        }
+    }
+    return NULL;
+}
+
+// Toma una muestra, la guarda en la cola y avisa al hilo de red
+static int enviar_lectura_unica(void) {
+    muestra_t muestra;
+
+    if (tomar_muestra(&muestra) != 0) {
+        return 1;
+    }
+
+    // Con agregación la lectura solo alimenta la ventana hasta que esta cubre
+    // el intervalo de reporte; entonces se envía el resumen en su lugar
+    if (modo_agregado) {
+        ventana_agregar(&ventana, &muestra);
+        uint32_t cubierto_ms = ventana_duracion_s(&ventana) * MS_PER_SEC + PERIODO_LECTURA_MS;
+        if (cubierto_ms < politica_intervalo_s(&politica) * MS_PER_SEC) {
+            mutex_unlock(&red_libre);
+            return 0;
+        }
+        ventana_cerrar(&ventana, &muestra);
+        printf("Ventana cerrada: %u lecturas en %lu s\n", (unsigned)muestra.cuenta,
+               (unsigned long)(cubierto_ms / MS_PER_SEC));
+    }
+
+    mutex_lock(&lock_politica);
+    bool publicar = politica_evaluar(&politica, &muestra, tiempo_nodo_s());
+    mutex_unlock(&lock_politica);
+
+    if (!publicar) {
+        puts("Sin cambios significativos, no se publica");
+    } else {
+        // Solo se numeran las muestras publicadas: un hueco indica una pérdida
+        muestra.secuencia = secuencia_muestra++;
+        if (cola_muestras_agregar(&cola_envio, &muestra)) {
+            puts("Advertencia: cola llena, se descartó la muestra más antigua");
+        }
+    }
+
+    // Sin nada pendiente el hilo de red no tiene trabajo y la radio no se usa
+    if (cola_muestras_cantidad(&cola_envio) == 0) {
+        mutex_unlock(&red_libre);
+        return 0;
+    }
+
+    // Si el hilo de red está ocupado ya vaciará esta muestra en su próxima vuelta
+    msg_t msg = { .type = MSG_MUESTRA_NUEVA };
+    mutex_trylock(&red_libre);
+    if (msg_try_send(&msg, pid_red) != 1) {
+        mutex_unlock(&red_libre);
+    }
     return 0;
 }
 
+// Guarda el estado en la RAM del RTC y duerme hasta el siguiente ciclo. El
+// RTT sigue contando durante el sueño profundo, así que el plazo se lleva en
+// ticks absolutos del RTT y el periodo no deriva entre arranques.
+static void dormir_profundo(uint32_t periodo_ms) {
+#if SUENO_PROFUNDO_DISPONIBLE
+    uint32_t ahora = rtt_get_counter();
+    if (proxima_alarma_rtt == 0) {
+        proxima_alarma_rtt = ahora;
+    }
+    do {
+        proxima_alarma_rtt = (proxima_alarma_rtt + RTT_MS_TO_TICKS(periodo_ms)) & RTT_MAX_VALUE;
+    } while ((int32_t)(proxima_alarma_rtt - ahora) <= 0);
+
+    uint32_t duracion_ms = RTT_TICKS_TO_MS(proxima_alarma_rtt - ahora);
+    tiempo_base_ms += xtimer_now_usec64() / US_PER_MS + duracion_ms;
+    tiempo_dormido_ms += duracion_ms;
+    dormido_ultimo_ms = duracion_ms;
+
+    printf("Sueño profundo durante %lu ms\n", (unsigned long)duracion_ms);
+    rtt_set_alarm(proxima_alarma_rtt, NULL, NULL);
+    pm_set(ESP_PM_DEEP_SLEEP);
+#else
+    (void)periodo_ms;
+#endif
+}
+
 static void *hilo_envio_automatico(void *arg) {
     (void)arg;
+    uint32_t ultimo_despertar = ztimer_now(ZTIMER_MSEC);
     
     while (envio_automatico_activo) {
-        printf("Enviando lectura única...\n");
+        uint32_t inicio = ztimer_now(ZTIMER_MSEC);
+        bool retenido = (modo_sueno == SUENO_LIGERO);
+        if (retenido) {
+            retener_despierto(true);
+        }
+
+        printf("Tomando lectura...\n");
         enviar_lectura_unica();
-        xtimer_sleep(RETRASO_SENSOR);
+
+        // Antes de dormir se espera (con límite) a que el hilo de red termine
+        if (modo_sueno != SUENO_CONTINUO) {
+            ztimer_mutex_lock_timeout(ZTIMER_MSEC, &red_libre, ESPERA_RED_MAX_MS);
+        }
+
+        uint32_t fin = ztimer_now(ZTIMER_MSEC);
+        activo_ultimo_ms = fin - inicio;
+        tiempo_activo_ms += activo_ultimo_ms;
+        ciclos_planificados++;
+
+        // El intervalo lo decide la política según lo que cambiaron los valores;
+        // con agregación se lee a ritmo fijo y la política marca la ventana
+        uint32_t periodo_ms = modo_agregado ? PERIODO_LECTURA_MS
+                                            : politica_intervalo_s(&politica) * MS_PER_SEC;
+
+        if (modo_sueno == SUENO_PROFUNDO) {
+            dormir_profundo(periodo_ms);
+            puts("Advertencia: sueño profundo no disponible, se continúa despierto");
+            modo_sueno = SUENO_LIGERO;
+        }
+
+        // Plazo absoluto: el periodo no deriva aunque el ciclo tarde más o menos
+        if (retenido) {
+            retener_despierto(false);
+        }
+        ztimer_periodic_wakeup(ZTIMER_MSEC, &ultimo_despertar, periodo_ms);
+        dormido_ultimo_ms = ztimer_now(ZTIMER_MSEC) - fin;
+        tiempo_dormido_ms += dormido_ultimo_ms;
     }
     
     pid_envio_automatico = KERNEL_PID_UNDEF;
@@ -227,31 +952,289 @@ static int comando_enviar_datos(int argc, char **argv) {
     (void)argc;
     (void)argv;
 
-    // Conectar automáticamente al broker si no está conectado
-    if (emcute_discon() == EMCUTE_NOGW) {
-        printf("No conectado al broker. Conectando a %s...\n", DIRECCION_BROKER);
-        if (conectar_broker() != 0) {
-            return 1; // No se puede conectar, se envía al shell
-        }
+    // El hilo de red se conecta al broker por su cuenta si no hay conexión
+    if (!conectado) {
+        printf("No conectado al broker. Se intentará conectar a %s en el próximo ciclo.\n",
+               DIRECCION_BROKER);
     }
 
     iniciar_envio_automatico();
     return 0;
 }
 
+static int comando_cola(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    printf("Conexión con el broker: %s\n", conectado ? "activa" : "caída");
+    printf("Cola: %u/%u muestras\n", cola_muestras_cantidad(&cola_envio), COLA_MUESTRAS_TAM);
+    printf("Encoladas: %lu, enviadas: %lu, descartadas: %lu\n",
+           (unsigned long)cola_envio.encoladas, (unsigned long)cola_envio.enviadas,
+           (unsigned long)cola_envio.descartadas);
+    if (tiempo_drenado_us > 0) {
+        printf("Vaciado: %lu muestras en %lu ms (%lu muestras/s)\n",
+               (unsigned long)muestras_drenadas, (unsigned long)(tiempo_drenado_us / US_PER_MS),
+               (unsigned long)((uint64_t)muestras_drenadas * US_PER_SEC / tiempo_drenado_us));
+    }
+    return 0;
+}
+
+static int comando_temas(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    unsigned total = aciertos_cache + fallos_cache;
+    printf("Temas registrados en la sesión: %u/%u\n", num_temas, MAX_TEMAS);
+    for (unsigned i = 0; i < num_temas; i++) {
+        printf("  [%u] %s\n", (unsigned)cache_temas[i].tema.id, cache_temas[i].nombre);
+    }
+    printf("Aciertos: %u, fallos (REGISTER enviados): %u, tasa de aciertos: %u%%\n",
+           aciertos_cache, fallos_cache, total ? (aciertos_cache * 100U) / total : 0U);
+    return 0;
+}
+
+static int comando_compacto(int argc, char **argv) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "on") == 0) {
+            modo_compacto = true;
+        } else if (strcmp(argv[1], "off") == 0) {
+            modo_compacto = false;
+        } else {
+            printf("uso: %s [on|off]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("Modo compacto: %s\n", modo_compacto ? "activado (1 trama por ciclo)"
+                                                : "desactivado (1 tema por campo)");
+    return 0;
+}
+
+static int comando_dht_stats(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    const dht11_stats_t *st = dht11_get_stats();
+    printf("Lecturas DHT11: %lu, exitosas: %lu\n",
+           (unsigned long)st->lecturas, (unsigned long)st->exitosas);
+    printf("Sin respuesta: %lu, timeouts: %lu, fallos de checksum: %lu (%lu.%lu%%)\n",
+           (unsigned long)st->sin_respuesta, (unsigned long)st->timeouts,
+           (unsigned long)st->fallos_checksum,
+           st->lecturas ? (unsigned long)(st->fallos_checksum * 100UL / st->lecturas) : 0UL,
+           st->lecturas ? (unsigned long)((st->fallos_checksum * 1000UL / st->lecturas) % 10) : 0UL);
+    if (st->exitosas > 0) {
+        printf("Latencia de lectura: última %lu us, media %lu us, máxima %lu us\n",
+               (unsigned long)st->latencia_ultima_us,
+               (unsigned long)(st->latencia_total_us / st->exitosas),
+               (unsigned long)st->latencia_max_us);
+    }
+    return 0;
+}
+
+static int comando_sueno(int argc, char **argv) {
+    static const char *nombres[] = { "continuo", "ligero", "profundo" };
+    static const uint32_t corriente_ua[] = {
+        CORRIENTE_ACTIVO_UA, CORRIENTE_SUENO_LIGERO_UA, CORRIENTE_SUENO_PROFUNDO_UA
+    };
+
+    if (argc > 1) {
+        unsigned i;
+        for (i = 0; i < ARRAY_SIZE(nombres); i++) {
+            if (strcmp(argv[1], nombres[i]) == 0) {
+                break;
+            }
+        }
+        if (i == ARRAY_SIZE(nombres)) {
+            printf("uso: %s [continuo|ligero|profundo]\n", argv[0]);
+            return 1;
+        }
+        modo_sueno = i;
+    }
+
+    uint64_t total = tiempo_activo_ms + tiempo_dormido_ms;
+    printf("Modo de sueño: %s, ciclos: %lu\n", nombres[modo_sueno],
+           (unsigned long)ciclos_planificados);
+    printf("Último ciclo: %lu ms despierto, %lu ms dormido\n",
+           (unsigned long)activo_ultimo_ms, (unsigned long)dormido_ultimo_ms);
+    if (total > 0) {
+        uint64_t media_ua = (tiempo_activo_ms * CORRIENTE_ACTIVO_UA +
+                             tiempo_dormido_ms * corriente_ua[modo_sueno]) / total;
+        printf("Ciclo de trabajo: %lu.%lu%%, corriente media estimada: %lu uA\n",
+               (unsigned long)(tiempo_activo_ms * 100 / total),
+               (unsigned long)((tiempo_activo_ms * 1000 / total) % 10),
+               (unsigned long)media_ua);
+    }
+    return 0;
+}
+
+static int comando_politica(int argc, char **argv) {
+    if (argc == 3) {
+        mutex_lock(&lock_politica);
+        int res = politica_configurar(&politica, argv[1], argv[2]);
+        mutex_unlock(&lock_politica);
+        if (res != 0) {
+            printf("uso: %s [activa|banda_temp|banda_hum|banda_suelo|latido|"
+                   "intervalo|intervalo_min|intervalo_max <valor>]\n", argv[0]);
+            return 1;
+        }
+    } else if (argc != 1) {
+        printf("uso: %s [clave valor]\n", argv[0]);
+        return 1;
+    }
+
+    const politica_config_t *c = &politica.config;
+    const politica_stats_t *st = &politica.stats;
+    printf("Reporte por cambio: %s, intervalo actual: %u s\n",
+           c->activa ? "activo" : "inactivo", (unsigned)politica_intervalo_s(&politica));
+    printf("Bandas: temp %u.%u °C, hum %u.%u %%, suelo %u.%u %%, latido %u s\n",
+           c->banda_temp / 10, c->banda_temp % 10, c->banda_hum / 10, c->banda_hum % 10,
+           c->banda_suelo / 10, c->banda_suelo % 10, (unsigned)c->latido_s);
+    printf("Intervalo: base %u s, mínimo %u s, máximo %u s\n",
+           (unsigned)c->intervalo_base_s, (unsigned)c->intervalo_min_s,
+           (unsigned)c->intervalo_max_s);
+    printf("Muestras: %lu, publicadas por cambio: %lu, por latido: %lu, suprimidas: %lu\n",
+           (unsigned long)st->evaluadas, (unsigned long)st->por_cambio,
+           (unsigned long)st->por_latido, (unsigned long)st->suprimidas);
+    return 0;
+}
+
+static int comando_agregado(int argc, char **argv) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "on") == 0) {
+            modo_agregado = true;
+        } else if (strcmp(argv[1], "off") == 0) {
+            modo_agregado = false;
+        } else {
+            printf("uso: %s [on|off]\n", argv[0]);
+            return 1;
+        }
+        // La ventana empieza de cero para no mezclar lecturas de antes del cambio
+        ventana_reiniciar(&ventana);
+    }
+
+    if (!modo_agregado) {
+        puts("Agregación: desactivada (una lectura por intervalo)");
+        return 0;
+    }
+    printf("Agregación: lectura cada %u ms, resumen cada %u s\n",
+           PERIODO_LECTURA_MS, (unsigned)politica_intervalo_s(&politica));
+    printf("Ventana en curso: %u lecturas en %lu s\n", (unsigned)ventana.lecturas,
+           (unsigned long)ventana_duracion_s(&ventana));
+    return 0;
+}
+
+static int comando_ia(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    const enlace_ia_stats_t *st = enlace_ia_stats();
+    printf("Solicitudes: %lu, respuestas: %lu, timeouts: %lu\n",
+           (unsigned long)st->solicitudes, (unsigned long)st->respuestas,
+           (unsigned long)st->timeouts);
+    printf("Errores de CRC: %lu, tramas ajenas: %lu, bytes perdidos: %lu\n",
+           (unsigned long)st->errores_crc, (unsigned long)st->ajenas,
+           (unsigned long)st->desbordes);
+    if (st->respuestas > 0) {
+        const resultado_ia_t *r = &ultimo_resultado_ia;
+        printf("Latencia: última %lu us, máxima %lu us\n",
+               (unsigned long)st->latencia_ultima_us, (unsigned long)st->latencia_max_us);
+        printf("Último resultado: cuadro %lu, sin estrés %u.%u%%, inferencia %lu us\n",
+               (unsigned long)r->cuadro, r->sin_estres / 10, r->sin_estres % 10,
+               (unsigned long)r->inferencia_us);
+    }
+    return 0;
+}
+
+static int comando_hora(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    if (!reloj.valido) {
+        printf("Sin hora del router [%s]: %lu fallos, las muestras se envían con tiempos relativos\n",
+               DIRECCION_HORA, (unsigned long)reloj.fallos);
+        return 0;
+    }
+    uint32_t ahora = tiempo_nodo_s();
+    printf("Hora Unix: %lu s (desfase %lu s)\n",
+           (unsigned long)(ahora + reloj_desfase_s(&reloj)), (unsigned long)reloj_desfase_s(&reloj));
+    printf("Última sincronización hace %lu s: ida y vuelta %lu ms, corrección %ld ms\n",
+           (unsigned long)(ahora - reloj.ultima_sync_s), (unsigned long)reloj.rtt_ms,
+           (long)reloj.correccion_ms);
+    printf("Sincronizaciones: %lu, fallos: %lu\n",
+           (unsigned long)reloj.sincronizaciones, (unsigned long)reloj.fallos);
+    return 0;
+}
+
+static int comando_fiable(int argc, char **argv) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "on") == 0) {
+            modo_fiable = true;
+        } else if (strcmp(argv[1], "off") == 0) {
+            modo_fiable = false;
+        } else {
+            printf("uso: %s [on|off]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    publicador_stats_t st;
+    publicador_stats(&st);
+    printf("Modo fiable: %s, sesión %s, en vuelo %u/%u (máximo %u)\n",
+           modo_fiable ? "activado (QoS 1 con ventana)" : "desactivado (QoS 1, de uno en uno)",
+           st.conectado ? "abierta" : "cerrada", st.en_vuelo, PUBLICADOR_VENTANA,
+           st.en_vuelo_max);
+    printf("Enviadas: %lu, confirmadas: %lu, reenvíos: %lu, perdidas: %lu, rechazadas: %lu\n",
+           (unsigned long)st.enviados, (unsigned long)st.confirmados,
+           (unsigned long)st.reenvios, (unsigned long)st.perdidos,
+           (unsigned long)st.rechazados);
+    if (st.enviados > 0) {
+        uint32_t permil = (uint32_t)((uint64_t)st.confirmados * 1000 / st.enviados);
+        printf("Entrega: %lu.%lu%%, ventana llena %lu veces, sesiones: %lu\n",
+               (unsigned long)(permil / 10), (unsigned long)(permil % 10),
+               (unsigned long)st.ventana_llena, (unsigned long)st.sesiones);
+    }
+
+    uint32_t p50, p90, max;
+    unsigned n = publicador_rtt(&p50, &p90, &max);
+    if (n > 0) {
+        printf("RTT (%u últimos): p50 %lu ms, p90 %lu ms, máximo %lu ms\n", n,
+               (unsigned long)p50, (unsigned long)p90, (unsigned long)max);
+        printf("SRTT %lu ms, RTTVAR %lu ms, RTO %lu ms\n", (unsigned long)st.srtt_ms,
+               (unsigned long)st.rttvar_ms, (unsigned long)st.rto_ms);
+    }
+    return 0;
+}
+
 static const shell_command_t comandos_shell[] = {
     { "enviar_datos", "envía datos del sensor al broker", comando_enviar_datos },
+    { "compacto", "activa o desactiva la trama binaria única por ciclo", comando_compacto },
+    { "cola", "muestra el estado de la cola de muestras pendientes", comando_cola },
+    { "dht_stats", "muestra latencia y tasa de errores del DHT11", comando_dht_stats },
+    { "sueno", "muestra o cambia el modo de sueño entre ciclos", comando_sueno },
+    { "politica", "muestra o ajusta el reporte por cambio", comando_politica },
+    { "ia", "muestra el estado del enlace con la Xiao Sense", comando_ia },
+    { "agregado", "activa o desactiva el resumen por ventanas de lecturas", comando_agregado },
+    { "temas", "muestra la caché de temas MQTT-SN y sus aciertos", comando_temas },
+    { "hora", "muestra la sincronización con la hora del router", comando_hora },
+    { "fiable", "activa o desactiva la publicación QoS 1 con ventana", comando_fiable },
     { NULL, NULL, NULL }
 };
 
 static int iniciar_envio_automatico(void) {
     if (!envio_automatico_activo) {
         envio_automatico_activo = true;
+        // Iniciar el hilo de red una sola vez; sigue vivo aunque se pierda la conexión
+        if (pid_red == KERNEL_PID_UNDEF) {
+            pid_red = thread_create(pila_red, sizeof(pila_red),
+                                    THREAD_PRIORITY_MAIN - 1, 0,
+                                    hilo_red, NULL, "red");
+        }
         // Iniciar el hilo para envíos
         pid_envio_automatico = thread_create(pila_envio_automatico, sizeof(pila_envio_automatico),
                                     THREAD_PRIORITY_MAIN - 1, 0,
                                     hilo_envio_automatico, NULL, "envio_automatico");
-        puts("Iniciando envío automático de datos cada 10 segundos...");
+        printf("Iniciando envío automático de datos cada %u segundos...\n",
+               (unsigned)politica_intervalo_s(&politica));
     }
     return 0;
 }
@@ -260,10 +1243,11 @@ static int iniciar_sistema(void) {
     // Intenta conectar al broker
     printf("Intentando conectar al broker en %s...\n", DIRECCION_BROKER);
     if (conectar_broker() != 0) {
-        puts("Error: No se pudo conectar al broker. Iniciando shell para comandos manuales.");
+        puts("Error: No se pudo conectar al broker. Las muestras se guardarán en cola hasta reconectar.");
+        iniciar_envio_automatico();
         return 1;
     }
-    
+
     // Si llegamos aquí, la conexión fue exitosa
     puts("Conexión exitosa al broker. Iniciando envío automático...");
     iniciar_envio_automatico();
@@ -277,6 +1261,52 @@ int main(void) {
     // Inicializar cola de mensajes
     msg_init_queue(cola, ARRAY_SIZE(cola));
 
+    uint16_t intervalo_s = RETRASO_SENSOR;
+#if SIMULACION
+    static char nombre_simulado[24], emcute_simulado[24], fiable_simulado[24];
+    sim_iniciar(ID_NODO, RETRASO_SENSOR);
+    id_nodo = sim_id_nodo();
+    intervalo_s = sim_intervalo_s();
+    snprintf(nombre_simulado, sizeof(nombre_simulado), "Simulado %s", id_nodo);
+    nombre_nodo = nombre_simulado;
+    // Identificadores de cliente únicos para que el gateway no mezcle las sesiones
+    snprintf(emcute_simulado, sizeof(emcute_simulado), "%s_%s", EMCUTE_ID, id_nodo);
+    id_emcute = emcute_simulado;
+    snprintf(fiable_simulado, sizeof(fiable_simulado), "nodo_%s", id_nodo);
+    id_fiable = fiable_simulado;
+#endif
+
+    // El estado retenido solo es válido si venimos de un sueño profundo de
+    // este mismo firmware
+    uint32_t firma = firma_retenida();
+    if (magia_retenida == firma && despierta_de_sueno()) {
+        reanudando = true;
+        mutex_init(&cola_envio.lock);
+        printf("Reanudando tras sueño profundo: %u muestras en cola\n",
+               cola_muestras_cantidad(&cola_envio));
+    } else {
+        if (magia_retenida == firma) {
+            puts("Estado retenido descartado: el arranque no viene de un sueño profundo");
+        }
+        // Inicializar la cola de muestras pendientes
+        cola_muestras_init(&cola_envio);
+        num_temas = 0;
+        secuencia_muestra = 0;
+        modo_sueno = MODO_SUENO;
+        tiempo_base_ms = 0;
+        reloj_init(&reloj);
+        proxima_alarma_rtt = 0;
+        ciclos_planificados = 0;
+        tiempo_activo_ms = 0;
+        tiempo_dormido_ms = 0;
+        activo_ultimo_ms = 0;
+        dormido_ultimo_ms = 0;
+        politica_init(&politica, REPORTE_ADAPTATIVO, intervalo_s);
+        modo_agregado = AGREGACION;
+        ventana_reiniciar(&ventana);
+        magia_retenida = firma;
+    }
+
     // Iniciar hilo para manejar pings (ICMPv6)
     pid_icmp = thread_create(pila_icmp, sizeof(pila_icmp),
                            THREAD_PRIORITY_MAIN - 1, THREAD_CREATE_STACKTEST,
@@ -288,8 +1318,11 @@ int main(void) {
     gnrc_netreg_register(GNRC_NETTYPE_ICMPV6, &icmp_entry);
 
     // Inicializar UART para comunicación con Xiao Sense
-    uart_init(UART_USED, UART_BAUD, NULL, NULL);
-    puts("UART inicializado para comunicación con Xiao Sense");
+    if (enlace_ia_init(UART_USED, UART_BAUD) != UART_OK) {
+        puts("Advertencia: no se pudo inicializar el UART de la Xiao Sense");
+    } else {
+        puts("UART inicializado para comunicación con Xiao Sense");
+    }
 
     // Configurar pin de estado como entrada
     gpio_init(ESTADO_PIN, GPIO_IN);
@@ -303,10 +1336,12 @@ int main(void) {
 
     if (sensor_inicializado) {
         puts("Sensor DHT11 inicializado correctamente. Procediendo con la conexión al broker...");
-        xtimer_sleep(2);
+        if (!reanudando) {
+            xtimer_sleep(2);
+        }
         
         if (iniciar_sistema() != 0) {
-            puts("Iniciando shell debido a fallo en la conexión...");
+            puts("Muestreo activo sin conexión; el hilo de red reintentará conectar.");
         }
     } else {
         puts("El sensor DHT11 no se inicializó correctamente. Iniciando shell para comandos manuales.");
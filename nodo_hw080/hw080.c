@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <string.h>
+#include "xtimer.h"
+#include "mutex.h"
+#include "hw080.h"
+#include "simulacion.h"
+
+#if IS_USED(MODULE_MTD)
+#include "board.h"
+#include "mtd.h"
+#endif
+
+#define CALIBRACION_MAGIA       (0x48573830UL)  // "HW80"
+
+// Imagen de la calibración tal como se guarda en flash
+typedef struct {
+    uint32_t magia;
+    hw080_calibracion_t curva;
+    uint16_t suma;
+} calibracion_flash_t;
+
+static adc_t linea_adc;
+static hw080_calibracion_t calibracion;
+static bool calibracion_de_fabrica = true;
+static hw080_stats_t stats;
+static mutex_t lock_adc = MUTEX_INIT;
+
+// Curva de fábrica: equivale al mapeo lineal original (seco = 4095, mojado = 0)
+static void cargar_curva_de_fabrica(void) {
+    calibracion.num_puntos = 2;
+    calibracion.puntos[0] = (hw080_punto_t){ .crudo = 0, .humedad = 1000 };
+    calibracion.puntos[1] = (hw080_punto_t){ .crudo = HW080_CRUDO_MAX, .humedad = 0 };
+    calibracion_de_fabrica = true;
+}
+
+#if IS_USED(MODULE_MTD)
+// Suma de Fletcher-16 para validar la imagen guardada
+static uint16_t suma_verificacion(const void *datos, size_t len) {
+    const uint8_t *p = datos;
+    uint16_t a = 0, b = 0;
+    for (size_t i = 0; i < len; i++) {
+        a = (a + p[i]) % 255;
+        b = (b + a) % 255;
+    }
+    return (b << 8) | a;
+}
+#endif
+
+static int cargar_calibracion(void) {
+#if IS_USED(MODULE_MTD)
+    calibracion_flash_t imagen;
+    mtd_dev_t *dev = MTD_0;
+    uint32_t pagina = (dev->sector_count - 1) * dev->pages_per_sector;
+
+    if (mtd_init(dev) != 0 || mtd_read_page(dev, &imagen, pagina, 0, sizeof(imagen)) != 0) {
+        return -1;
+    }
+    if (imagen.magia != CALIBRACION_MAGIA ||
+        imagen.suma != suma_verificacion(&imagen.curva, sizeof(imagen.curva)) ||
+        imagen.curva.num_puntos < 2 || imagen.curva.num_puntos > HW080_MAX_PUNTOS) {
+        return -1;
+    }
+
+    calibracion = imagen.curva;
+    calibracion_de_fabrica = false;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int hw080_guardar_calibracion(void) {
+#if IS_USED(MODULE_MTD)
+    calibracion_flash_t imagen = {
+        .magia = CALIBRACION_MAGIA,
+        .curva = calibracion,
+        .suma = suma_verificacion(&calibracion, sizeof(calibracion)),
+    };
+    mtd_dev_t *dev = MTD_0;
+    uint32_t sector = dev->sector_count - 1;
+
+    if (mtd_erase_sector(dev, sector, 1) != 0 ||
+        mtd_write_page_raw(dev, &imagen, sector * dev->pages_per_sector, 0, sizeof(imagen)) != 0) {
+        puts("Error: No se pudo escribir la calibración en flash.");
+        return -1;
+    }
+    return 0;
+#else
+    puts("Error: Almacenamiento no disponible (compilar con USEMODULE += mtd).");
+    return -1;
+#endif
+}
+
+#if SIMULACION
+// Sonda simulada para la placa native: entrega el valor crudo que la curva
+// de fábrica convierte en la humedad de la traza, con el ruido de cada lectura
+static int32_t muestrear(void) {
+    sim_valores_t valores;
+    sim_leer(&valores);
+    return (int32_t)(((1000U - valores.humedad_suelo) * HW080_CRUDO_MAX + 500U) / 1000U);
+}
+#else
+static int32_t muestrear(void) {
+    return adc_sample(linea_adc, ADC_RES_12BIT);
+}
+#endif
+
+int hw080_init(adc_t linea) {
+    linea_adc = linea;
+#if !SIMULACION
+    if (adc_init(linea_adc) < 0) {
+        return -1;
+    }
+#endif
+
+    if (cargar_calibracion() == 0) {
+        printf("Calibración del HW080 cargada de flash (%u puntos)\n",
+               (unsigned)calibracion.num_puntos);
+    } else {
+        cargar_curva_de_fabrica();
+    }
+    return 0;
+}
+
+int hw080_leer_crudo(uint16_t *crudo) {
+    uint16_t muestras[HW080_MUESTRAS_RAFAGA];
+    uint32_t inicio = xtimer_now_usec();
+
+    // Ráfaga de lecturas consecutivas (el shell también puede pedir ráfagas)
+    mutex_lock(&lock_adc);
+    for (unsigned i = 0; i < HW080_MUESTRAS_RAFAGA; i++) {
+        int32_t valor = muestrear();
+        if (valor < 0) {
+            mutex_unlock(&lock_adc);
+            return -1;
+        }
+        muestras[i] = (uint16_t)valor;
+    }
+    mutex_unlock(&lock_adc);
+
+    // Ordenar (inserción: la ráfaga es corta) para descartar los extremos
+    for (unsigned i = 1; i < HW080_MUESTRAS_RAFAGA; i++) {
+        uint16_t v = muestras[i];
+        unsigned j = i;
+        while (j > 0 && muestras[j - 1] > v) {
+            muestras[j] = muestras[j - 1];
+            j--;
+        }
+        muestras[j] = v;
+    }
+
+    // Media recortada: se descarta el cuarto inferior y el superior
+    unsigned desde = HW080_MUESTRAS_RAFAGA / 4;
+    unsigned hasta = HW080_MUESTRAS_RAFAGA - desde;
+    uint32_t suma = 0;
+    for (unsigned i = desde; i < hasta; i++) {
+        suma += muestras[i];
+    }
+    *crudo = (uint16_t)((suma + (hasta - desde) / 2) / (hasta - desde));
+
+    uint32_t duracion = xtimer_now_usec() - inicio;
+    stats.rafagas++;
+    stats.duracion_ultima_us = duracion;
+    if (duracion > stats.duracion_max_us) {
+        stats.duracion_max_us = duracion;
+    }
+    stats.dispersion_ultima = muestras[hasta - 1] - muestras[desde];
+
+    return 0;
+}
+
+uint16_t hw080_convertir(uint16_t crudo) {
+    const hw080_punto_t *p = calibracion.puntos;
+    unsigned n = calibracion.num_puntos;
+
+    // Con un solo punto capturado todavía no hay curva: mapeo lineal de fábrica
+    if (n < 2) {
+        return (uint16_t)(((HW080_CRUDO_MAX - crudo) * 1000UL) / HW080_CRUDO_MAX);
+    }
+
+    // Fuera del rango calibrado se satura al extremo más cercano
+    if (crudo <= p[0].crudo) {
+        return p[0].humedad;
+    }
+    if (crudo >= p[n - 1].crudo) {
+        return p[n - 1].humedad;
+    }
+
+    unsigned i = 1;
+    while (crudo > p[i].crudo) {
+        i++;
+    }
+
+    // Interpolación lineal entre p[i - 1] y p[i]
+    int32_t dx = p[i].crudo - p[i - 1].crudo;
+    int32_t dy = (int32_t)p[i].humedad - p[i - 1].humedad;
+    int32_t x = crudo - p[i - 1].crudo;
+    return (uint16_t)(p[i - 1].humedad + (dy * x + dx / 2) / dx);
+}
+
+int hw080_leer(uint16_t *humedad) {
+    uint16_t crudo;
+
+    if (hw080_leer_crudo(&crudo) != 0) {
+        return -1;
+    }
+    *humedad = hw080_convertir(crudo);
+    return 0;
+}
+
+int hw080_agregar_punto(uint16_t crudo, uint16_t humedad) {
+    if (calibracion_de_fabrica) {
+        calibracion.num_puntos = 0;
+        calibracion_de_fabrica = false;
+    }
+
+    // Un punto con el mismo valor crudo reemplaza al anterior
+    unsigned i = 0;
+    while (i < calibracion.num_puntos && calibracion.puntos[i].crudo < crudo) {
+        i++;
+    }
+    if (i < calibracion.num_puntos && calibracion.puntos[i].crudo == crudo) {
+        calibracion.puntos[i].humedad = humedad;
+        return 0;
+    }
+
+    if (calibracion.num_puntos >= HW080_MAX_PUNTOS) {
+        return -1;
+    }
+
+    memmove(&calibracion.puntos[i + 1], &calibracion.puntos[i],
+            (calibracion.num_puntos - i) * sizeof(hw080_punto_t));
+    calibracion.puntos[i] = (hw080_punto_t){ .crudo = crudo, .humedad = humedad };
+    calibracion.num_puntos++;
+    return 0;
+}
+
+void hw080_restablecer_calibracion(void) {
+    cargar_curva_de_fabrica();
+}
+
+const hw080_calibracion_t *hw080_calibracion(void) {
+    return &calibracion;
+}
+
+const hw080_stats_t *hw080_get_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,58 @@
+#ifndef HW080_H
+#define HW080_H
+
+#include <stdint.h>
+#include "periph/adc.h"
+
+// Lecturas del ADC por ráfaga; se ordenan y se promedia la mitad central
+#ifndef HW080_MUESTRAS_RAFAGA
+#define HW080_MUESTRAS_RAFAGA   (32U)
+#endif
+
+// Puntos de la curva de calibración por sonda
+#define HW080_MAX_PUNTOS        (8U)
+
+#define HW080_CRUDO_MAX         (4095U)     // Resolución de 12 bits
+
+typedef struct {
+    uint16_t crudo;                 // Valor filtrado del ADC
+    uint16_t humedad;               // Décimas de % de humedad del suelo
+} hw080_punto_t;
+
+// Curva lineal por tramos, ordenada por valor crudo ascendente
+typedef struct {
+    uint8_t num_puntos;
+    hw080_punto_t puntos[HW080_MAX_PUNTOS];
+} hw080_calibracion_t;
+
+typedef struct {
+    uint32_t rafagas;               // Ráfagas tomadas desde el arranque
+    uint32_t duracion_ultima_us;    // Costo de la última ráfaga
+    uint32_t duracion_max_us;
+    uint16_t dispersion_ultima;     // max - min de las muestras conservadas
+} hw080_stats_t;
+
+// Inicializa el ADC y carga la calibración guardada (o la de fábrica)
+int hw080_init(adc_t linea);
+
+// Toma una ráfaga y devuelve el valor crudo filtrado (media recortada)
+int hw080_leer_crudo(uint16_t *crudo);
+
+// Convierte un valor crudo a décimas de % según la curva de calibración
+uint16_t hw080_convertir(uint16_t crudo);
+
+// Ráfaga + conversión: humedad del suelo en décimas de %
+int hw080_leer(uint16_t *humedad);
+
+// Agrega (o reemplaza) un punto de calibración; la primera captura descarta
+// la curva de fábrica
+int hw080_agregar_punto(uint16_t crudo, uint16_t humedad);
+void hw080_restablecer_calibracion(void);
+
+// Persistencia en el último sector de la flash (requiere el módulo mtd)
+int hw080_guardar_calibracion(void);
+
+const hw080_calibracion_t *hw080_calibracion(void);
+const hw080_stats_t *hw080_get_stats(void);
+
+#endif
@@ -0,0 +1,18 @@
+-- Columnas para los resúmenes por ventana que envían los nodos con
+-- AGREGACION=1. Quedan a NULL en las filas de lecturas sueltas.
+USE proyecto_iot;
+
+ALTER TABLE dht11_data
+    ADD COLUMN sample_count SMALLINT UNSIGNED NULL,
+    ADD COLUMN temperature_min FLOAT NULL,
+    ADD COLUMN temperature_max FLOAT NULL,
+    ADD COLUMN temperature_std FLOAT NULL,
+    ADD COLUMN humidity_min FLOAT NULL,
+    ADD COLUMN humidity_max FLOAT NULL,
+    ADD COLUMN humidity_std FLOAT NULL;
+
+ALTER TABLE hw080_data
+    ADD COLUMN sample_count SMALLINT UNSIGNED NULL,
+    ADD COLUMN moisture_min FLOAT NULL,
+    ADD COLUMN moisture_max FLOAT NULL,
+    ADD COLUMN moisture_std FLOAT NULL;
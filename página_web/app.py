@@ -1,53 +1,725 @@
 from flask import Flask, render_template, jsonify, request
 from flask_socketio import SocketIO
 import mysql.connector
+import mysql.connector.pooling
+from contextlib import contextmanager
+from collections import deque
 from datetime import datetime, timedelta
 import paho.mqtt.client as mqtt
 import json
 import re
+import struct
 import socket  # Importar el módulo socket para enviar UDP
+import itertools
+import threading
+import time
+import queue
+import atexit
+import heapq
 
 app = Flask(__name__)
 socketio = SocketIO(app, cors_allowed_origins="*")
 
 # Configuración de la base de datos
-db = mysql.connector.connect(
-    host="localhost",
-    user="user",
-    password="password"
-    database="proyecto_iot"
+DB_CONFIG = {
+    'host': "localhost",
+    'user': "user",
+    'password': "password",
+    'database': "proyecto_iot",
+}
+
+# Ingesta: on_message (hilo de paho) solo encola filas; los escritores las
+# insertan por lotes con sus propias conexiones. Con la cola llena on_message
+# se bloquea, lo que frena la lectura del broker, y pasado INGESTA_ESPERA_MAX
+# descarta la fila.
+INGESTA_COLA_MAX = 10000
+INGESTA_ESCRITORES = 2
+INGESTA_LOTE_MAX = 500      # Filas por commit
+INGESTA_VENTANA = 0.2       # Segundos que una fila puede esperar a completar lote
+INGESTA_ESPERA_MAX = 5.0    # Segundos de bloqueo con la cola llena antes de descartar
+INGESTA_MUESTRAS_COMMIT = 256   # Últimas latencias de commit para los percentiles
+API_CONEXIONES = 4          # Conexiones para las consultas de Flask
+
+pool_api = mysql.connector.pooling.MySQLConnectionPool(
+    pool_name='api', pool_size=API_CONEXIONES, **DB_CONFIG)
+pool_escritura = mysql.connector.pooling.MySQLConnectionPool(
+    pool_name='ingesta', pool_size=INGESTA_ESCRITORES, **DB_CONFIG)
+# El pool no espera si se agota: el semáforo hace que las peticiones hagan cola
+conexiones_api_libres = threading.BoundedSemaphore(API_CONEXIONES)
+
+cola_ingesta = queue.Queue(maxsize=INGESTA_COLA_MAX)
+parar_ingesta = threading.Event()
+escritores = []
+metricas_lock = threading.Lock()
+metricas_ingesta = {
+    'encoladas': 0,
+    'bloqueos': 0,          # Filas que encontraron la cola llena
+    'descartadas': 0,       # Seguían sin sitio tras INGESTA_ESPERA_MAX
+    'escritas': 0,
+    'perdidas': 0,          # Lotes que fallaron también al reintentar
+    'lotes': 0,
+    'errores': 0,
+    'profundidad_max': 0,
+    'lote_max': 0,
+    'commit_total_ms': 0.0,
+    'commit_max_ms': 0.0,
+}
+latencias_commit = deque(maxlen=INGESTA_MUESTRAS_COMMIT)
+
+# Agregados por cubeta (rollups.sql): mínimo, máximo y suma por nodo y
+# magnitud, actualizados en el mismo commit que las filas crudas
+ROLLUP_MAGNITUDES = {
+    'dht11_data': ('dht11', ('temperature', 'humidity', 'estado_estres')),
+    'hw080_data': ('hw080', ('moisture', 'estado_estres')),
+}
+ROLLUP_RESOLUCIONES = (   # nombre, segundos por cubeta, campos que se truncan
+    ('1m', 60, {'second': 0}),
+    ('1h', 3600, {'minute': 0, 'second': 0}),
+    ('1d', 86400, {'hour': 0, 'minute': 0, 'second': 0}),
 )
+rollups_activos = False
+
+# Columnas opcionales de las migraciones (agregados.sql, confianza_ia.sql,
+# hora_muestra.sql): insertar solo añade las que existen en la tabla
+COLUMNAS_OPCIONALES = {
+    'dht11_data': ('sample_count', 'temperature_min', 'temperature_max', 'temperature_std',
+                   'humidity_min', 'humidity_max', 'humidity_std', 'stress_confidence', 'received_at'),
+    'hw080_data': ('sample_count', 'moisture_min', 'moisture_max', 'moisture_std',
+                   'stress_confidence', 'received_at'),
+}
+columnas_opcionales = {}    # tabla -> columnas opcionales presentes
+
+# /api/data: nodos del panel y puntos máximos por serie si no se indican
+NODOS_PANEL = (1, 2, 3, 4)
+DATA_MAX_PUNTOS = 1000
+SINCE_MAX_FILAS = 1000  # Filas por respuesta de /api/since
+SINCE_ESPERA_MAX = 2.0  # Segundos que /api/since espera a las filas aún sin escribir
+
+# Orden de llegada (orden_llegada.sql): cada fila se numera al encolarla y
+# /api/since pagina por ese número. Un escritor puede confirmar su lote
+# antes que otro con números menores, así que el cursor nunca pasa del
+# horizonte: el último número por debajo del cual no queda nada pendiente.
+llegada_activa = False
+llegada_cond = threading.Condition()
+llegada_ultima = 0          # Último número asignado
+llegada_pendientes = set()  # Asignados sin commit ni descarte todavía
+
+# Caché de las últimas lecturas por tipo de sensor y nodo, en orden de
+# timestamp: /api/last_n_values la usa para n <= CACHE_FILAS sin tocar MySQL.
+# Se carga de la base al arrancar y después se alimenta en la ingesta.
+CACHE_FILAS = 200
+CACHE_COLUMNAS = {'dht11': 'temperature, humidity', 'hw080': 'moisture'}
+cache_lock = threading.Lock()
+cache_ultimas = {}          # (sensor_type, node_number) -> deque de filas
+cache_cargada = False
+metricas_cache = {
+    'aciertos': 0,
+    'fallos': 0,
+    'acierto_total_ms': 0.0,
+    'acierto_max_ms': 0.0,
+    'fallo_total_ms': 0.0,
+    'fallo_max_ms': 0.0,
+}
 
 # Configuración MQTT
 MQTT_BROKER = "localhost"
 MQTT_PORT = 1883
 MQTT_TOPIC = "sensores/#"
+# Lotes de la pasarela MQTT-SN del router de borde (router_borde/pasarela.h)
+MQTT_TOPIC_LOTE = "pasarela/lote"
+MQTT_TOPIC_VECINOS = "pasarela/vecinos"
 
 # Configuración UDP
 UDP_IP = "2001:db8:a::2"  # Dirección IPv6 del ESP32
 UDP_PORT = 12345  # Puerto UDP en el ESP32
 
+# Órdenes binarias a los actuadores del router (ver router_borde/actuador.h)
+ACTUADOR_VERSION = 1
+ACTUADOR_ORDEN = struct.Struct('<BHBBII')  # version, seq, canal, accion, retardo_ms, duracion_ms
+ACTUADOR_ACK = struct.Struct('<BHBI')      # version, seq, estado, latencia_us
+ACTUADOR_ACCIONES = {'OFF': 0, 'ON': 1, 'TOGGLE': 2}
+ACTUADOR_ESTADOS = {0: 'applied', 1: 'scheduled', 2: 'invalid', 3: 'no_channel', 4: 'busy'}
+ACTUADOR_CANALES = 3
+ACTUADOR_ESPERA_ACK = 0.5   # Segundos por intento
+ACTUADOR_INTENTOS = 3
+actuador_seq = itertools.count(1)
+actuador_seq_lock = threading.Lock()
+
+# Trama compacta publicada en sensores/nodo_<N>/trama (ver modulos/telemetria/include/trama.h)
+TRAMA_VERSION = 1
+TRAMA_CABECERA = struct.Struct('<BBHBI')   # version, banderas, id_nodo, num_registros, tiempo_envio
+TRAMA_REGISTRO = struct.Struct('<HIhHHB')  # secuencia, tiempo, temperatura, humedad, humedad_suelo, estres
+TRAMA_TEMP_AUSENTE = -32768
+TRAMA_VALOR_AUSENTE = 0xFFFF
+TRAMA_ESTRES_AUSENTE = 0xFF
+# Con esta bandera cada registro resume una ventana y lleva su dispersión
+TRAMA_BANDERA_RESUMEN = 0x01
+# Con esta bandera los tiempos son segundos Unix puestos por el nodo
+TRAMA_BANDERA_HORA = 0x02
+TRAMA_RESUMEN = struct.Struct('<HhhHhhHhhH')  # cuenta, (min, max, desv) x temperatura, humedad, suelo
+
+# Lote de la pasarela: cabecera y, por registro, tiempo + tema + datos
+LOTE_VERSION = 1
+LOTE_CABECERA = struct.Struct('<BBI')  # version, num_registros, tiempo_envio
+# Tabla de vecinos de la pasarela: misma cabecera y una entrada por nodo
+VECINO = struct.Struct('<H8sIIHHbbI')  # id_nodo, iid, paquetes, bytes, dup, descartes, rssi, rssi_medio, antiguedad
+RSSI_AUSENTE = -128
+
 # Diccionario para almacenar datos temporales de los nodos
 node_data = {}
 
+# Última tabla de enlaces publicada por la pasarela, por IID del nodo
+link_stats = {}
+
 def extract_node_number(topic):
     match = re.search(r'nodo_(\d+)', topic)
     return int(match.group(1)) if match else None
 
+def resumen_magnitud(prefijo, minimo, maximo, desviacion):
+    return {f'{prefijo}_min': minimo, f'{prefijo}_max': maximo, f'{prefijo}_std': desviacion}
+
+@contextmanager
+def conexion_api():
+    with conexiones_api_libres:
+        conexion = pool_api.get_connection()
+        try:
+            yield conexion
+        finally:
+            conexion.close()  # Vuelve al pool
+
+def insertar(tabla, columnas, valores, extra):
+    # Columnas opcionales: resumen de ventana (agregados.sql), confianza de la
+    # clasificación (confianza_ia.sql) y hora de llegada de las muestras con
+    # hora del nodo (hora_muestra.sql), solo cuando el nodo las envía y la
+    # migración está aplicada. Con orden_llegada.sql se numera además la
+    # fila, y ese número se devuelve.
+    presentes = columnas_opcionales.get(tabla, ())
+    extra = {columna: valor for columna, valor in extra.items() if columna in presentes}
+    if extra:
+        columnas = columnas + list(extra)
+        valores = valores + list(extra.values())
+    llegada = numerar_llegada() if llegada_activa else None
+    if llegada is not None:
+        columnas = columnas + ['arrival_id']
+        valores = valores + [llegada]
+
+    fila = (tabla, tuple(columnas), tuple(valores))
+    try:
+        cola_ingesta.put_nowait(fila)
+    except queue.Full:
+        with metricas_lock:
+            metricas_ingesta['bloqueos'] += 1
+        try:
+            cola_ingesta.put(fila, timeout=INGESTA_ESPERA_MAX)
+        except queue.Full:
+            with metricas_lock:
+                metricas_ingesta['descartadas'] += 1
+            print(f"--- Cola de ingesta llena, fila de {tabla} descartada ---")
+            if llegada is not None:
+                liberar_llegada([llegada])
+            return None
+
+    with metricas_lock:
+        metricas_ingesta['encoladas'] += 1
+        metricas_ingesta['profundidad_max'] = max(metricas_ingesta['profundidad_max'], cola_ingesta.qsize())
+    return llegada
+
+def numerar_llegada():
+    global llegada_ultima
+    with llegada_cond:
+        llegada_ultima += 1
+        llegada_pendientes.add(llegada_ultima)
+        return llegada_ultima
+
+def liberar_llegada(numeros):
+    # Filas ya confirmadas o perdidas: dejan de frenar el horizonte
+    if numeros:
+        with llegada_cond:
+            llegada_pendientes.difference_update(numeros)
+            llegada_cond.notify_all()
+
+def numeros_llegada(lote):
+    return [valores[columnas.index('arrival_id')]
+            for _, columnas, valores in lote if 'arrival_id' in columnas]
+
+def horizonte_llegada(espera=0):
+    # Con espera, aguarda hasta ese tiempo a que se escriba lo ya numerado
+    with llegada_cond:
+        objetivo = llegada_ultima
+        llegada_cond.wait_for(lambda: min(llegada_pendientes, default=objetivo + 1) > objetivo, espera)
+        return min(llegada_pendientes, default=llegada_ultima + 1) - 1
+
+def columna_llegada():
+    return ', arrival_id' if llegada_activa else ''
+
+def cachear_lectura(fila):
+    clave = (fila['sensor_type'], fila['node_number'])
+    with cache_lock:
+        serie = cache_ultimas.get(clave)
+        if serie is None:
+            serie = cache_ultimas[clave] = deque(maxlen=CACHE_FILAS)
+        if not serie or serie[-1]['timestamp'] <= fila['timestamp']:
+            serie.append(fila)
+            return
+
+        # Lectura atrasada (vaciado de la cola del nodo o de la pasarela): se
+        # coloca en su sitio si es más reciente que la más antigua guardada
+        posicion = len(serie)
+        while posicion > 0 and serie[posicion - 1]['timestamp'] > fila['timestamp']:
+            posicion -= 1
+        if len(serie) == CACHE_FILAS:
+            if posicion == 0:
+                return
+            serie.popleft()
+            posicion -= 1
+        serie.insert(posicion, fila)
+
+def cargar_cache():
+    global cache_cargada
+    with conexion_api() as conexion:
+        cursor = conexion.cursor(dictionary=True)
+        for sensor_type, columnas in CACHE_COLUMNAS.items():
+            tabla = f'{sensor_type}_data'
+            cursor.execute(f"SELECT DISTINCT node_number FROM {tabla}")
+            for node_number in [fila['node_number'] for fila in cursor.fetchall()]:
+                cursor.execute(f"""
+                SELECT '{sensor_type}' as sensor_type, node_number, name, {columnas}, estado_estres, timestamp
+                       {columna_llegada()}
+                FROM {tabla}
+                WHERE node_number = %s
+                ORDER BY timestamp DESC
+                LIMIT %s
+                """, (node_number, CACHE_FILAS))
+                filas = cursor.fetchall()
+                with cache_lock:
+                    cache_ultimas[(sensor_type, node_number)] = deque(reversed(filas), maxlen=CACHE_FILAS)
+        cursor.close()
+    cache_cargada = True
+    print(f"Caché de últimas lecturas cargada: {len(cache_ultimas)} series")
+
+def registrar_consulta_cache(acierto, inicio):
+    duracion_ms = (time.perf_counter() - inicio) * 1000
+    tipo = 'acierto' if acierto else 'fallo'
+    with metricas_lock:
+        metricas_cache['aciertos' if acierto else 'fallos'] += 1
+        metricas_cache[f'{tipo}_total_ms'] += duracion_ms
+        metricas_cache[f'{tipo}_max_ms'] = max(metricas_cache[f'{tipo}_max_ms'], duracion_ms)
+
+def escribir_lote(conexion, lote):
+    # Las filas con las mismas columnas van en un solo executemany, que
+    # mysql.connector convierte en un INSERT de varias filas
+    grupos = {}
+    for tabla, columnas, valores in lote:
+        grupos.setdefault((tabla, columnas), []).append(valores)
+
+    for intento in range(2):
+        try:
+            if conexion is None:
+                conexion = pool_escritura.get_connection()
+            inicio = time.monotonic()
+            cursor = conexion.cursor()
+            for (tabla, columnas), filas in grupos.items():
+                cursor.executemany(f"INSERT INTO {tabla} ({', '.join(columnas)}) "
+                                   f"VALUES ({', '.join(['%s'] * len(columnas))})", filas)
+            if rollups_activos:
+                actualizar_rollups(cursor, lote)
+            conexion.commit()
+            cursor.close()
+            duracion_ms = (time.monotonic() - inicio) * 1000
+
+            with metricas_lock:
+                metricas_ingesta['escritas'] += len(lote)
+                metricas_ingesta['lotes'] += 1
+                metricas_ingesta['lote_max'] = max(metricas_ingesta['lote_max'], len(lote))
+                metricas_ingesta['commit_total_ms'] += duracion_ms
+                metricas_ingesta['commit_max_ms'] = max(metricas_ingesta['commit_max_ms'], duracion_ms)
+                latencias_commit.append(duracion_ms)
+            liberar_llegada(numeros_llegada(lote))
+            return conexion
+        except mysql.connector.Error as e:
+            print(f"--- Error escribiendo lote de {len(lote)} filas (intento {intento + 1}) ---")
+            print(f"Error: {e}")
+            with metricas_lock:
+                metricas_ingesta['errores'] += 1
+            # Se descarta la conexión y el reintento usa otra del pool
+            if conexion is not None:
+                try:
+                    conexion.rollback()
+                    conexion.close()
+                except mysql.connector.Error:
+                    pass
+                conexion = None
+
+            # Reintentar no arregla una fila con datos o columnas que la base
+            # no admite: se parte el lote por la mitad hasta aislarla, así
+            # solo se pierde esa fila y no las de los demás nodos
+            if es_error_de_datos(e):
+                if len(lote) > 1:
+                    mitad = len(lote) // 2
+                    conexion = escribir_lote(conexion, lote[:mitad])
+                    return escribir_lote(conexion, lote[mitad:])
+                break
+
+    with metricas_lock:
+        metricas_ingesta['perdidas'] += len(lote)
+    liberar_llegada(numeros_llegada(lote))
+    return None
+
+def es_error_de_datos(error):
+    # Los de conexión (OperationalError, InterfaceError) sí pueden pasar al reintentar
+    return isinstance(error, mysql.connector.DatabaseError) and \
+        not isinstance(error, mysql.connector.OperationalError)
+
+def actualizar_rollups(cursor, lote):
+    # Se acumula el lote en memoria y cada cubeta se actualiza una sola vez
+    cubetas = {}
+    for tabla, columnas, valores in lote:
+        if tabla not in ROLLUP_MAGNITUDES:
+            continue
+        sensor_type, magnitudes = ROLLUP_MAGNITUDES[tabla]
+        fila = dict(zip(columnas, valores))
+        instante = datetime.strptime(fila['timestamp'], '%Y-%m-%d %H:%M:%S')
+        for magnitud in magnitudes:
+            valor = fila.get(magnitud)
+            if valor is None:
+                continue
+            minimo = fila.get(f'{magnitud}_min', valor)
+            maximo = fila.get(f'{magnitud}_max', valor)
+            for nombre, _, campos in ROLLUP_RESOLUCIONES:
+                clave = (nombre, sensor_type, magnitud, fila['node_number'], instante.replace(**campos))
+                cubeta = cubetas.get(clave)
+                if cubeta is None:
+                    cubetas[clave] = [1, valor, minimo, maximo]
+                else:
+                    cubeta[0] += 1
+                    cubeta[1] += valor
+                    cubeta[2] = min(cubeta[2], minimo)
+                    cubeta[3] = max(cubeta[3], maximo)
+
+    # En orden de clave para que dos escritores no se bloqueen mutuamente
+    for nombre, _, _ in ROLLUP_RESOLUCIONES:
+        filas = [(*clave[1:], *cubeta) for clave, cubeta in sorted(cubetas.items()) if clave[0] == nombre]
+        if filas:
+            cursor.executemany(f"""
+                INSERT INTO rollup_{nombre}
+                    (sensor_type, metric, node_number, bucket, samples, value_sum, value_min, value_max)
+                VALUES (%s, %s, %s, %s, %s, %s, %s, %s)
+                ON DUPLICATE KEY UPDATE samples = samples + VALUES(samples),
+                    value_sum = value_sum + VALUES(value_sum),
+                    value_min = LEAST(value_min, VALUES(value_min)),
+                    value_max = GREATEST(value_max, VALUES(value_max))
+            """, filas)
+
+def comprobar_rollups():
+    global rollups_activos
+    with conexion_api() as conexion:
+        cursor = conexion.cursor()
+        cursor.execute("""
+            SELECT COUNT(*) FROM information_schema.tables
+            WHERE table_schema = DATABASE() AND table_name IN ('rollup_1m', 'rollup_1h', 'rollup_1d')
+        """)
+        (tablas,) = cursor.fetchone()
+        cursor.close()
+    rollups_activos = tablas == len(ROLLUP_RESOLUCIONES)
+    print(f"Agregados por cubeta {'activos' if rollups_activos else 'desactivados (falta rollups.sql)'}")
+
+def comprobar_columnas():
+    with conexion_api() as conexion:
+        cursor = conexion.cursor()
+        for tabla, opcionales in COLUMNAS_OPCIONALES.items():
+            cursor.execute(f"""
+                SELECT column_name FROM information_schema.columns
+                WHERE table_schema = DATABASE() AND table_name = %s
+                AND column_name IN ({', '.join(['%s'] * len(opcionales))})
+            """, (tabla, *opcionales))
+            presentes = {fila[0] for fila in cursor.fetchall()}
+            columnas_opcionales[tabla] = presentes
+            ausentes = [columna for columna in opcionales if columna not in presentes]
+            if ausentes:
+                print(f"Columnas opcionales ausentes en {tabla} (no se guardan): {', '.join(ausentes)}")
+        cursor.close()
+
+def comprobar_llegada():
+    # El contador sigue desde el mayor número ya guardado
+    global llegada_activa, llegada_ultima
+    with conexion_api() as conexion:
+        cursor = conexion.cursor()
+        cursor.execute("""
+            SELECT COUNT(*) FROM information_schema.columns
+            WHERE table_schema = DATABASE() AND table_name IN ('dht11_data', 'hw080_data')
+            AND column_name = 'arrival_id'
+        """)
+        (columnas,) = cursor.fetchone()
+        llegada_activa = columnas == 2
+        if llegada_activa:
+            cursor.execute("""
+                SELECT GREATEST(COALESCE((SELECT MAX(arrival_id) FROM dht11_data), 0),
+                                COALESCE((SELECT MAX(arrival_id) FROM hw080_data), 0))
+            """)
+            llegada_ultima = int(cursor.fetchone()[0])
+        cursor.close()
+    print(f"Orden de llegada {'activo' if llegada_activa else 'desactivado (falta orden_llegada.sql)'}")
+
+def escritor_ingesta():
+    conexion = None
+    while True:
+        try:
+            lote = [cola_ingesta.get(timeout=INGESTA_VENTANA)]
+        except queue.Empty:
+            if parar_ingesta.is_set():
+                break
+            continue
+
+        # Se completa el lote con lo que llegue dentro de la ventana
+        limite = time.monotonic() + INGESTA_VENTANA
+        while len(lote) < INGESTA_LOTE_MAX:
+            restante = limite - time.monotonic()
+            if restante <= 0:
+                break
+            try:
+                lote.append(cola_ingesta.get(timeout=restante))
+            except queue.Empty:
+                break
+        conexion = escribir_lote(conexion, lote)
+
+    if conexion is not None:
+        conexion.close()
+
+def iniciar_ingesta():
+    comprobar_columnas()
+    comprobar_rollups()
+    for i in range(INGESTA_ESCRITORES):
+        hilo = threading.Thread(target=escritor_ingesta, name=f'ingesta_{i}', daemon=True)
+        hilo.start()
+        escritores.append(hilo)
+
+def detener_ingesta():
+    # Los escritores vacían la cola antes de terminar
+    parar_ingesta.set()
+    for hilo in escritores:
+        hilo.join(timeout=10)
+
+def percentil(valores, p):
+    if not valores:
+        return None
+    ordenados = sorted(valores)
+    return ordenados[min(len(ordenados) - 1, int(p / 100.0 * len(ordenados)))]
+
+def columnas_extra(resumen, confianza, recepcion=None):
+    extra = dict(resumen or {})
+    if confianza is not None:
+        extra['stress_confidence'] = confianza
+    if recepcion is not None:
+        extra['received_at'] = recepcion
+    return extra
+
+def formato_hora(instante):
+    return instante.strftime('%Y-%m-%d %H:%M:%S')
+
+def separar_hora(payload):
+    # "valor@segundos": el nodo marcó la lectura con hora Unix (modulos/telemetria/include/reloj.h)
+    valor, _, marca = payload.decode().partition('@')
+    return valor, (datetime.fromtimestamp(int(marca)) if marca else None)
+
+def guardar_dht11(node_number, temperature, humidity, stress_state, timestamp_str, resumen=None,
+                  confianza=None, recepcion=None):
+    data_to_save = {
+        'sensor_type': 'dht11',
+        'node_number': node_number,
+        'name': node_data[node_number]['name'],
+        'temperature': temperature,
+        'humidity': humidity,
+        'stress_state': stress_state,
+        'estado_estres': stress_state,
+        'timestamp': timestamp_str
+    }
+
+    llegada = insertar('dht11_data',
+                       ['node_number', 'name', 'temperature', 'humidity', 'estado_estres', 'timestamp'],
+                       [data_to_save['node_number'],
+                        data_to_save['name'],
+                        data_to_save['temperature'],
+                        data_to_save['humidity'],
+                        data_to_save['stress_state'],
+                        data_to_save['timestamp']],
+                       columnas_extra(resumen, confianza, recepcion))
+    data_to_save.update(columnas_extra(resumen, confianza, recepcion))
+    data_to_save['arrival_id'] = llegada
+    cachear_lectura({'sensor_type': 'dht11', 'node_number': node_number, 'name': data_to_save['name'],
+                     'arrival_id': llegada,
+                     'temperature': temperature, 'humidity': humidity, 'estado_estres': stress_state,
+                     'timestamp': datetime.strptime(timestamp_str, '%Y-%m-%d %H:%M:%S')})
+
+    socketio.emit('new_data', data_to_save)
+    print("--- Datos DHT11 almacenados ---")
+    print(f"Datos: {data_to_save}")
+
+def guardar_hw080(node_number, moisture, stress_state, timestamp_str, resumen=None,
+                  confianza=None, recepcion=None):
+    data_to_save = {
+        'sensor_type': 'hw080',
+        'node_number': node_number,
+        'name': node_data[node_number]['name'],
+        'moisture': moisture,
+        'estado_estres': stress_state,
+        'timestamp': timestamp_str
+    }
+
+    llegada = insertar('hw080_data',
+                       ['node_number', 'name', 'moisture', 'estado_estres', 'timestamp'],
+                       [data_to_save['node_number'],
+                        data_to_save['name'],
+                        data_to_save['moisture'],
+                        stress_state,
+                        data_to_save['timestamp']],
+                       columnas_extra(resumen, confianza, recepcion))
+    data_to_save.update(columnas_extra(resumen, confianza, recepcion))
+    data_to_save['arrival_id'] = llegada
+    cachear_lectura({'sensor_type': 'hw080', 'node_number': node_number, 'name': data_to_save['name'],
+                     'arrival_id': llegada,
+                     'moisture': moisture, 'estado_estres': stress_state,
+                     'timestamp': datetime.strptime(timestamp_str, '%Y-%m-%d %H:%M:%S')})
+
+    socketio.emit('new_data', data_to_save)
+    print("--- Datos HW080 almacenados ---")
+    print(f"Datos: {data_to_save}")
+
+def procesar_trama(node_number, payload, llegada):
+    version, banderas, id_nodo, num_registros, tiempo_envio = TRAMA_CABECERA.unpack_from(payload, 0)
+    if version != TRAMA_VERSION:
+        raise ValueError(f"Versión de trama no soportada: {version}")
+    tam_registro = TRAMA_REGISTRO.size
+    if banderas & TRAMA_BANDERA_RESUMEN:
+        tam_registro += TRAMA_RESUMEN.size
+    if len(payload) < TRAMA_CABECERA.size + num_registros * tam_registro:
+        raise ValueError(f"Trama truncada: {len(payload)} bytes para {num_registros} registros")
+
+    for i in range(num_registros):
+        offset = TRAMA_CABECERA.size + i * tam_registro
+        secuencia, tiempo, temperatura, humedad, humedad_suelo, estres = TRAMA_REGISTRO.unpack_from(payload, offset)
+
+        resumen_dht11 = resumen_hw080 = None
+        if banderas & TRAMA_BANDERA_RESUMEN:
+            (cuenta, t_min, t_max, t_desv, h_min, h_max, h_desv,
+             s_min, s_max, s_desv) = TRAMA_RESUMEN.unpack_from(payload, offset + TRAMA_REGISTRO.size)
+            # cuenta == 0: lectura suelta dentro de una trama con resúmenes
+            if cuenta > 0:
+                resumen_dht11 = {'sample_count': cuenta,
+                                 **resumen_magnitud('temperature', t_min / 10.0, t_max / 10.0, t_desv / 10.0),
+                                 **resumen_magnitud('humidity', h_min / 10.0, h_max / 10.0, h_desv / 10.0)}
+                resumen_hw080 = {'sample_count': cuenta,
+                                 **resumen_magnitud('moisture', s_min / 10.0, s_max / 10.0, s_desv / 10.0)}
+
+        recepcion = None
+        if banderas & TRAMA_BANDERA_HORA:
+            # El nodo tenía hora del router: se guarda la de la lectura tal cual
+            timestamp_str = formato_hora(datetime.fromtimestamp(tiempo))
+            recepcion = formato_hora(llegada)
+        else:
+            # Los tiempos de la trama son relativos al arranque del nodo: la muestra
+            # ocurrió (tiempo_envio - tiempo) segundos antes de recibir la trama
+            # (llegada ya descuenta lo que esperó en la pasarela, si pasó por ella)
+            antiguedad = max(0, tiempo_envio - tiempo)
+            timestamp_str = formato_hora(llegada - timedelta(seconds=antiguedad))
+
+        # estres es la confianza de "sin estrés" en %; el estado se deriva de ella
+        confianza = None
+        if estres != TRAMA_ESTRES_AUSENTE:
+            confianza = float(estres)
+            node_data[node_number]['stress_state'] = 1 if estres >= 50 else 0
+        stress_state = node_data[node_number]['stress_state']
+
+        print(f"Trama nodo {id_nodo}, muestra #{secuencia}: temp={temperatura}, hum={humedad}, "
+              f"suelo={humedad_suelo}, estres={estres}")
+
+        if temperatura != TRAMA_TEMP_AUSENTE and humedad != TRAMA_VALOR_AUSENTE:
+            guardar_dht11(node_number, temperatura / 10.0, humedad / 10.0, stress_state, timestamp_str,
+                          resumen_dht11, confianza, recepcion)
+
+        if humedad_suelo != TRAMA_VALOR_AUSENTE:
+            guardar_hw080(node_number, humedad_suelo / 10.0,
+                          stress_state if stress_state is not None else 1, timestamp_str,
+                          resumen_hw080, confianza, recepcion)
+
 def on_connect(client, userdata, flags, rc):
     print(f"Conectado al broker MQTT con código: {rc}")
     client.subscribe(MQTT_TOPIC)
-    print(f"Suscrito a {MQTT_TOPIC}")
+    client.subscribe(MQTT_TOPIC_LOTE, qos=1)
+    client.subscribe(MQTT_TOPIC_VECINOS)
+    print(f"Suscrito a {MQTT_TOPIC}, {MQTT_TOPIC_LOTE} y {MQTT_TOPIC_VECINOS}")
+
+def procesar_lote(payload):
+    version, num_registros, tiempo_envio = LOTE_CABECERA.unpack_from(payload, 0)
+    if version != LOTE_VERSION:
+        raise ValueError(f"Versión de lote no soportada: {version}")
+
+    recibido = datetime.now()
+    offset = LOTE_CABECERA.size
+    for _ in range(num_registros):
+        tiempo, longitud_tema = struct.unpack_from('<IB', payload, offset)
+        offset += 5
+        topic = payload[offset:offset + longitud_tema].decode()
+        offset += longitud_tema
+        (longitud_datos,) = struct.unpack_from('<H', payload, offset)
+        offset += 2
+        datos = payload[offset:offset + longitud_datos]
+        offset += longitud_datos
+        if len(datos) != longitud_datos:
+            raise ValueError(f"Lote truncado en el tema {topic}")
+
+        # Cada mensaje se trata como si hubiera llegado cuando lo recibió la pasarela
+        llegada = recibido - timedelta(seconds=max(0, tiempo_envio - tiempo))
+        procesar_mensaje(topic, datos, llegada)
+
+def procesar_vecinos(payload):
+    version, num_vecinos, _ = LOTE_CABECERA.unpack_from(payload, 0)
+    if version != LOTE_VERSION:
+        raise ValueError(f"Versión de tabla de vecinos no soportada: {version}")
+
+    recibido = datetime.now()
+    for i in range(num_vecinos):
+        (id_nodo, iid, paquetes, bytes_, dup, descartes, rssi, rssi_medio,
+         antiguedad) = VECINO.unpack_from(payload, LOTE_CABECERA.size + i * VECINO.size)
+        link_stats[iid.hex()] = {
+            'node_number': id_nodo or None,
+            'iid': iid.hex(),
+            'packets': paquetes,
+            'bytes': bytes_,
+            'retransmissions': dup,
+            'drops': descartes,
+            'rssi': None if rssi == RSSI_AUSENTE else rssi,
+            'rssi_avg': None if rssi_medio == RSSI_AUSENTE else rssi_medio,
+            'last_seen': (recibido - timedelta(seconds=antiguedad)).strftime('%Y-%m-%d %H:%M:%S'),
+        }
+    socketio.emit('link_stats', list(link_stats.values()))
 
 def on_message(client, userdata, msg):
+    print("\n--- Mensaje recibido ---")
+    print(f"Topic: {msg.topic}")
+    print(f"Payload: {msg.payload}")
+
+    if msg.topic == MQTT_TOPIC_LOTE:
+        try:
+            procesar_lote(msg.payload)
+        except Exception as e:
+            print("--- Error procesando lote de la pasarela ---")
+            print(f"Error: {e}")
+        return
+    if msg.topic == MQTT_TOPIC_VECINOS:
+        try:
+            procesar_vecinos(msg.payload)
+        except Exception as e:
+            print("--- Error procesando la tabla de vecinos ---")
+            print(f"Error: {e}")
+        return
+
+    procesar_mensaje(msg.topic, msg.payload, datetime.now())
+
+def procesar_mensaje(topic, payload, llegada):
     try:
-        print("\n--- Mensaje recibido ---")
-        print(f"Topic: {msg.topic}")
-        print(f"Payload: {msg.payload}")
-        
-        topic_parts = msg.topic.split('/')
+        topic_parts = topic.split('/')
         if len(topic_parts) < 3:
-            print(f"Formato de topic no válido: {msg.topic}")
+            print(f"Formato de topic no válido: {topic}")
             return
 
         node_number = extract_node_number(topic_parts[1])
@@ -65,186 +737,485 @@ def on_message(client, userdata, msg):
                 'humidity': None,
                 'moisture': None,
                 'stress_state': None,
+                'resumen': None,
+                'stress_confidence': None,
+                'sample_time': None,
             }
 
+        # Trama compacta: una muestra completa en un solo mensaje
+        if sensor_type == 'trama':
+            procesar_trama(node_number, payload, llegada)
+            return
+
+        # Los valores pueden llevar la hora de la lectura puesta por el nodo
+        valor = None
+        if sensor_type in ('temperatura', 'humedad', 'humedad_suelo', 'estado_estres',
+                           'confianza_sin_estres'):
+            valor, hora_muestra = separar_hora(payload)
+            if hora_muestra is not None:
+                node_data[node_number]['sample_time'] = hora_muestra
+
         # Procesar el payload según el tipo de sensor
         if sensor_type == 'nombre':
-            node_data[node_number]['name'] = json.loads(msg.payload.decode())
+            node_data[node_number]['name'] = json.loads(payload.decode())
         elif sensor_type == 'temperatura':
-            node_data[node_number]['temperature'] = float(msg.payload.decode())
+            node_data[node_number]['temperature'] = float(valor)
         elif sensor_type == 'humedad':
-            node_data[node_number]['humidity'] = float(msg.payload.decode())
+            node_data[node_number]['humidity'] = float(valor)
         elif sensor_type == 'humedad_suelo':
-            node_data[node_number]['moisture'] = float(msg.payload.decode())
+            node_data[node_number]['moisture'] = float(valor)
         elif sensor_type == 'estado_estres':
-            node_data[node_number]['stress_state'] = int(msg.payload.decode())
+            node_data[node_number]['stress_state'] = int(valor)
+        elif sensor_type == 'confianza_sin_estres':
+            # Confianza del clasificador en %; sustituye al 0/1 de estado_estres
+            confianza = float(valor)
+            node_data[node_number]['stress_confidence'] = confianza
+            node_data[node_number]['stress_state'] = 1 if confianza >= 50 else 0
+        elif sensor_type == 'resumen':
+            # Llega antes que las medias de la misma ventana
+            node_data[node_number]['resumen'] = json.loads(payload.decode())
+
+        # Con hora del nodo se guarda la de la lectura y aparte la de llegada
+        recepcion = None
+        timestamp_str = formato_hora(llegada)
+        if node_data[node_number]['sample_time'] is not None:
+            timestamp_str = formato_hora(node_data[node_number]['sample_time'])
+            recepcion = formato_hora(llegada)
 
-        current_timestamp = datetime.now()
-        timestamp_str = current_timestamp.strftime('%Y-%m-%d %H:%M:%S')
+        resumen = node_data[node_number]['resumen']
 
         # Almacenar datos del DHT11
         if node_data[node_number]['temperature'] is not None and node_data[node_number]['humidity'] is not None:
-            data_to_save = {
-                'node_number': node_data[node_number]['node_number'],
-                'name': node_data[node_number]['name'],
-                'temperature': node_data[node_number]['temperature'],
-                'humidity': node_data[node_number]['humidity'],
-                'stress_state': node_data[node_number]['stress_state'],
-                'timestamp': timestamp_str
-            }
-
-            cursor = db.cursor()
-            query = """
-                INSERT INTO dht11_data (node_number, name, temperature, humidity, estado_estres, timestamp)
-                VALUES (%s, %s, %s, %s, %s, %s)
-            """
-            cursor.execute(query, (
-                data_to_save['node_number'],
-                data_to_save['name'],
-                data_to_save['temperature'],
-                data_to_save['humidity'],
-                data_to_save['stress_state'],
-                data_to_save['timestamp']
-            ))
-            db.commit()
-            cursor.close()
-
-            socketio.emit('new_data', data_to_save)
-            print("--- Datos DHT11 almacenados ---")
-            print(f"Datos: {data_to_save}")
+            resumen_dht11 = None
+            if resumen and 'temperatura' in resumen:
+                resumen_dht11 = {'sample_count': resumen['n'],
+                                 **resumen_magnitud('temperature', *resumen['temperatura']),
+                                 **resumen_magnitud('humidity', *resumen['humedad'])}
+            guardar_dht11(node_number,
+                          node_data[node_number]['temperature'],
+                          node_data[node_number]['humidity'],
+                          node_data[node_number]['stress_state'],
+                          timestamp_str,
+                          resumen_dht11,
+                          node_data[node_number]['stress_confidence'],
+                          recepcion)
 
             node_data[node_number]['temperature'] = None
             node_data[node_number]['humidity'] = None
+            node_data[node_number]['resumen'] = None
+            node_data[node_number]['sample_time'] = None
 
         # Almacenar datos del HW080
         if node_data[node_number]['moisture'] is not None:
-            data_to_save = {
-                'node_number': node_data[node_number]['node_number'],
-                'name': node_data[node_number]['name'],
-                'moisture': node_data[node_number]['moisture'],
-                'timestamp': timestamp_str
-            }
-
-            cursor = db.cursor()
-            query = """
-                INSERT INTO hw080_data (node_number, name, moisture, estado_estres, timestamp)
-                VALUES (%s, %s, %s, %s, %s)
-            """
-            cursor.execute(query, (
-                data_to_save['node_number'],
-                data_to_save['name'],
-                data_to_save['moisture'],
-                node_data[node_number]['stress_state'] or 1,  # Usar stress_state si está disponible, de lo contrario, usar 1
-                data_to_save['timestamp']
-            ))
-            db.commit()
-            cursor.close()
-
-            socketio.emit('new_data', data_to_save)
-            print("--- Datos HW080 almacenados ---")
-            print(f"Datos: {data_to_save}")
+            resumen_hw080 = None
+            if resumen and 'humedad_suelo' in resumen:
+                resumen_hw080 = {'sample_count': resumen['n'],
+                                 **resumen_magnitud('moisture', *resumen['humedad_suelo'])}
+            # Sin estado recibido se guarda 1; un 0 (estresado) se respeta
+            stress_state = node_data[node_number]['stress_state']
+            guardar_hw080(node_number,
+                          node_data[node_number]['moisture'],
+                          stress_state if stress_state is not None else 1,
+                          timestamp_str,
+                          resumen_hw080,
+                          node_data[node_number]['stress_confidence'],
+                          recepcion)
 
             node_data[node_number]['moisture'] = None
+            node_data[node_number]['resumen'] = None
+            node_data[node_number]['sample_time'] = None
 
     except Exception as e:
         print("--- Error procesando mensaje MQTT ---")
         print(f"Error: {e}")
-        print(f"Payload que causó el error: {msg.payload}")
+        print(f"Payload que causó el error: {payload}")
 
 @app.route('/')
 def index():
     return render_template('index.html')
 
-@app.route('/api/data')
-def get_data():
-    cursor = db.cursor(dictionary=True)
-    
-    start_date = request.args.get('start_date', default=(datetime.now() - timedelta(days=1)).strftime('%Y-%m-%d %H:%M:%S'))
-    end_date = request.args.get('end_date', default=datetime.now().strftime('%Y-%m-%d %H:%M:%S'))
-    
-    query_dht11 = """
-    SELECT DISTINCT 'dht11' as sensor_type, node_number, name, temperature, humidity, estado_estres, timestamp
+def leer_fecha(texto):
+    # Acepta "YYYY-mm-dd HH:MM:SS" y el ISO de toISOString() ("...T...Z")
+    return datetime.strptime(texto[:19].replace('T', ' '), '%Y-%m-%d %H:%M:%S')
+
+def leer_nodos(texto):
+    if not texto:
+        return NODOS_PANEL
+    return tuple(int(nodo) for nodo in texto.split(',') if nodo.strip())
+
+def elegir_resolucion(cursor, inicio, fin, nodos, max_puntos):
+    if not rollups_activos:
+        return 'raw'
+
+    # Filas crudas de la serie más larga, estimadas con los agregados por hora
+    marcas = ', '.join(['%s'] * len(nodos))
+    cursor.execute(f"""
+        SELECT MAX(filas) AS filas FROM (
+            SELECT SUM(samples) AS filas FROM rollup_1h
+            WHERE bucket BETWEEN %s AND %s AND node_number IN ({marcas}) AND metric <> 'estado_estres'
+            GROUP BY sensor_type, metric, node_number
+        ) AS series
+    """, (inicio.replace(minute=0, second=0), fin, *nodos))
+    filas = cursor.fetchone()['filas']
+    if filas is None or filas <= max_puntos:
+        return 'raw'
+
+    segundos = (fin - inicio).total_seconds()
+    for nombre, segundos_cubeta, _ in ROLLUP_RESOLUCIONES:
+        if segundos / segundos_cubeta <= max_puntos:
+            return nombre
+    return ROLLUP_RESOLUCIONES[-1][0]
+
+def consultar_crudos(cursor, inicio, fin, nodos):
+    marcas = ', '.join(['%s'] * len(nodos))
+    query_dht11 = f"""
+    SELECT 'dht11' as sensor_type, node_number, name, temperature, humidity, estado_estres, timestamp
+           {columna_llegada()}
     FROM dht11_data
-    WHERE timestamp BETWEEN %s AND %s
-    AND node_number IN (1, 2, 3, 4)
+    WHERE node_number IN ({marcas})
+    AND timestamp BETWEEN %s AND %s
     ORDER BY node_number, timestamp
     """
-    
-    query_hw080 = """
-    SELECT DISTINCT 'hw080' as sensor_type, node_number, name, moisture, estado_estres, timestamp
+
+    query_hw080 = f"""
+    SELECT 'hw080' as sensor_type, node_number, name, moisture, estado_estres, timestamp
+           {columna_llegada()}
     FROM hw080_data
-    WHERE timestamp BETWEEN %s AND %s
-    AND node_number IN (1, 2, 3, 4)
+    WHERE node_number IN ({marcas})
+    AND timestamp BETWEEN %s AND %s
     ORDER BY node_number, timestamp
     """
-    
-    # Ejecutar las consultas
-    cursor.execute(query_dht11, (start_date, end_date))
+
+    cursor.execute(query_dht11, (*nodos, inicio, fin))
     dht11_data = cursor.fetchall()
-    
-    cursor.execute(query_hw080, (start_date, end_date))
+
+    cursor.execute(query_hw080, (*nodos, inicio, fin))
     hw080_data = cursor.fetchall()
-    
-    cursor.close()
-    
-    # Combinar los resultados
-    combined_data = dht11_data + hw080_data
-    
-    return jsonify(combined_data)
+
+    return dht11_data + hw080_data
+
+def nombre_nodo(cursor, tabla, node_number):
+    if node_number in node_data:
+        return node_data[node_number]['name']
+    cursor.execute(f"SELECT name FROM {tabla} WHERE node_number = %s ORDER BY timestamp DESC LIMIT 1",
+                   (node_number,))
+    fila = cursor.fetchone()
+    return fila['name'] if fila else f'Nodo {node_number}'
+
+def consultar_rollup(cursor, resolucion, inicio, fin, nodos):
+    # Una fila por magnitud y cubeta; se juntan en una por nodo y cubeta con
+    # la media en el campo de siempre y el rango en <magnitud>_min/_max
+    campos = dict((nombre, c) for nombre, _, c in ROLLUP_RESOLUCIONES)[resolucion]
+    marcas = ', '.join(['%s'] * len(nodos))
+    cursor.execute(f"""
+        SELECT sensor_type, metric, node_number, bucket, samples, value_sum, value_min, value_max
+        FROM rollup_{resolucion}
+        WHERE node_number IN ({marcas}) AND bucket BETWEEN %s AND %s
+        ORDER BY sensor_type, node_number, bucket
+    """, (*nodos, inicio.replace(**campos), fin))
+
+    puntos = {}
+    for fila in cursor.fetchall():
+        clave = (fila['sensor_type'], fila['node_number'], fila['bucket'])
+        punto = puntos.setdefault(clave, {'sensor_type': fila['sensor_type'],
+                                          'node_number': fila['node_number'],
+                                          'timestamp': fila['bucket'],
+                                          'resolution': resolucion})
+        media = fila['value_sum'] / fila['samples']
+        if fila['metric'] == 'estado_estres':
+            # Fracción de muestras sin estrés; el panel espera 0 o 1
+            punto['estado_estres'] = round(media)
+            punto['stress_ratio'] = round(media, 3)
+        else:
+            punto[fila['metric']] = round(media, 2)
+            punto[f"{fila['metric']}_min"] = fila['value_min']
+            punto[f"{fila['metric']}_max"] = fila['value_max']
+        punto['samples'] = max(punto.get('samples', 0), fila['samples'])
+
+    nombres = {}
+    for punto in puntos.values():
+        clave = (punto['sensor_type'], punto['node_number'])
+        if clave not in nombres:
+            nombres[clave] = nombre_nodo(cursor, f'{clave[0]}_data', clave[1])
+        punto['name'] = nombres[clave]
+    return list(puntos.values())
+
+@app.route('/api/data')
+def get_data():
+    # La resolución se elige para que ninguna serie pase de max_points puntos:
+    # filas crudas si caben y si no agregados por minuto, hora o día
+    try:
+        inicio = leer_fecha(request.args.get('start_date', default=formato_hora(datetime.now() - timedelta(days=1))))
+        fin = leer_fecha(request.args.get('end_date', default=formato_hora(datetime.now())))
+        max_puntos = int(request.args.get('max_points', default=DATA_MAX_PUNTOS))
+        nodos = leer_nodos(request.args.get('nodes'))
+    except ValueError:
+        return jsonify({'error': 'Invalid parameters'}), 400
+    if max_puntos <= 0 or not nodos:
+        return jsonify({'error': 'Invalid parameters'}), 400
+
+    resolucion = request.args.get('resolution')
+    # Cursor de /api/since desde el que seguir: lo escrito hasta aquí ya sale
+    # en la consulta y el resto llegará por el socket o por /api/since
+    horizonte = horizonte_llegada() if llegada_activa else None
+    with conexion_api() as conexion:
+        cursor = conexion.cursor(dictionary=True)
+        if resolucion not in ('raw', *(nombre for nombre, _, _ in ROLLUP_RESOLUCIONES)) or \
+                (resolucion != 'raw' and not rollups_activos):
+            resolucion = elegir_resolucion(cursor, inicio, fin, nodos, max_puntos)
+        if resolucion == 'raw':
+            combined_data = consultar_crudos(cursor, inicio, fin, nodos)
+        else:
+            combined_data = consultar_rollup(cursor, resolucion, inicio, fin, nodos)
+        cursor.close()
+
+    respuesta = respuesta_con_cursor(combined_data, horizonte)
+    respuesta.headers['X-Resolution'] = resolucion
+    return respuesta
 
 @app.route('/api/last_n_values')
 def get_last_n_values():
-    cursor = db.cursor(dictionary=True)
-    n = int(request.args.get('n', default=10))
-    
-    query_dht11 = """
-    SELECT DISTINCT 'dht11' as sensor_type, node_number, name, temperature, humidity, estado_estres, timestamp 
-    FROM dht11_data 
-    WHERE node_number IN (1, 2, 3, 4)
-    ORDER BY timestamp DESC
-    LIMIT %s
-    """
-    
-    query_hw080 = """
-    SELECT DISTINCT 'hw080' as sensor_type, node_number, name, moisture, estado_estres, timestamp 
-    FROM hw080_data 
-    WHERE node_number IN (1, 2, 3, 4)
-    ORDER BY timestamp DESC
-    LIMIT %s
-    """
-    
-    cursor.execute(query_dht11, (n,))
-    dht11_data = cursor.fetchall()
-    
-    cursor.execute(query_hw080, (n,))
-    hw080_data = cursor.fetchall()
-    
-    cursor.close()
-    
-    combined_data = dht11_data + hw080_data
-    
-    return jsonify(combined_data)
+    try:
+        n = int(request.args.get('n', default=10))
+        nodos = leer_nodos(request.args.get('nodes'))
+    except ValueError:
+        return jsonify({'error': 'Invalid parameters'}), 400
+    if n <= 0 or not nodos:
+        return jsonify({'error': 'Invalid parameters'}), 400
+
+    inicio = time.perf_counter()
+    horizonte = horizonte_llegada() if llegada_activa else None
+    # Las n más recientes de cada tipo están entre las n más recientes de
+    # cada nodo, así que la caché basta mientras guarde al menos n por serie
+    if cache_cargada and n <= CACHE_FILAS:
+        combined_data = []
+        with cache_lock:
+            for sensor_type in CACHE_COLUMNAS:
+                filas = [fila for nodo in nodos for fila in cache_ultimas.get((sensor_type, nodo), ())]
+                combined_data += heapq.nlargest(n, filas, key=lambda fila: fila['timestamp'])
+        registrar_consulta_cache(True, inicio)
+        return respuesta_con_cursor(combined_data, horizonte)
+
+    marcas = ', '.join(['%s'] * len(nodos))
+    combined_data = []
+    with conexion_api() as conexion:
+        cursor = conexion.cursor(dictionary=True)
+        for sensor_type, columnas in CACHE_COLUMNAS.items():
+            cursor.execute(f"""
+            SELECT '{sensor_type}' as sensor_type, node_number, name, {columnas}, estado_estres, timestamp
+                   {columna_llegada()}
+            FROM {sensor_type}_data
+            WHERE node_number IN ({marcas})
+            ORDER BY timestamp DESC
+            LIMIT %s
+            """, (*nodos, n))
+            combined_data += cursor.fetchall()
+        cursor.close()
+    registrar_consulta_cache(False, inicio)
+
+    return respuesta_con_cursor(combined_data, horizonte)
+
+def respuesta_con_cursor(filas, horizonte):
+    respuesta = jsonify(filas)
+    if horizonte is not None:
+        respuesta.headers['X-Cursor'] = str(horizonte)
+    return respuesta
+
+@app.route('/api/cache')
+def get_cache_stats():
+    with metricas_lock:
+        metricas = dict(metricas_cache)
+    with cache_lock:
+        series = len(cache_ultimas)
+        filas = sum(len(serie) for serie in cache_ultimas.values())
+    consultas = metricas['aciertos'] + metricas['fallos']
+    return jsonify({
+        'loaded': cache_cargada,
+        'series': series,
+        'rows': filas,
+        'rows_per_series': CACHE_FILAS,
+        'hits': metricas['aciertos'],
+        'misses': metricas['fallos'],
+        'hit_ratio': round(metricas['aciertos'] / consultas, 3) if consultas else None,
+        'hit_ms_avg': round(metricas['acierto_total_ms'] / metricas['aciertos'], 3) if metricas['aciertos'] else None,
+        'hit_ms_max': round(metricas['acierto_max_ms'], 3),
+        'miss_ms_avg': round(metricas['fallo_total_ms'] / metricas['fallos'], 3) if metricas['fallos'] else None,
+        'miss_ms_max': round(metricas['fallo_max_ms'], 3),
+    })
+
+@app.route('/api/since')
+def get_since():
+    # Filas con orden de llegada > since, en ese orden; se vuelve a pedir
+    # desde el cursor devuelto mientras more sea true. El orden de llegada y
+    # no timestamp, porque las muestras atrasadas llegan con horas anteriores
+    # a las ya servidas. Se espera un poco a lo ya recibido y aún sin escribir
+    # para que lo publicado durante un corte del socket no se quede atrás;
+    # si no da tiempo, more también sale a true.
+    if not llegada_activa:
+        return jsonify({'error': 'Arrival order not available (orden_llegada.sql)'}), 503
+    try:
+        desde = int(request.args['since'])
+        limite = min(int(request.args.get('limit', SINCE_MAX_FILAS)), SINCE_MAX_FILAS)
+        nodos = leer_nodos(request.args.get('nodes'))
+    except (KeyError, ValueError):
+        return jsonify({'error': 'Invalid parameters'}), 400
+    if limite <= 0 or not nodos:
+        return jsonify({'error': 'Invalid parameters'}), 400
+
+    objetivo = llegada_ultima
+    hasta = horizonte_llegada(SINCE_ESPERA_MAX)
+    marcas = ', '.join(['%s'] * len(nodos))
+    with conexion_api() as conexion:
+        cursor = conexion.cursor(dictionary=True)
+        cursor.execute(f"""
+        SELECT 'dht11' as sensor_type, node_number, name, temperature, humidity, estado_estres, timestamp,
+               arrival_id
+        FROM dht11_data
+        WHERE node_number IN ({marcas}) AND arrival_id > %s AND arrival_id <= %s
+        ORDER BY arrival_id
+        LIMIT %s
+        """, (*nodos, desde, hasta, limite))
+        filas = cursor.fetchall()
+        lleno = len(filas) == limite
+
+        cursor.execute(f"""
+        SELECT 'hw080' as sensor_type, node_number, name, moisture, estado_estres, timestamp, arrival_id
+        FROM hw080_data
+        WHERE node_number IN ({marcas}) AND arrival_id > %s AND arrival_id <= %s
+        ORDER BY arrival_id
+        LIMIT %s
+        """, (*nodos, desde, hasta, limite))
+        filas_hw080 = cursor.fetchall()
+        lleno = lleno or len(filas_hw080) == limite
+        filas += filas_hw080
+        cursor.close()
+
+    # Cada tabla trae como mucho limite filas, así que las limite primeras de
+    # la mezcla son las mismas que daría una consulta conjunta. Si alguna
+    # tabla llenó su página puede que le queden filas y el cursor se queda en
+    # la última devuelta; si no, salta al horizonte aunque las últimas fueran
+    # de otros nodos.
+    filas.sort(key=lambda fila: fila['arrival_id'])
+    filas = filas[:limite]
+    for fila in filas:
+        fila['timestamp'] = formato_hora(fila['timestamp'])
+
+    return jsonify({'rows': filas, 'cursor': filas[-1]['arrival_id'] if lleno else max(desde, hasta),
+                    'more': lleno or hasta < objetivo})
+
+@app.route('/api/enlaces')
+def get_link_stats():
+    # Estado de enlace de cada nodo según la pasarela del router de borde
+    return jsonify(sorted(link_stats.values(), key=lambda e: e['node_number'] or 0))
+
+@app.route('/api/ingesta')
+def get_ingestion_stats():
+    with metricas_lock:
+        metricas = dict(metricas_ingesta)
+        latencias = list(latencias_commit)
+    lotes = metricas['lotes']
+    return jsonify({
+        'queue_depth': cola_ingesta.qsize(),
+        'queue_depth_max': metricas.pop('profundidad_max'),
+        'queue_capacity': INGESTA_COLA_MAX,
+        'writers': sum(1 for hilo in escritores if hilo.is_alive()),
+        'enqueued': metricas['encoladas'],
+        'blocked': metricas['bloqueos'],
+        'dropped': metricas['descartadas'],
+        'written': metricas['escritas'],
+        'lost': metricas['perdidas'],
+        'errors': metricas['errores'],
+        'batches': lotes,
+        'batch_size_avg': round(metricas['escritas'] / lotes, 1) if lotes else None,
+        'batch_size_max': metricas['lote_max'],
+        'commit_ms_avg': round(metricas['commit_total_ms'] / lotes, 2) if lotes else None,
+        'commit_ms_p50': round(percentil(latencias, 50), 2) if latencias else None,
+        'commit_ms_p90': round(percentil(latencias, 90), 2) if latencias else None,
+        'commit_ms_max': round(metricas['commit_max_ms'], 2),
+    })
 
 @socketio.on('connect')
 def handle_connect():
     print("Cliente conectado")
 
+def enviar_orden_actuador(canal, accion, retardo_ms, duracion_ms):
+    with actuador_seq_lock:
+        seq = next(actuador_seq) & 0xFFFF
+    orden = ACTUADOR_ORDEN.pack(ACTUADOR_VERSION, seq, canal, accion, retardo_ms, duracion_ms)
+
+    # Se reintenta con el mismo seq: el router no repite una orden ya aplicada,
+    # solo vuelve a mandar su ack
+    with socket.socket(socket.AF_INET6, socket.SOCK_DGRAM) as sock:
+        inicio = time.monotonic()
+        for intento in range(ACTUADOR_INTENTOS):
+            sock.sendto(orden, (UDP_IP, UDP_PORT))
+            sock.settimeout(ACTUADOR_ESPERA_ACK)
+            try:
+                while True:
+                    datos, _ = sock.recvfrom(64)
+                    if len(datos) != ACTUADOR_ACK.size:
+                        continue
+                    version, seq_ack, estado, latencia_us = ACTUADOR_ACK.unpack(datos)
+                    if version == ACTUADOR_VERSION and seq_ack == seq:
+                        return {'seq': seq, 'status': ACTUADOR_ESTADOS.get(estado, estado),
+                                'router_latency_us': latencia_us,
+                                'round_trip_ms': round((time.monotonic() - inicio) * 1000, 1),
+                                'attempts': intento + 1}
+            except socket.timeout:
+                continue
+    return None
+
 @app.route('/actuator', methods=['POST'])
 def control_actuator():
-    data = request.json
+    data = request.json or {}
     action = data.get('action')
+    try:
+        channel = int(data.get('channel', 0))
+        delay_ms = int(data.get('delay_ms', 0))
+        duration_ms = int(data.get('duration_ms', 0))
+    except (TypeError, ValueError):
+        return jsonify({'error': 'Invalid parameters'}), 400
 
-    if action not in ['ON', 'OFF']:
+    if action not in ACTUADOR_ACCIONES:
         return jsonify({'error': 'Invalid action'}), 400
+    if not 0 <= channel < ACTUADOR_CANALES or not 0 <= delay_ms < 2**32 or not 0 <= duration_ms < 2**32:
+        return jsonify({'error': 'Invalid parameters'}), 400
 
-    # Enviar el comando UDP al ESP32
-    with socket.socket(socket.AF_INET6, socket.SOCK_DGRAM) as sock:
-        sock.sendto(action.encode(), (UDP_IP, UDP_PORT))
-        print(f"Sent {action} to ESP32")
+    ack = enviar_orden_actuador(channel, ACTUADOR_ACCIONES[action], delay_ms, duration_ms)
+    if ack is None:
+        print(f"Sin respuesta del router a {action} en el canal {channel}")
+        return jsonify({'error': 'No acknowledgement from router'}), 504
+    print(f"Orden {action} canal {channel}: {ack}")
+
+    if ack['status'] not in ('applied', 'scheduled'):
+        return jsonify({'error': f"Command rejected: {ack['status']}", 'ack': ack}), 409
+    return jsonify({'message': f'Actuator turned {action}', 'ack': ack}), 200
+
+# Parámetros de la política de reporte que acepta cada nodo
+CLAVES_POLITICA = {'activa', 'banda_temp', 'banda_hum', 'banda_suelo',
+                   'latido', 'intervalo', 'intervalo_min', 'intervalo_max'}
+
+@app.route('/api/nodos/<int:node_number>/config', methods=['POST'])
+def configurar_nodo(node_number):
+    data = request.json or {}
+    invalidas = [clave for clave in data if clave not in CLAVES_POLITICA]
+    if not data or invalidas:
+        return jsonify({'error': 'Invalid keys', 'keys': invalidas}), 400
+    if mqtt_client is None:
+        return jsonify({'error': 'MQTT client not connected'}), 503
+
+    # Los nodos reciben pares "clave=valor" separados por espacios
+    payload = ' '.join(f'{clave}={valor}' for clave, valor in data.items())
+    topic = f'control/nodo_{node_number}/config'
+    mqtt_client.publish(topic, payload)
+    print(f"Configuración enviada a {topic}: {payload}")
+
+    return jsonify({'message': f'Config sent to node {node_number}', 'payload': payload}), 200
 
-    return jsonify({'message': f'Actuator turned {action}'}), 200
+mqtt_client = None
 
 def start_mqtt_client():
+    global mqtt_client
     client = mqtt.Client()
     client.on_connect = on_connect
     client.on_message = on_message
@@ -252,10 +1223,18 @@ def start_mqtt_client():
     try:
         client.connect(MQTT_BROKER, MQTT_PORT, 60)
         client.loop_start()
+        mqtt_client = client
         print(f"Cliente MQTT iniciado y conectado a {MQTT_BROKER}:{MQTT_PORT}")
     except Exception as e:
         print(f"Error conectando al broker MQTT: {e}")
 
 if __name__ == '__main__':
+    comprobar_llegada()
+    cargar_cache()
+    iniciar_ingesta()
+    atexit.register(detener_ingesta)
     start_mqtt_client()
-    socketio.run(app, host='0.0.0.0', port=5000, debug=True)
+    # Sin el recargador de Werkzeug: repetiría este bloque en un segundo
+    # proceso con su propio contador de llegada (números duplicados) y otro
+    # cliente MQTT
+    socketio.run(app, host='0.0.0.0', port=5000, debug=True, use_reloader=False)
@@ -0,0 +1,9 @@
+-- Confianza de "sin estrés" (%) que los nodos reciben de la XIAO por UART.
+-- estado_estres se sigue guardando, derivado de ella (>= 50 -> 1).
+USE proyecto_iot;
+
+ALTER TABLE dht11_data
+    ADD COLUMN stress_confidence FLOAT NULL;
+
+ALTER TABLE hw080_data
+    ADD COLUMN stress_confidence FLOAT NULL;
@@ -0,0 +1,11 @@
+-- Hora de llegada de las muestras que el nodo marca con su propia hora
+-- (sincronizada con el router de borde). timestamp es entonces el instante de
+-- la lectura; received_at, cuándo llegó al servidor o a la pasarela.
+-- Queda a NULL en las muestras sin hora del nodo.
+USE proyecto_iot;
+
+ALTER TABLE dht11_data
+    ADD COLUMN received_at DATETIME NULL;
+
+ALTER TABLE hw080_data
+    ADD COLUMN received_at DATETIME NULL;
@@ -0,0 +1,14 @@
+-- Orden de llegada de las filas, para que /api/since pagine por él y no por
+-- timestamp: las muestras con hora del nodo que llegan tarde (cola del nodo,
+-- lotes de la pasarela) tienen horas anteriores a las ya servidas. app.py
+-- numera cada fila al recibirla con un contador común a las dos tablas y solo
+-- usa la columna si existe. Las filas anteriores quedan a NULL.
+USE proyecto_iot;
+
+ALTER TABLE dht11_data
+    ADD COLUMN arrival_id BIGINT UNSIGNED NULL,
+    ADD INDEX idx_dht11_llegada (arrival_id);
+
+ALTER TABLE hw080_data
+    ADD COLUMN arrival_id BIGINT UNSIGNED NULL,
+    ADD INDEX idx_hw080_llegada (arrival_id);
@@ -0,0 +1,67 @@
+-- Índices para las consultas por nodo y rango de tiempo, y tablas de
+-- agregados por minuto, hora y día que /api/data usa para rangos largos.
+-- app.py las mantiene al insertar (una fila por cubeta, nodo y magnitud) y
+-- solo las usa si existen. Al final se rellenan con los datos ya guardados
+-- (el relleno usa las columnas de agregados.sql).
+USE proyecto_iot;
+
+CREATE INDEX idx_dht11_nodo_tiempo ON dht11_data (node_number, timestamp);
+CREATE INDEX idx_dht11_tiempo ON dht11_data (timestamp);
+CREATE INDEX idx_hw080_nodo_tiempo ON hw080_data (node_number, timestamp);
+CREATE INDEX idx_hw080_tiempo ON hw080_data (timestamp);
+
+-- samples cuenta filas; la media es value_sum / samples. Con resúmenes por
+-- ventana (agregados.sql) el mínimo y el máximo son los de la ventana.
+CREATE TABLE rollup_1m (
+    sensor_type VARCHAR(8) NOT NULL,
+    metric VARCHAR(16) NOT NULL,
+    node_number INT NOT NULL,
+    bucket DATETIME NOT NULL,
+    samples INT UNSIGNED NOT NULL,
+    value_sum DOUBLE NOT NULL,
+    value_min FLOAT NOT NULL,
+    value_max FLOAT NOT NULL,
+    PRIMARY KEY (sensor_type, metric, node_number, bucket),
+    KEY idx_rollup_1m_bucket (bucket)
+);
+
+CREATE TABLE rollup_1h LIKE rollup_1m;
+CREATE TABLE rollup_1d LIKE rollup_1m;
+
+-- Datos anteriores: el minuto desde las tablas crudas, la hora y el día desde el minuto
+INSERT INTO rollup_1m (sensor_type, metric, node_number, bucket, samples, value_sum, value_min, value_max)
+SELECT sensor_type, metric, node_number, DATE_FORMAT(timestamp, '%Y-%m-%d %H:%i:00'),
+       COUNT(*), SUM(valor), MIN(minimo), MAX(maximo)
+FROM (
+    SELECT 'dht11' AS sensor_type, 'temperature' AS metric, node_number, timestamp,
+           temperature AS valor, COALESCE(temperature_min, temperature) AS minimo,
+           COALESCE(temperature_max, temperature) AS maximo
+    FROM dht11_data WHERE temperature IS NOT NULL
+    UNION ALL
+    SELECT 'dht11', 'humidity', node_number, timestamp, humidity,
+           COALESCE(humidity_min, humidity), COALESCE(humidity_max, humidity)
+    FROM dht11_data WHERE humidity IS NOT NULL
+    UNION ALL
+    SELECT 'dht11', 'estado_estres', node_number, timestamp, estado_estres, estado_estres, estado_estres
+    FROM dht11_data WHERE estado_estres IS NOT NULL
+    UNION ALL
+    SELECT 'hw080', 'moisture', node_number, timestamp, moisture,
+           COALESCE(moisture_min, moisture), COALESCE(moisture_max, moisture)
+    FROM hw080_data WHERE moisture IS NOT NULL
+    UNION ALL
+    SELECT 'hw080', 'estado_estres', node_number, timestamp, estado_estres, estado_estres, estado_estres
+    FROM hw080_data WHERE estado_estres IS NOT NULL
+) AS crudos
+GROUP BY sensor_type, metric, node_number, DATE_FORMAT(timestamp, '%Y-%m-%d %H:%i:00');
+
+INSERT INTO rollup_1h (sensor_type, metric, node_number, bucket, samples, value_sum, value_min, value_max)
+SELECT sensor_type, metric, node_number, DATE_FORMAT(bucket, '%Y-%m-%d %H:00:00'),
+       SUM(samples), SUM(value_sum), MIN(value_min), MAX(value_max)
+FROM rollup_1m
+GROUP BY sensor_type, metric, node_number, DATE_FORMAT(bucket, '%Y-%m-%d %H:00:00');
+
+INSERT INTO rollup_1d (sensor_type, metric, node_number, bucket, samples, value_sum, value_min, value_max)
+SELECT sensor_type, metric, node_number, DATE(bucket),
+       SUM(samples), SUM(value_sum), MIN(value_min), MAX(value_max)
+FROM rollup_1h
+GROUP BY sensor_type, metric, node_number, DATE(bucket);
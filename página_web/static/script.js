@@ -3,6 +3,16 @@ let dateRange
 let socket
 const latestData = { dht11: {}, hw080: {}, stress: {} }
 let activeNodes = [1, 2, 3, 4]
+// Puntos máximos por serie en /api/data; con rangos largos el servidor
+// devuelve medias por minuto, hora o día en lugar de las lecturas
+const MAX_CHART_POINTS = 500
+// Resolución de los datos en pantalla; los puntos en vivo solo se añaden a
+// gráficas de lecturas sueltas
+let currentResolution = "raw"
+// Orden de llegada hasta el que se tiene todo (cabecera X-Cursor, arrival_id
+// de las lecturas y cursor de /api/since), para pedir a /api/since lo que falte
+let lastCursor = null
+const nodeStatus = {}
 
 const nodeInfo = {
   1: { name: "Jordan Manguay", mac: "08:A6:F7:BC:F7:F1", ipv6: "2001:db8::aa6:f7ff:febc:f7f1" },
@@ -76,11 +86,10 @@ function createNodeFilter() {
 function initSocket() {
   socket = io()
   socket.on("new_data", (data) => {
-    updateDataList([data])
     updateChartsWithNewData(data)
-    updateNodeMap(data)
-    updateNodeInfo(data)
   })
+  // Tras una reconexión se recupera lo publicado mientras tanto
+  socket.on("connect", fetchSince)
 }
 
 function toggleRealTimeMode() {
@@ -95,20 +104,14 @@ function toggleRealTimeMode() {
   }
 }
 
-let realTimeInterval
-
+// Las lecturas nuevas llegan por el socket, así que basta con la carga inicial
 function startRealTimeUpdates() {
   const n = document.getElementById("n-values").value
   fetchLastNValues(n)
-  realTimeInterval = setInterval(() => {
-    fetchLastNValues(n)
-  }, 5000) // Actualizar cada 5 segundos
 }
 
 function stopRealTimeUpdates() {
-  if (realTimeInterval) {
-    clearInterval(realTimeInterval)
-  }
+  fetchInitialData()
 }
 
 function fetchInitialData() {
@@ -117,37 +120,99 @@ function fetchInitialData() {
 }
 
 function fetchData(start, end) {
-  const url = `/api/data?start_date=${start.toISOString()}&end_date=${end.toISOString()}`
+  const url = `/api/data?start_date=${start.toISOString()}&end_date=${end.toISOString()}&max_points=${MAX_CHART_POINTS}`
 
   fetch(url)
-    .then((response) => response.json())
-    .then((data) => {
-      const processedData = processData(data)
-      updateDHT11Charts(processedData.dht11)
-      updateHW080Charts(processedData.hw080)
-      updateStressChart(processedData.stress)
-      updateDataList(data)
-      updateNodeMap(data)
-      updateNodeInfo(data)
-    })
+    .then((response) =>
+      response.json().then((data) => renderData(data, response.headers.get("X-Resolution"), response.headers.get("X-Cursor"))),
+    )
 }
 
 function fetchLastNValues(n) {
   const url = `/api/last_n_values?n=${n}`
 
   fetch(url)
-    .then((response) => response.json())
-    .then((data) => {
-      const processedData = processData(data)
-      updateDHT11Charts(processedData.dht11)
-      updateHW080Charts(processedData.hw080)
-      updateStressChart(processedData.stress)
-      updateDataList(data)
-      updateNodeMap(data)
-      updateNodeInfo(data)
+    .then((response) => response.json().then((data) => renderData(data, "raw", response.headers.get("X-Cursor"))))
+}
+
+function fetchSince() {
+  if (lastCursor === null || activeNodes.length === 0) return
+  const url = `/api/since?since=${lastCursor}&nodes=${activeNodes.join(",")}`
+
+  fetch(url)
+    .then((response) => (response.ok ? response.json() : null))
+    .then((result) => {
+      if (!result) return
+      result.rows.forEach(updateChartsWithNewData)
+      advanceCursor(result.cursor)
+      // Página llena o filas que el servidor aún no había escrito; este
+      // espera un poco antes de responder, así que no se pide en bucle
+      if (result.more) {
+        fetchSince()
+      }
     })
 }
 
+// Carga completa: reconstruye las gráficas y reinicia las series en memoria.
+// Después se pide a /api/since lo llegado desde la consulta, que puede no
+// estar en ella ni haberse aplicado por el socket antes de reconstruir.
+function renderData(data, resolution, cursor) {
+  currentResolution = resolution || "raw"
+  const processedData = processData(data)
+  const limit = seriesLimit()
+  for (const type of ["dht11", "hw080", "stress"]) {
+    Object.values(processedData[type]).forEach((series) => {
+      series.sort((a, b) => parseTimestamp(a.timestamp) - parseTimestamp(b.timestamp))
+      series.splice(0, Math.max(0, series.length - limit))
+    })
+    latestData[type] = processedData[type]
+  }
+  lastCursor = cursor === null ? null : Number(cursor)
+
+  updateDHT11Charts(latestData.dht11)
+  updateHW080Charts(latestData.hw080)
+  updateStressChart(latestData.stress)
+  updateDataList(data)
+  updateNodeMap(data)
+  updateNodeInfo(data)
+  fetchSince()
+}
+
+function seriesLimit() {
+  if (document.getElementById("show-last-n").checked) {
+    return Math.max(1, Number.parseInt(document.getElementById("n-values").value) || 1)
+  }
+  return MAX_CHART_POINTS
+}
+
+// Solo avanza si hay un cursor: sin él (falta orden_llegada.sql) no se usa
+// /api/since
+function advanceCursor(arrivalId) {
+  if (lastCursor !== null && arrivalId !== null && arrivalId !== undefined && arrivalId > lastCursor) {
+    lastCursor = arrivalId
+  }
+}
+
+// Posición de una lectura en una serie ordenada por hora. Las atrasadas
+// (cola del nodo, lotes de la pasarela) van en su sitio y no al final.
+function insertionIndex(series, item) {
+  const time = parseTimestamp(item.timestamp).getTime()
+  let index = series.length
+  while (index > 0 && parseTimestamp(series[index - 1].timestamp).getTime() > time) {
+    index--
+  }
+  return index
+}
+
+// Inserta en index y descarta lo más antiguo por encima del límite (la propia
+// lectura, si es más antigua que todas con la serie llena)
+function insertBounded(array, index, item, limit) {
+  array.splice(index, 0, item)
+  if (array.length > limit) {
+    array.splice(0, array.length - limit)
+  }
+}
+
 function updateCharts() {
   const showLastN = document.getElementById("show-last-n").checked
   if (showLastN) {
@@ -165,28 +230,58 @@ function updateLastNValues() {
   }
 }
 
+// Una lectura nueva (del socket o de /api/since): se añade a las gráficas
+// existentes sin recrearlas
 function updateChartsWithNewData(newData) {
-  if (newData.sensor_type === "dht11") {
-    if (!latestData.dht11[newData.node_number]) {
-      latestData.dht11[newData.node_number] = []
-    }
-    latestData.dht11[newData.node_number].push(newData)
-    updateDHT11Charts(latestData.dht11)
-  } else if (newData.sensor_type === "hw080") {
-    if (!latestData.hw080[newData.node_number]) {
-      latestData.hw080[newData.node_number] = []
-    }
-    latestData.hw080[newData.node_number].push(newData)
-    updateHW080Charts(latestData.hw080)
+  const node = newData.node_number
+  if (!activeNodes.includes(node) || !latestData[newData.sensor_type]) return
+
+  if (!latestData[newData.sensor_type][node]) {
+    latestData[newData.sensor_type][node] = []
   }
-  // Add stress data update
-  if (!latestData.stress[newData.node_number]) {
-    latestData.stress[newData.node_number] = []
+  if (!latestData.stress[node]) {
+    latestData.stress[node] = []
   }
-  latestData.stress[newData.node_number].push(newData)
-  updateStressChart(latestData.stress)
+  const series = latestData[newData.sensor_type][node]
+  // La misma fila puede llegar por el socket y por /api/since; lecturas
+  // distintas del mismo segundo se guardan todas
+  const arrivalId = newData.arrival_id
+  if (arrivalId !== null && arrivalId !== undefined && series.some((item) => item.arrival_id === arrivalId)) return
+  advanceCursor(arrivalId)
+  updateDataList([newData])
   updateNodeMap(newData)
   updateNodeInfo(newData)
+  if (currentResolution !== "raw") return
+
+  const limit = seriesLimit()
+  // Las gráficas del tipo tienen un punto por lectura de la serie, así que
+  // la posición sirve para las dos
+  const index = insertionIndex(series, newData)
+  insertBounded(series, index, newData, limit)
+  const stressSeries = latestData.stress[node]
+  insertBounded(stressSeries, insertionIndex(stressSeries, newData), newData, limit)
+
+  const label = formatTimestamp(newData.timestamp)
+  if (newData.sensor_type === "dht11") {
+    const inserted =
+      insertIntoChart(`dht11-temp-${node}`, index, label, Number.parseFloat(newData.temperature), limit) &&
+      insertIntoChart(`dht11-humidity-${node}`, index, label, Number.parseFloat(newData.humidity), limit)
+    if (!inserted) updateDHT11Charts(latestData.dht11)
+  } else {
+    if (!insertIntoChart(`hw080-moisture-${node}`, index, label, Number.parseFloat(newData.moisture), limit)) {
+      updateHW080Charts(latestData.hw080)
+    }
+  }
+  updateStressChart(latestData.stress)
+}
+
+function insertIntoChart(chartId, index, label, value, limit) {
+  const chart = charts[chartId]
+  if (!chart) return false
+  insertBounded(chart.data.labels, index, label, limit)
+  insertBounded(chart.data.datasets[0].data, index, value, limit)
+  chart.update("none")
+  return true
 }
 
 function processData(data) {
@@ -194,7 +289,12 @@ function processData(data) {
   const seenTimestamps = new Set()
 
   data.forEach((item) => {
-    const key = `${item.node_number}-${item.timestamp}`
+    // Sin orden de llegada (agregados, o falta orden_llegada.sql) la clave
+    // es el nodo y la hora
+    const key =
+      item.arrival_id !== null && item.arrival_id !== undefined
+        ? `${item.sensor_type}-${item.arrival_id}`
+        : `${item.node_number}-${item.timestamp}`
     if (!seenTimestamps.has(key)) {
       seenTimestamps.add(key)
       if (item.sensor_type === "dht11") {
@@ -219,8 +319,17 @@ function processData(data) {
   return processedData
 }
 
+// Las horas de la base no llevan zona; las del socket ("YYYY-MM-DD HH:MM:SS")
+// se leen como UTC igual que las que Flask serializa con "GMT"
+function parseTimestamp(timestamp) {
+  if (typeof timestamp === "string" && /^\d{4}-\d{2}-\d{2} \d{2}:\d{2}:\d{2}$/.test(timestamp)) {
+    return new Date(`${timestamp.replace(" ", "T")}Z`)
+  }
+  return new Date(timestamp)
+}
+
 function formatTimestamp(timestamp) {
-  const date = new Date(timestamp)
+  const date = parseTimestamp(timestamp)
   return date.toLocaleString("es-ES", {
     year: "numeric",
     month: "2-digit",
@@ -502,12 +611,15 @@ function updateDataList(data) {
 
 function updateStressChart(data) {
   const stressData = calculateStressData(data)
-  const ctx = document.getElementById("stress-pie-chart").getContext("2d")
-
-  if (charts["stress-pie-chart"]) {
-    charts["stress-pie-chart"].destroy()
+  const chart = charts["stress-pie-chart"]
+  if (chart) {
+    chart.data.datasets[0].data = [stressData.withoutStress, stressData.withStress]
+    chart.update("none")
+    return
   }
 
+  const ctx = document.getElementById("stress-pie-chart").getContext("2d")
+
   charts["stress-pie-chart"] = new Chart(ctx, {
     type: "pie",
     data: {
@@ -606,26 +718,33 @@ function hideTooltip() {
   }
 }
 
+// La tabla se crea una vez; después solo cambia el estado del nodo que
+// tenga una lectura más reciente
 function updateNodeInfo(data) {
   const nodeInfoBody = document.getElementById("node-info-body")
-  nodeInfoBody.innerHTML = ""
-
-  for (let i = 1; i <= 4; i++) {
-    const nodeData = Array.isArray(data)
-      ? data.find((item) => item.node_number === i)
-      : data.node_number === i
-        ? data
-        : null
-    const row = document.createElement("tr")
-    row.innerHTML = `
+  if (nodeInfoBody.children.length === 0) {
+    for (let i = 1; i <= 4; i++) {
+      const row = document.createElement("tr")
+      row.innerHTML = `
             <td>${i}</td>
             <td>${nodeInfo[i].name}</td>
-            <td>${nodeData ? (nodeData.estado_estres === 0 ? "Con estrés" : "Sin estrés") : "N/A"}</td>
+            <td id="node-status-${i}">N/A</td>
             <td>${nodeInfo[i].mac}</td>
             <td>${nodeInfo[i].ipv6}</td>
         `
-    nodeInfoBody.appendChild(row)
+      nodeInfoBody.appendChild(row)
+    }
   }
+
+  const items = Array.isArray(data) ? data : [data]
+  items.forEach((item) => {
+    const cell = document.getElementById(`node-status-${item.node_number}`)
+    const time = parseTimestamp(item.timestamp)
+    const previous = nodeStatus[item.node_number]
+    if (!cell || (previous && previous > time)) return
+    nodeStatus[item.node_number] = time
+    cell.textContent = item.estado_estres === 0 ? "Con estrés" : "Sin estrés"
+  })
 }
 
 function toggleNodeInfoTable() {
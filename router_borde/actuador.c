@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "msg.h"
+#include "mutex.h"
+#include "thread.h"
+#include "ztimer.h"
+#include "periph/gpio.h"
+#include "ws281x.h"
+
+#include "actuador.h"
+
+#define ACTUADOR_PRIO           (THREAD_PRIORITY_MAIN)
+#define SIN_ESPERA              (UINT32_MAX)
+
+typedef struct {
+    bool ocupada;
+    bool con_ack;
+    uint16_t seq;
+    uint8_t canal;
+    uint8_t accion;
+    uint32_t retardo_ms;
+    uint32_t duracion_ms;
+    uint32_t recibida_us;
+    sock_udp_t *sock;
+    sock_udp_ep_t remoto;
+} orden_t;
+
+typedef struct {
+    bool activa;
+    bool con_latencia;          // Orden diferida: anota su latencia al aplicarse
+    uint8_t canal;
+    uint8_t accion;             // CONMUTAR se resuelve al vencer, con el estado de entonces
+    uint32_t duracion_ms;       // Al aplicarla, volver al estado previo tras este tiempo
+    uint32_t vence_ms;
+    uint32_t prevista_us;       // Recepción más el retardo pedido (ZTIMER_USEC)
+} programada_t;
+
+typedef struct {
+    sock_udp_ep_t remoto;
+    uint16_t seq;
+    bool valida;
+    bool respondida;
+    uint8_t ack[ACTUADOR_TAM_ACK];
+} reciente_t;
+
+// LED RGB (canal 0)
+static ws281x_t led_strip;
+static uint8_t led_strip_buf[WS281X_BYTES_PER_DEVICE * WS281X_PARAM_NUMOF];
+static ws281x_params_t led_params = {
+    .buf = led_strip_buf,
+    .numof = 1,
+    .pin = GPIO48
+};
+
+static const gpio_t salidas[ACTUADOR_NUM_CANALES - 1] = { ACTUADOR_GPIO_1, ACTUADOR_GPIO_2 };
+
+static char pila_actuador[THREAD_STACKSIZE_DEFAULT];
+static msg_t cola_actuador[ACTUADOR_COLA];
+static kernel_pid_t pid_actuador = KERNEL_PID_UNDEF;
+
+// Compartido entre la recepción, el shell y el hilo actuador
+static mutex_t lock = MUTEX_INIT;
+static orden_t ordenes[ACTUADOR_COLA];
+static unsigned en_cola = 0;
+static reciente_t recientes[ACTUADOR_RECIENTES];
+static unsigned siguiente_reciente = 0;
+static actuador_stats_t stats;
+static uint64_t suma_latencias_us = 0;
+
+// Solo los usa el hilo actuador
+static programada_t programadas[ACTUADOR_PROGRAMADAS];
+
+static uint8_t *escribir_u32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+static uint32_t leer_u32(const uint8_t *p) {
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool canal_valido(uint8_t canal) {
+    if (canal == ACTUADOR_CANAL_LED) {
+        return true;
+    }
+    return canal < ACTUADOR_NUM_CANALES && salidas[canal - 1] != GPIO_UNDEF;
+}
+
+static bool mismo_origen(const sock_udp_ep_t *a, const sock_udp_ep_t *b) {
+    return a->port == b->port && memcmp(&a->addr.ipv6, &b->addr.ipv6, sizeof(a->addr.ipv6)) == 0;
+}
+
+// --- Respuestas -------------------------------------------------------------
+
+static void enviar_ack(sock_udp_t *sock, const sock_udp_ep_t *remoto, uint16_t seq,
+                       uint8_t estado, uint32_t latencia_us) {
+    uint8_t ack[ACTUADOR_TAM_ACK];
+    ack[0] = ACTUADOR_VERSION;
+    ack[1] = seq & 0xFF;
+    ack[2] = seq >> 8;
+    ack[3] = estado;
+    escribir_u32(&ack[4], latencia_us);
+
+    // Se guarda para repetirlo si el origen reenvía la misma orden
+    mutex_lock(&lock);
+    for (unsigned i = 0; i < ACTUADOR_RECIENTES; i++) {
+        if (recientes[i].valida && recientes[i].seq == seq &&
+            mismo_origen(&recientes[i].remoto, remoto)) {
+            memcpy(recientes[i].ack, ack, sizeof(ack));
+            recientes[i].respondida = true;
+            break;
+        }
+    }
+    mutex_unlock(&lock);
+
+    sock_udp_send(sock, ack, sizeof(ack), remoto);
+}
+
+// desde_us es la recepción o, en una orden diferida, la recepción más el
+// retardo pedido: la espera deliberada no cuenta como latencia
+static void anotar_latencia(uint32_t desde_us) {
+    uint32_t latencia = ztimer_now(ZTIMER_USEC) - desde_us;
+
+    mutex_lock(&lock);
+    stats.aplicadas++;
+    stats.latencia_ultima_us = latencia;
+    if (latencia > stats.latencia_max_us) {
+        stats.latencia_max_us = latencia;
+    }
+    suma_latencias_us += latencia;
+    stats.latencia_media_us = suma_latencias_us / stats.aplicadas;
+    mutex_unlock(&lock);
+}
+
+// --- Hilo actuador ----------------------------------------------------------
+
+static void aplicar(uint8_t canal, bool encender) {
+    if (canal == ACTUADOR_CANAL_LED) {
+        // ws281x_write() desactiva las interrupciones mientras envía los bits;
+        // por eso se hace aquí y no en el hilo que recibe los paquetes
+        color_rgb_t color = { 0, 0, 0 };
+        if (encender) {
+            color = (color_rgb_t){ 0, 168, 243 };
+        }
+        ws281x_set(&led_strip, 0, color);
+        ws281x_prepare_transmission(&led_strip);
+        ws281x_write(&led_strip);
+    } else {
+        gpio_write(salidas[canal - 1], encender);
+    }
+
+    mutex_lock(&lock);
+    stats.encendido[canal] = encender;
+    mutex_unlock(&lock);
+    printf("Actuador %u %s\n", canal, encender ? "encendido" : "apagado");
+}
+
+static bool programar(const programada_t *accion) {
+    for (unsigned i = 0; i < ACTUADOR_PROGRAMADAS; i++) {
+        if (!programadas[i].activa) {
+            programadas[i] = *accion;
+            programadas[i].activa = true;
+            return true;
+        }
+    }
+    puts("Actuador: no quedan huecos para acciones programadas");
+    return false;
+}
+
+// Aplica una acción y, si tiene duración, programa la vuelta al estado previo
+static bool ejecutar(uint8_t canal, uint8_t accion, uint32_t duracion_ms) {
+    mutex_lock(&lock);
+    bool previo = stats.encendido[canal];
+    mutex_unlock(&lock);
+
+    aplicar(canal, accion == ACTUADOR_CONMUTAR ? !previo : accion == ACTUADOR_ENCENDER);
+    if (duracion_ms > 0) {
+        programada_t vuelta = {
+            .canal = canal,
+            .accion = previo ? ACTUADOR_ENCENDER : ACTUADOR_APAGAR,
+            .vence_ms = ztimer_now(ZTIMER_MSEC) + duracion_ms,
+        };
+        return programar(&vuelta);
+    }
+    return true;
+}
+
+static uint32_t ejecutar_vencidas(void) {
+    uint32_t espera = SIN_ESPERA;
+
+    for (unsigned i = 0; i < ACTUADOR_PROGRAMADAS; i++) {
+        programada_t *p = &programadas[i];
+        if (!p->activa) {
+            continue;
+        }
+        int32_t falta = (int32_t)(p->vence_ms - ztimer_now(ZTIMER_MSEC));
+        if (falta <= 0) {
+            // Copia: la vuelta atrás que programe ejecutar() puede ocupar este hueco
+            programada_t vencida = *p;
+            p->activa = false;
+            ejecutar(vencida.canal, vencida.accion, vencida.duracion_ms);
+            if (vencida.con_latencia) {
+                anotar_latencia(vencida.prevista_us);
+            }
+            // Pudo ocupar un hueco anterior; se recalcula la espera desde el principio
+            return 0;
+        }
+        if ((uint32_t)falta < espera) {
+            espera = falta;
+        }
+    }
+    return espera;
+}
+
+static void atender(orden_t *orden) {
+    uint8_t estado;
+    if (orden->retardo_ms > 0) {
+        // El estado se decide al vencer: lo que pase entretanto cuenta para CONMUTAR
+        programada_t diferida = {
+            .con_latencia = true,
+            .canal = orden->canal,
+            .accion = orden->accion,
+            .duracion_ms = orden->duracion_ms,
+            .vence_ms = ztimer_now(ZTIMER_MSEC) + orden->retardo_ms,
+            .prevista_us = orden->recibida_us + orden->retardo_ms * US_PER_MS,
+        };
+        estado = programar(&diferida) ? ACTUADOR_PROGRAMADA : ACTUADOR_OCUPADO;
+    } else {
+        // La vuelta atrás de una orden temporizada puede no caber, pero la
+        // orden en sí ya está aplicada
+        ejecutar(orden->canal, orden->accion, orden->duracion_ms);
+        estado = ACTUADOR_APLICADA;
+        anotar_latencia(orden->recibida_us);
+    }
+
+    if (orden->con_ack) {
+        uint32_t latencia = ztimer_now(ZTIMER_USEC) - orden->recibida_us;
+        enviar_ack(orden->sock, &orden->remoto, orden->seq, estado, latencia);
+    }
+}
+
+static void *hilo_actuador(void *arg) {
+    (void)arg;
+    msg_init_queue(cola_actuador, ACTUADOR_COLA);
+
+    while (1) {
+        uint32_t espera;
+        while ((espera = ejecutar_vencidas()) == 0) {}
+
+        msg_t msg;
+        int res = (espera == SIN_ESPERA) ? msg_receive(&msg)
+                                         : ztimer_msg_receive_timeout(ZTIMER_MSEC, &msg, espera);
+        if (res < 0) {
+            continue;
+        }
+
+        orden_t *orden = &ordenes[msg.content.value];
+        atender(orden);
+
+        mutex_lock(&lock);
+        orden->ocupada = false;
+        en_cola--;
+        mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+// --- Recepción --------------------------------------------------------------
+
+static int encolar(const orden_t *orden) {
+    mutex_lock(&lock);
+    unsigned i;
+    for (i = 0; i < ACTUADOR_COLA && ordenes[i].ocupada; i++) {}
+    if (i == ACTUADOR_COLA) {
+        mutex_unlock(&lock);
+        return -1;
+    }
+    ordenes[i] = *orden;
+    ordenes[i].ocupada = true;
+    en_cola++;
+    if (en_cola > stats.cola_max) {
+        stats.cola_max = en_cola;
+    }
+    mutex_unlock(&lock);
+
+    msg_t msg = { .content.value = i };
+    if (msg_try_send(&msg, pid_actuador) != 1) {
+        mutex_lock(&lock);
+        ordenes[i].ocupada = false;
+        en_cola--;
+        mutex_unlock(&lock);
+        return -1;
+    }
+    return 0;
+}
+
+// Devuelve true si la orden ya se recibió antes (y repite su ack si lo hay)
+static bool repetida(sock_udp_t *sock, const sock_udp_ep_t *remoto, uint16_t seq) {
+    mutex_lock(&lock);
+    for (unsigned i = 0; i < ACTUADOR_RECIENTES; i++) {
+        reciente_t *r = &recientes[i];
+        if (r->valida && r->seq == seq && mismo_origen(&r->remoto, remoto)) {
+            stats.repetidas++;
+            bool respondida = r->respondida;
+            uint8_t ack[ACTUADOR_TAM_ACK];
+            memcpy(ack, r->ack, sizeof(ack));
+            mutex_unlock(&lock);
+            if (respondida) {
+                sock_udp_send(sock, ack, sizeof(ack), remoto);
+            }
+            return true;
+        }
+    }
+
+    reciente_t *r = &recientes[siguiente_reciente];
+    siguiente_reciente = (siguiente_reciente + 1) % ACTUADOR_RECIENTES;
+    r->remoto = *remoto;
+    r->seq = seq;
+    r->valida = true;
+    r->respondida = false;
+    mutex_unlock(&lock);
+    return false;
+}
+
+// Una orden que no se pudo encolar debe poder reintentarse con el mismo seq
+static void olvidar(const sock_udp_ep_t *remoto, uint16_t seq) {
+    mutex_lock(&lock);
+    for (unsigned i = 0; i < ACTUADOR_RECIENTES; i++) {
+        if (recientes[i].valida && recientes[i].seq == seq &&
+            mismo_origen(&recientes[i].remoto, remoto)) {
+            recientes[i].valida = false;
+        }
+    }
+    mutex_unlock(&lock);
+}
+
+static void rechazar(sock_udp_t *sock, const sock_udp_ep_t *remoto, uint16_t seq,
+                     uint8_t estado, uint32_t recibido_us) {
+    mutex_lock(&lock);
+    stats.rechazadas++;
+    mutex_unlock(&lock);
+    enviar_ack(sock, remoto, seq, estado, ztimer_now(ZTIMER_USEC) - recibido_us);
+}
+
+void actuador_recibir(sock_udp_t *sock, const sock_udp_ep_t *remoto,
+                      const uint8_t *buf, size_t len, uint32_t recibido_us) {
+    // Órdenes de texto de la versión anterior
+    if ((len == 2 && memcmp(buf, "ON", 2) == 0) || (len == 3 && memcmp(buf, "OFF", 3) == 0)) {
+        actuador_ordenar(ACTUADOR_CANAL_LED, len == 2 ? ACTUADOR_ENCENDER : ACTUADOR_APAGAR);
+        return;
+    }
+    if (len < 3) {
+        return;
+    }
+
+    uint16_t seq = buf[1] | (buf[2] << 8);
+    mutex_lock(&lock);
+    stats.recibidas++;
+    mutex_unlock(&lock);
+
+    if (buf[0] != ACTUADOR_VERSION || len != ACTUADOR_TAM_ORDEN || buf[4] > ACTUADOR_CONMUTAR) {
+        rechazar(sock, remoto, seq, ACTUADOR_INVALIDA, recibido_us);
+        return;
+    }
+    if (!canal_valido(buf[3])) {
+        rechazar(sock, remoto, seq, ACTUADOR_SIN_CANAL, recibido_us);
+        return;
+    }
+    if (repetida(sock, remoto, seq)) {
+        return;
+    }
+
+    orden_t orden = {
+        .con_ack = true,
+        .seq = seq,
+        .canal = buf[3],
+        .accion = buf[4],
+        .retardo_ms = leer_u32(&buf[5]),
+        .duracion_ms = leer_u32(&buf[9]),
+        .recibida_us = recibido_us,
+        .sock = sock,
+        .remoto = *remoto,
+    };
+    if (encolar(&orden) != 0) {
+        olvidar(remoto, seq);
+        rechazar(sock, remoto, seq, ACTUADOR_OCUPADO, recibido_us);
+    }
+}
+
+int actuador_ordenar(uint8_t canal, actuador_accion_t accion) {
+    if (!canal_valido(canal)) {
+        return -1;
+    }
+    orden_t orden = {
+        .con_ack = false,
+        .canal = canal,
+        .accion = accion,
+        .recibida_us = ztimer_now(ZTIMER_USEC),
+    };
+    return encolar(&orden);
+}
+
+void actuador_stats(actuador_stats_t *s) {
+    mutex_lock(&lock);
+    *s = stats;
+    mutex_unlock(&lock);
+}
+
+int actuador_iniciar(void) {
+    if (ws281x_init(&led_strip, &led_params) != 0) {
+        puts("Error inicializando el LED RGB");
+    }
+    for (unsigned i = 0; i < ACTUADOR_NUM_CANALES - 1; i++) {
+        if (salidas[i] != GPIO_UNDEF) {
+            gpio_init(salidas[i], GPIO_OUT);
+            gpio_clear(salidas[i]);
+        }
+    }
+
+    pid_actuador = thread_create(pila_actuador, sizeof(pila_actuador), ACTUADOR_PRIO, 0,
+                                 hilo_actuador, NULL, "actuador");
+    return pid_actuador > 0 ? 0 : -1;
+}
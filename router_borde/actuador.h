@@ -0,0 +1,85 @@
+#ifndef ACTUADOR_H
+#define ACTUADOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "net/sock/udp.h"
+
+// Órdenes a los actuadores del router recibidas por UDP (puerto 12345)
+//
+// Orden, todo en little-endian:
+//   version (u8) | seq (u16) | canal (u8) | accion (u8) | retardo_ms (u32) | duracion_ms (u32)
+// Respuesta (ack) al mismo origen:
+//   version (u8) | seq (u16) | estado (u8) | latencia_us (u32)
+//
+// La orden se aplica pasados retardo_ms y, si duracion_ms no es 0, el canal
+// vuelve a su estado anterior al cumplirse ese tiempo. El ack de una orden
+// inmediata sale cuando ya está aplicada, con la latencia desde que se
+// recibió; el de una orden con retardo, cuando queda programada, y CONMUTAR
+// se resuelve con el estado del canal al aplicarse. Una orden repetida con el
+// mismo seq no se vuelve a aplicar: se repite su ack.
+//
+// Por compatibilidad, los datagramas "ON" y "OFF" encienden y apagan el LED
+// sin respuesta.
+#define ACTUADOR_PUERTO         (12345U)
+#define ACTUADOR_VERSION        (1U)
+#define ACTUADOR_TAM_ORDEN      (13U)
+#define ACTUADOR_TAM_ACK        (8U)
+
+// Canales: 0 es el LED RGB; 1 y 2, salidas GPIO opcionales
+#define ACTUADOR_CANAL_LED      (0U)
+#define ACTUADOR_NUM_CANALES    (3U)
+#ifndef ACTUADOR_GPIO_1
+#define ACTUADOR_GPIO_1         GPIO_UNDEF
+#endif
+#ifndef ACTUADOR_GPIO_2
+#define ACTUADOR_GPIO_2         GPIO_UNDEF
+#endif
+
+#define ACTUADOR_COLA           (8U)    // Órdenes en espera del hilo actuador
+#define ACTUADOR_PROGRAMADAS    (8U)    // Acciones diferidas pendientes
+#define ACTUADOR_RECIENTES      (8U)    // Seqs recordados para detectar repetidas
+
+typedef enum {
+    ACTUADOR_APAGAR = 0,
+    ACTUADOR_ENCENDER = 1,
+    ACTUADOR_CONMUTAR = 2,
+} actuador_accion_t;
+
+typedef enum {
+    ACTUADOR_APLICADA = 0,
+    ACTUADOR_PROGRAMADA = 1,
+    ACTUADOR_INVALIDA = 2,          // Versión, longitud o acción desconocidas
+    ACTUADOR_SIN_CANAL = 3,         // Canal inexistente o sin GPIO asignado
+    ACTUADOR_OCUPADO = 4,           // Cola o tabla de programadas llenas
+} actuador_estado_t;
+
+typedef struct {
+    uint32_t recibidas;
+    uint32_t aplicadas;
+    uint32_t rechazadas;
+    uint32_t repetidas;
+    uint32_t latencia_ultima_us;    // De la recepción a la orden aplicada, sin el retardo pedido
+    uint32_t latencia_max_us;
+    uint32_t latencia_media_us;
+    unsigned cola_max;              // Máximo de órdenes en espera a la vez
+    bool encendido[ACTUADOR_NUM_CANALES];
+} actuador_stats_t;
+
+// Inicializa el LED y las salidas y arranca el hilo actuador
+int actuador_iniciar(void);
+
+// Atiende un datagrama recibido en sock en el instante recibido_us
+// (ZTIMER_USEC). Las órdenes rechazadas se responden aquí; el resto, desde el
+// hilo actuador.
+void actuador_recibir(sock_udp_t *sock, const sock_udp_ep_t *remoto,
+                      const uint8_t *buf, size_t len, uint32_t recibido_us);
+
+// Encola una orden local (shell) sin respuesta
+int actuador_ordenar(uint8_t canal, actuador_accion_t accion);
+
+void actuador_stats(actuador_stats_t *stats);
+
+#endif
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "mutex.h"
+#include "thread.h"
+#include "ztimer.h"
+#include "net/ipv6/addr.h"
+#include "net/sntp.h"
+#include "net/sock/udp.h"
+
+#include "hora.h"
+
+static char pila_hora[THREAD_STACKSIZE_DEFAULT];
+static sock_udp_t sock;
+
+static mutex_t lock = MUTEX_INIT;
+static hora_stats_t stats;
+
+static uint8_t *escribir_u64(uint8_t *p, uint64_t v) {
+    for (unsigned i = 0; i < 8; i++) {
+        p[i] = (v >> (8 * i)) & 0xFF;
+    }
+    return p + 8;
+}
+
+uint64_t hora_unix_ms(void) {
+    mutex_lock(&lock);
+    bool sincronizada = stats.sincronizada;
+    mutex_unlock(&lock);
+    return sincronizada ? sntp_get_unix_usec() / US_PER_MS : 0;
+}
+
+// Consulta el servidor SNTP; devuelve en cuántos segundos hay que repetirlo
+static uint32_t sincronizar(void) {
+    sock_udp_ep_t servidor = { .family = AF_INET6, .port = NTP_PORT };
+    if (ipv6_addr_from_str((ipv6_addr_t *)&servidor.addr.ipv6, HORA_SERVIDOR) == NULL) {
+        puts("hora: dirección del servidor SNTP no válida");
+        return HORA_PERIODO_SYNC_S;
+    }
+
+    int64_t desfase_previo_us = sntp_get_offset();
+    if (sntp_sync(&servidor, HORA_ESPERA_SNTP_MS * US_PER_MS) < 0) {
+        mutex_lock(&lock);
+        stats.fallos_sync++;
+        mutex_unlock(&lock);
+        return HORA_REINTENTO_SYNC_S;
+    }
+
+    mutex_lock(&lock);
+    // El primer ajuste parte de un reloj sin poner: no es una corrección
+    if (stats.sincronizada) {
+        stats.correccion_ms = (int32_t)((sntp_get_offset() - desfase_previo_us) / 1000);
+    }
+    stats.sincronizada = true;
+    stats.sincronizaciones++;
+    stats.ultima_sync_s = ztimer_now(ZTIMER_MSEC) / MS_PER_SEC;
+    mutex_unlock(&lock);
+    return HORA_PERIODO_SYNC_S;
+}
+
+static void responder(const sock_udp_ep_t *remoto, const uint8_t *buf, size_t len) {
+    // Se toma la hora lo antes posible: lo que tarde la respuesta en salir
+    // es error para el nodo
+    uint64_t unix_ms = hora_unix_ms();
+
+    mutex_lock(&lock);
+    stats.peticiones++;
+    if (len != HORA_TAM_PETICION || buf[0] != HORA_VERSION) {
+        stats.descartadas++;
+        mutex_unlock(&lock);
+        return;
+    }
+    stats.respuestas++;
+    mutex_unlock(&lock);
+
+    uint8_t respuesta[HORA_TAM_RESPUESTA];
+    uint8_t *p = respuesta;
+    *p++ = HORA_VERSION;
+    *p++ = unix_ms ? HORA_SINCRONIZADA : HORA_SIN_SINCRONIZAR;
+    memcpy(p, &buf[1], 4);
+    p += 4;
+    escribir_u64(p, unix_ms);
+
+    sock_udp_send(&sock, respuesta, sizeof(respuesta), remoto);
+}
+
+// Atiende las peticiones y, cuando vence el plazo, vuelve a sincronizar
+static void *hilo_hora(void *arg) {
+    (void)arg;
+    uint32_t proxima_sync_ms = ztimer_now(ZTIMER_MSEC);
+
+    while (1) {
+        uint32_t ahora = ztimer_now(ZTIMER_MSEC);
+        if ((int32_t)(proxima_sync_ms - ahora) <= 0) {
+            proxima_sync_ms = ztimer_now(ZTIMER_MSEC) + sincronizar() * MS_PER_SEC;
+            continue;
+        }
+
+        uint8_t buf[16];
+        sock_udp_ep_t remoto;
+        ssize_t res = sock_udp_recv(&sock, buf, sizeof(buf),
+                                    (proxima_sync_ms - ahora) * US_PER_MS, &remoto);
+        if (res >= 0) {
+            responder(&remoto, buf, res);
+        }
+    }
+    return NULL;
+}
+
+int hora_iniciar(void) {
+    sock_udp_ep_t local = SOCK_IPV6_EP_ANY;
+    local.port = HORA_PUERTO;
+    if (sock_udp_create(&sock, &local, NULL, 0) < 0) {
+        puts("hora: no se puede abrir el puerto de los nodos");
+        return 1;
+    }
+
+    // Por encima del resto de hilos de red para responder sin esperas
+    thread_create(pila_hora, sizeof(pila_hora), THREAD_PRIORITY_MAIN - 3, 0,
+                  hilo_hora, NULL, "hora");
+
+    printf("hora: servidor SNTP [%s], escuchando en el puerto %u\n", HORA_SERVIDOR, HORA_PUERTO);
+    return 0;
+}
+
+void hora_stats(hora_stats_t *s) {
+    mutex_lock(&lock);
+    *s = stats;
+    mutex_unlock(&lock);
+}
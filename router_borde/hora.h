@@ -0,0 +1,59 @@
+#ifndef HORA_H
+#define HORA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Servicio de hora para los nodos (puerto 12346)
+//
+// El router se sincroniza por SNTP con HORA_SERVIDOR cada HORA_PERIODO_SYNC_S
+// y responde a cada petición con su hora Unix en ese instante. Con un solo
+// intercambio el nodo estima su desfase como
+//   unix_ms - (t_envio + t_recepcion) / 2
+// con un error de como mucho la mitad del tiempo de ida y vuelta.
+//
+// Petición, todo en little-endian:
+//   version (u8) | origen (u32)
+// Respuesta:
+//   version (u8) | estado (u8) | origen (u32) | unix_ms (u64)
+// origen es un valor del nodo que se devuelve tal cual para emparejar la
+// respuesta; con estado HORA_SIN_SINCRONIZAR unix_ms no es válido.
+#ifndef HORA_SERVIDOR
+#define HORA_SERVIDOR               "2001:db8:a::1"
+#endif
+#define HORA_PUERTO                 (12346U)
+#define HORA_VERSION                (1U)
+#define HORA_TAM_PETICION           (5U)
+#define HORA_TAM_RESPUESTA          (14U)
+
+#ifndef HORA_PERIODO_SYNC_S
+#define HORA_PERIODO_SYNC_S         (600U)
+#endif
+#define HORA_REINTENTO_SYNC_S       (10U)       // Tras un fallo, o antes de la primera sincronización
+#define HORA_ESPERA_SNTP_MS         (1000U)
+
+typedef enum {
+    HORA_SIN_SINCRONIZAR = 0,
+    HORA_SINCRONIZADA = 1,
+} hora_estado_t;
+
+typedef struct {
+    uint32_t peticiones;
+    uint32_t respuestas;
+    uint32_t descartadas;           // Versión o longitud incorrectas
+    uint32_t sincronizaciones;
+    uint32_t fallos_sync;
+    uint32_t ultima_sync_s;         // Segundos desde el arranque del router
+    int32_t correccion_ms;          // Salto del reloj en la última sincronización
+    bool sincronizada;
+} hora_stats_t;
+
+// Abre el puerto de los nodos y arranca el hilo que sincroniza y responde
+int hora_iniciar(void);
+
+// Hora Unix actual en ms; 0 si aún no se ha sincronizado
+uint64_t hora_unix_ms(void);
+
+void hora_stats(hora_stats_t *stats);
+
+#endif
@@ -4,22 +4,18 @@
 #include "net/gnrc/netif.h"
 #include "net/netopt.h"
 #include "net/ipv6/addr.h"
-#include "ws281x.h"
 #include "net/sock/udp.h"
 #include "thread.h" // Incluir el encabezado para manejar hilos
+#include "ztimer.h"
+#include "actuador.h"
+#include "hora.h"
+#if PASARELA
+#include "pasarela.h"
+#endif
 
 #define MAIN_QUEUE_SIZE     (8)
 static msg_t _main_msg_queue[MAIN_QUEUE_SIZE];
 
-// Inicializar el LED RGB
-static ws281x_t led_strip;
-static uint8_t led_strip_buf[WS281X_BYTES_PER_DEVICE * WS281X_PARAM_NUMOF];
-static ws281x_params_t led_params = {
-    .buf = led_strip_buf,
-    .numof = 1,
-    .pin = GPIO48
-};
-
 // Definir el tamaño del stack para el hilo UDP
 #define UDP_THREAD_STACKSIZE  (THREAD_STACKSIZE_DEFAULT)
 
@@ -67,48 +63,129 @@ void configure_ipv6_address(void) {
     }
 }
 
-// Función para encender el LED RGB
-void led_on(void) {
-    color_rgb_t white = {0, 168, 243};
-    ws281x_set(&led_strip, 0, white);
-    ws281x_prepare_transmission(&led_strip);
-    ws281x_write(&led_strip);
-    puts("LED encendido.");
-}
-
-// Función para apagar el LED RGB
-void led_off(void) {
-    color_rgb_t off = {0, 0, 0};
-    ws281x_set(&led_strip, 0, off);
-    ws281x_prepare_transmission(&led_strip);
-    ws281x_write(&led_strip);
-    puts("LED apagado.");
-}
-
 // Comando para encender el LED
 static int comando_led_on(int argc, char **argv) {
-    led_on();
+    if (actuador_ordenar(ACTUADOR_CANAL_LED, ACTUADOR_ENCENDER) != 0) {
+        puts("Cola del actuador llena");
+    }
     return 0;
 }
 
 // Comando para apagar el LED
 static int comando_led_off(int argc, char **argv) {
-    led_off();
+    if (actuador_ordenar(ACTUADOR_CANAL_LED, ACTUADOR_APAGAR) != 0) {
+        puts("Cola del actuador llena");
+    }
     return 0;
 }
 
+// Comando para ver el estado de los actuadores y la latencia de las órdenes
+static int comando_actuadores(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    actuador_stats_t s;
+    actuador_stats(&s);
+
+    for (unsigned i = 0; i < ACTUADOR_NUM_CANALES; i++) {
+        printf("Canal %u: %s\n", i, s.encendido[i] ? "encendido" : "apagado");
+    }
+    printf("Órdenes: %lu recibidas, %lu aplicadas, %lu rechazadas, %lu repetidas\n",
+           (unsigned long)s.recibidas, (unsigned long)s.aplicadas,
+           (unsigned long)s.rechazadas, (unsigned long)s.repetidas);
+    printf("Latencia: última %lu us, media %lu us, máxima %lu us; cola máxima %u\n",
+           (unsigned long)s.latencia_ultima_us, (unsigned long)s.latencia_media_us,
+           (unsigned long)s.latencia_max_us, s.cola_max);
+    return 0;
+}
+
+// Comando para ver el estado del servicio de hora de los nodos
+static int comando_hora(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    hora_stats_t s;
+    hora_stats(&s);
+
+    if (!s.sincronizada) {
+        printf("Sin sincronizar con [%s] (%lu fallos)\n", HORA_SERVIDOR,
+               (unsigned long)s.fallos_sync);
+    } else {
+        uint64_t unix_ms = hora_unix_ms();
+        printf("Hora Unix: %lu.%03u s\n", (unsigned long)(unix_ms / 1000),
+               (unsigned)(unix_ms % 1000));
+        printf("Sincronizaciones: %lu, fallos: %lu, última hace %lu s, corrección %ld ms\n",
+               (unsigned long)s.sincronizaciones, (unsigned long)s.fallos_sync,
+               (unsigned long)(ztimer_now(ZTIMER_MSEC) / 1000 - s.ultima_sync_s),
+               (long)s.correccion_ms);
+    }
+    printf("Peticiones: %lu, respondidas: %lu, descartadas: %lu\n",
+           (unsigned long)s.peticiones, (unsigned long)s.respuestas,
+           (unsigned long)s.descartadas);
+    return 0;
+}
+
+#if PASARELA
+// Comando para ver el estado de la pasarela MQTT-SN
+static int comando_pasarela(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    pasarela_stats_t s;
+    pasarela_stats(&s);
+
+    printf("Broker: %s, %u lotes pendientes\n", s.conectada ? "conectado" : "desconectado",
+           s.lotes_pendientes);
+    printf("Nodos: %u, temas: %u\n", s.vecinos, s.temas);
+    printf("Mensajes: %lu recibidos, %lu rechazados, %lu repetidos, %lu reenviados a los nodos\n",
+           (unsigned long)s.recibidos, (unsigned long)s.rechazados, (unsigned long)s.repetidos,
+           (unsigned long)s.reenviados);
+    printf("Lotes: %lu enviados, %lu descartados, %lu fallos de subida\n",
+           (unsigned long)s.lotes_enviados, (unsigned long)s.lotes_descartados,
+           (unsigned long)s.fallos_subida);
+    return 0;
+}
+
+// Comando para ver el tráfico y la calidad de enlace de cada nodo vecino
+static int comando_vecinos(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    static pasarela_vecino_t tabla[PASARELA_MAX_VECINOS];
+    unsigned n = pasarela_vecinos(tabla, PASARELA_MAX_VECINOS);
+    uint32_t ahora = ztimer_now(ZTIMER_MSEC) / 1000;
+
+    printf("%-40s %5s %8s %9s %5s %5s %9s %7s\n", "Dirección", "Nodo", "Paquetes", "Bytes",
+           "Dup", "Desc", "RSSI/med", "Hace");
+    for (unsigned i = 0; i < n; i++) {
+        const pasarela_vecino_t *v = &tabla[i];
+        char dir[IPV6_ADDR_MAX_STR_LEN];
+        ipv6_addr_to_str(dir, &v->direccion, sizeof(dir));
+        printf("%-40s %5u %8lu %9lu %5u %5u %4d/%-4d %6lus\n", dir, v->id_nodo,
+               (unsigned long)v->paquetes, (unsigned long)v->bytes, v->retransmisiones,
+               v->descartes, v->rssi, v->rssi_medio, (unsigned long)(ahora - v->ultima_vez));
+    }
+    if (n == 0) {
+        puts("Ningún nodo ha contactado con la pasarela");
+    }
+    return 0;
+}
+#endif
+
 // Comandos del shell
 static const shell_command_t comandos_shell[] = {
     { "led_on", "Enciende el LED RGB", comando_led_on },
     { "led_off", "Apaga el LED RGB", comando_led_off },
+    { "actuadores", "Estado y latencia de los actuadores", comando_actuadores },
+    { "hora", "Estado del servicio de hora de los nodos", comando_hora },
+#if PASARELA
+    { "pasarela", "Estado de la pasarela MQTT-SN", comando_pasarela },
+    { "vecinos", "Tráfico y RSSI por nodo vecino", comando_vecinos },
+#endif
     { NULL, NULL, NULL }
 };
 
 // Función para manejar los mensajes UDP
 void udp_listener(void) {
     sock_udp_ep_t local = SOCK_IPV6_EP_ANY;
-    sock_udp_t sock;
-    local.port = 12345;
+    static sock_udp_t sock;
+    local.port = ACTUADOR_PUERTO;
 
     if (sock_udp_create(&sock, &local, NULL, 0) < 0) {
         puts("Error creando el socket UDP");
@@ -120,14 +197,10 @@ void udp_listener(void) {
         uint8_t buf[128];
         ssize_t res;
 
+        // Solo se decodifica y se encola: el hilo actuador aplica la orden y
+        // responde, así una ráfaga de órdenes no retrasa la recepción
         if ((res = sock_udp_recv(&sock, buf, sizeof(buf), SOCK_NO_TIMEOUT, &remote)) >= 0) {
-            buf[res] = '\0'; // Asegurarse de que el buffer sea una cadena
-            printf("Mensaje recibido: %s\n", buf);
-            if (strcmp((char *)buf, "ON") == 0) {
-                led_on();
-            } else if (strcmp((char *)buf, "OFF") == 0) {
-                led_off();
-            }
+            actuador_recibir(&sock, &remote, buf, res, ztimer_now(ZTIMER_USEC));
         }
     }
 }
@@ -139,8 +212,10 @@ static void *udp_thread(void *arg) {
 }
 
 int main(void) {
-    // Inicializar el LED RGB
-    ws281x_init(&led_strip, &led_params);
+    // Inicializar el LED RGB, las salidas y el hilo actuador
+    if (actuador_iniciar() != 0) {
+        puts("Error iniciando el hilo actuador");
+    }
 
     // Configurar el canal inalámbrico
     set_wifi_channel();
@@ -155,6 +230,18 @@ int main(void) {
     // Crear un hilo para el listener UDP
     thread_create(udp_thread_stack, sizeof(udp_thread_stack), THREAD_PRIORITY_MAIN - 1, 0, udp_thread, NULL, "udp_listener");
 
+    // Hora real para que los nodos marquen sus muestras
+    if (hora_iniciar() != 0) {
+        puts("Error iniciando el servicio de hora");
+    }
+
+#if PASARELA
+    // Pasarela MQTT-SN local para los nodos
+    if (pasarela_iniciar() != 0) {
+        puts("Error iniciando la pasarela MQTT-SN");
+    }
+#endif
+
     // Iniciar el shell
     puts("All up, running the shell now");
     char line_buf[SHELL_DEFAULT_BUFSIZE];
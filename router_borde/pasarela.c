@@ -0,0 +1,797 @@
+#if PASARELA
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "mutex.h"
+#include "thread.h"
+#include "ztimer.h"
+#include "net/emcute.h"
+#include "net/ipv6/addr.h"
+#include "net/sock/udp.h"
+
+#include "pasarela.h"
+
+// Tipos de mensaje MQTT-SN que atiende la pasarela
+#define MQTTSN_CONNECT          (0x04)
+#define MQTTSN_CONNACK          (0x05)
+#define MQTTSN_REGISTER         (0x0A)
+#define MQTTSN_REGACK           (0x0B)
+#define MQTTSN_PUBLISH          (0x0C)
+#define MQTTSN_PUBACK           (0x0D)
+#define MQTTSN_SUBSCRIBE        (0x12)
+#define MQTTSN_SUBACK           (0x13)
+#define MQTTSN_UNSUBSCRIBE      (0x14)
+#define MQTTSN_UNSUBACK         (0x15)
+#define MQTTSN_PINGREQ          (0x16)
+#define MQTTSN_PINGRESP         (0x17)
+#define MQTTSN_DISCONNECT       (0x18)
+
+#define MQTTSN_ACEPTADO         (0x00)
+#define MQTTSN_CONGESTION       (0x01)
+#define MQTTSN_TEMA_INVALIDO    (0x02)
+#define MQTTSN_NO_SOPORTADO     (0x03)
+
+#define MQTTSN_DUP              (0x80)
+#define MQTTSN_QOS_MASK         (0x60)
+#define MQTTSN_QOS_1            (0x20)
+#define MQTTSN_QOS_2            (0x40)
+#define MQTTSN_WILL             (0x08)
+#define MQTTSN_SESION_LIMPIA    (0x04)
+#define MQTTSN_TIPO_TEMA        (0x03)
+
+#if PASARELA_TAM_LOTE + 7 > CONFIG_EMCUTE_BUFSIZE
+#error "PASARELA_TAM_LOTE no cabe en el buffer de emcute"
+#endif
+#if PASARELA_TAM_CABECERA + PASARELA_MAX_VECINOS * PASARELA_TAM_VECINO + 7 > CONFIG_EMCUTE_BUFSIZE
+#error "La tabla de vecinos no cabe en el buffer de emcute"
+#endif
+
+#if PASARELA_MAX_TEMAS > 64
+#error "Los temas registrados por cliente se guardan en 64 bits"
+#endif
+
+#define TAM_PAQUETE             (CONFIG_EMCUTE_BUFSIZE)
+#define TAM_REENVIO             (128U)
+
+typedef struct {
+    uint32_t numero;
+    uint16_t longitud;
+    uint8_t datos[PASARELA_TAM_LOTE];
+} lote_t;
+
+// Los IDs de tema son el índice + 1 y no se liberan: un nodo que vuelve del
+// sueño profundo reanuda su sesión con los IDs que ya tenía. Cada cliente
+// solo puede usar los que registró él (cliente_t).
+typedef struct {
+    char nombre[PASARELA_LONGITUD_TEMA];
+    emcute_sub_t sub;           // Suscripción en el broker
+    bool pedir_sub;
+    bool suscrito;
+} tema_t;
+
+typedef struct {
+    sock_udp_ep_t nodo;
+    uint16_t tema;
+} suscripcion_t;
+
+// Cliente MQTT-SN por dirección y puerto (un nodo puede tener dos: emcute y
+// el publicador fiable). Solo puede publicar en los IDs que registró: tras
+// reiniciarse el router, un nodo que no se entera sigue usando IDs que ahora
+// numeran temas de otros nodos.
+typedef struct {
+    sock_udp_ep_t ep;
+    uint64_t temas;             // Bit id - 1 de cada tema registrado
+    uint32_t ultima_vez;
+    uint16_t recientes[PASARELA_MSG_RECIENTES];    // msg_id de los últimos PUBLISH QoS 1 aceptados
+    uint8_t num_recientes;
+    uint8_t siguiente_reciente;
+} cliente_t;
+
+static char pila_emcute[THREAD_STACKSIZE_DEFAULT];
+static char pila_recepcion[THREAD_STACKSIZE_DEFAULT];
+static char pila_subida[THREAD_STACKSIZE_DEFAULT];
+
+static sock_udp_t sock;
+static uint8_t paquete[TAM_PAQUETE];
+static uint8_t respuesta[TAM_REENVIO + 7];
+
+// Tablas y lotes compartidos entre la recepción, la subida y el hilo de emcute
+static mutex_t lock = MUTEX_INIT;
+static pasarela_vecino_t vecinos[PASARELA_MAX_VECINOS];
+static unsigned num_vecinos = 0;
+static tema_t temas[PASARELA_MAX_TEMAS];
+static unsigned num_temas = 0;
+static suscripcion_t suscripciones[PASARELA_MAX_SUSCRIPCIONES];
+static unsigned num_suscripciones = 0;
+static cliente_t clientes[PASARELA_MAX_CLIENTES];
+static unsigned num_clientes = 0;
+static lote_t abierto;
+static lote_t pendientes[PASARELA_LOTES_PENDIENTES];
+static unsigned primero = 0;
+static unsigned num_pendientes = 0;
+static uint32_t siguiente_lote = 0;
+static pasarela_stats_t stats;
+
+// Solo los usa el hilo de subida
+static lote_t envio;
+static emcute_topic_t tema_lote;
+static emcute_topic_t tema_vecinos;
+static uint8_t informe[PASARELA_TAM_CABECERA + PASARELA_MAX_VECINOS * PASARELA_TAM_VECINO];
+
+static uint8_t *escribir_u16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *escribir_u32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+static uint32_t segundos(void) {
+    return ztimer_now(ZTIMER_MSEC) / 1000;
+}
+
+// --- Lotes (con lock) -------------------------------------------------------
+
+static void cerrar_lote(void) {
+    if (abierto.longitud == 0) {
+        return;
+    }
+    if (num_pendientes == PASARELA_LOTES_PENDIENTES) {
+        primero = (primero + 1) % PASARELA_LOTES_PENDIENTES;
+        num_pendientes--;
+        stats.lotes_descartados++;
+    }
+    abierto.numero = siguiente_lote++;
+    pendientes[(primero + num_pendientes) % PASARELA_LOTES_PENDIENTES] = abierto;
+    num_pendientes++;
+    abierto.longitud = 0;
+}
+
+static bool agregar_a_lote(const char *tema, const uint8_t *datos, size_t len) {
+    size_t longitud_tema = strlen(tema);
+    size_t tam = 4 + 1 + longitud_tema + 2 + len;
+    if (PASARELA_TAM_CABECERA + tam > PASARELA_TAM_LOTE) {
+        return false;
+    }
+
+    if (abierto.longitud + tam > PASARELA_TAM_LOTE || abierto.datos[1] == UINT8_MAX) {
+        cerrar_lote();
+    }
+    if (abierto.longitud == 0) {
+        abierto.datos[0] = PASARELA_LOTE_VERSION;
+        abierto.datos[1] = 0;
+        abierto.longitud = PASARELA_TAM_CABECERA;
+    }
+
+    uint8_t *p = abierto.datos + abierto.longitud;
+    p = escribir_u32(p, segundos());
+    *p++ = (uint8_t)longitud_tema;
+    memcpy(p, tema, longitud_tema);
+    p = escribir_u16(p + longitud_tema, (uint16_t)len);
+    memcpy(p, datos, len);
+    abierto.longitud += tam;
+    abierto.datos[1]++;
+    return true;
+}
+
+// --- Tablas (con lock) ------------------------------------------------------
+
+static uint16_t buscar_tema(const char *nombre, bool crear) {
+    for (unsigned i = 0; i < num_temas; i++) {
+        if (strcmp(temas[i].nombre, nombre) == 0) {
+            return i + 1;
+        }
+    }
+    if (!crear || num_temas == PASARELA_MAX_TEMAS || strlen(nombre) >= PASARELA_LONGITUD_TEMA) {
+        return 0;
+    }
+    strcpy(temas[num_temas].nombre, nombre);
+    return ++num_temas;
+}
+
+static const char *nombre_tema(uint16_t id) {
+    return (id >= 1 && id <= num_temas) ? temas[id - 1].nombre : NULL;
+}
+
+static pasarela_vecino_t *buscar_vecino(const ipv6_addr_t *addr) {
+    for (unsigned i = 0; i < num_vecinos; i++) {
+        if (ipv6_addr_equal(&vecinos[i].direccion, addr)) {
+            return &vecinos[i];
+        }
+    }
+    if (num_vecinos == PASARELA_MAX_VECINOS) {
+        return NULL;
+    }
+    pasarela_vecino_t *v = &vecinos[num_vecinos++];
+    memset(v, 0, sizeof(*v));
+    v->direccion = *addr;
+    v->rssi = PASARELA_RSSI_AUSENTE;
+    v->rssi_medio = PASARELA_RSSI_AUSENTE;
+    return v;
+}
+
+static void anotar_rssi(pasarela_vecino_t *v, int16_t rssi) {
+    if (rssi < INT8_MIN + 1) {
+        rssi = INT8_MIN + 1;
+    } else if (rssi > INT8_MAX) {
+        rssi = INT8_MAX;
+    }
+    v->rssi = rssi;
+    if (v->rssi_medio == PASARELA_RSSI_AUSENTE) {
+        v->rssi_medio = rssi;
+    } else {
+        v->rssi_medio += (rssi - v->rssi_medio) / 8;
+    }
+}
+
+// El número de nodo se deduce del primer tema que lo lleve (sensores/nodo_<N>/...)
+static void anotar_id_nodo(pasarela_vecino_t *v, const char *tema) {
+    const char *nodo = strstr(tema, "nodo_");
+    if (v->id_nodo == 0 && nodo != NULL) {
+        v->id_nodo = (uint16_t)strtoul(nodo + 5, NULL, 10);
+    }
+}
+
+static void anotar_descarte(pasarela_vecino_t *v) {
+    if (v != NULL) {
+        mutex_lock(&lock);
+        v->descartes++;
+        mutex_unlock(&lock);
+    }
+}
+
+static bool mismo_nodo(const sock_udp_ep_t *a, const sock_udp_ep_t *b) {
+    return a->port == b->port &&
+           ipv6_addr_equal((const ipv6_addr_t *)&a->addr.ipv6, (const ipv6_addr_t *)&b->addr.ipv6);
+}
+
+// Con la tabla llena se reutiliza el cliente que lleva más tiempo callado; si
+// vuelve, sus IDs se rechazan y el nodo registra los temas de nuevo
+static cliente_t *buscar_cliente(const sock_udp_ep_t *ep, bool crear) {
+    cliente_t *antiguo = NULL;
+    for (unsigned i = 0; i < num_clientes; i++) {
+        if (mismo_nodo(&clientes[i].ep, ep)) {
+            clientes[i].ultima_vez = segundos();
+            return &clientes[i];
+        }
+        if (antiguo == NULL || clientes[i].ultima_vez < antiguo->ultima_vez) {
+            antiguo = &clientes[i];
+        }
+    }
+    if (!crear) {
+        return NULL;
+    }
+
+    cliente_t *c = (num_clientes < PASARELA_MAX_CLIENTES) ? &clientes[num_clientes++] : antiguo;
+    c->ep = *ep;
+    c->temas = 0;
+    c->num_recientes = 0;
+    c->ultima_vez = segundos();
+    return c;
+}
+
+static bool tema_registrado(const cliente_t *c, uint16_t id) {
+    return c != NULL && id >= 1 && id <= num_temas && (c->temas & (1ULL << (id - 1)));
+}
+
+static bool publicacion_reciente(const cliente_t *c, uint16_t msg_id) {
+    for (unsigned i = 0; i < c->num_recientes; i++) {
+        if (c->recientes[i] == msg_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void anotar_publicacion(cliente_t *c, uint16_t msg_id) {
+    c->recientes[c->siguiente_reciente] = msg_id;
+    c->siguiente_reciente = (c->siguiente_reciente + 1) % PASARELA_MSG_RECIENTES;
+    if (c->num_recientes < PASARELA_MSG_RECIENTES) {
+        c->num_recientes++;
+    }
+}
+
+static bool agregar_suscripcion(const sock_udp_ep_t *nodo, uint16_t tema) {
+    for (unsigned i = 0; i < num_suscripciones; i++) {
+        if (suscripciones[i].tema == tema && mismo_nodo(&suscripciones[i].nodo, nodo)) {
+            return true;
+        }
+    }
+    if (num_suscripciones == PASARELA_MAX_SUSCRIPCIONES) {
+        return false;
+    }
+    suscripciones[num_suscripciones].nodo = *nodo;
+    suscripciones[num_suscripciones].tema = tema;
+    num_suscripciones++;
+    return true;
+}
+
+static void quitar_suscripcion(const sock_udp_ep_t *nodo, uint16_t tema) {
+    for (unsigned i = 0; i < num_suscripciones; i++) {
+        if (suscripciones[i].tema == tema && mismo_nodo(&suscripciones[i].nodo, nodo)) {
+            suscripciones[i] = suscripciones[--num_suscripciones];
+            return;
+        }
+    }
+}
+
+// --- Recepción de los nodos -------------------------------------------------
+
+static void responder(const sock_udp_ep_t *nodo, size_t len) {
+    respuesta[0] = (uint8_t)len;
+    sock_udp_send(&sock, respuesta, len, nodo);
+}
+
+static void al_conectar(const sock_udp_ep_t *nodo, pasarela_vecino_t *v,
+                        const uint8_t *p, size_t len) {
+    uint8_t rc = MQTTSN_ACEPTADO;
+
+    if (len < 4 || (p[0] & MQTTSN_WILL)) {
+        rc = MQTTSN_NO_SOPORTADO;
+    } else if (v == NULL) {
+        rc = MQTTSN_CONGESTION;
+    } else {
+        mutex_lock(&lock);
+        if (p[0] & MQTTSN_SESION_LIMPIA) {
+            // Sesión nueva: los temas se registran otra vez y los msg_id
+            // vuelven a empezar
+            cliente_t *c = buscar_cliente(nodo, true);
+            c->temas = 0;
+            c->num_recientes = 0;
+            v->sesion = true;
+        } else if (!v->sesion) {
+            // Sesión de antes de reiniciar el router: sus IDs de tema ya no
+            // valen, el nodo debe reconectar con sesión limpia y registrarlos
+            rc = MQTTSN_NO_SOPORTADO;
+        }
+        mutex_unlock(&lock);
+    }
+
+    respuesta[1] = MQTTSN_CONNACK;
+    respuesta[2] = rc;
+    responder(nodo, 3);
+}
+
+static void al_registrar(const sock_udp_ep_t *nodo, pasarela_vecino_t *v,
+                         uint8_t *p, size_t len) {
+    if (len < 5) {
+        return;
+    }
+    p[len] = '\0';
+
+    mutex_lock(&lock);
+    uint16_t id = buscar_tema((char *)&p[4], true);
+    if (id != 0) {
+        buscar_cliente(nodo, true)->temas |= 1ULL << (id - 1);
+    }
+    if (v != NULL) {
+        anotar_id_nodo(v, (char *)&p[4]);
+    }
+    mutex_unlock(&lock);
+
+    respuesta[1] = MQTTSN_REGACK;
+    byteorder_htobebufs(&respuesta[2], id);
+    memcpy(&respuesta[4], &p[2], 2);
+    respuesta[6] = id ? MQTTSN_ACEPTADO : MQTTSN_CONGESTION;
+    responder(nodo, 7);
+}
+
+static void al_publicar(const sock_udp_ep_t *nodo, pasarela_vecino_t *v,
+                        const uint8_t *p, size_t len) {
+    if (len < 5) {
+        return;
+    }
+    uint8_t qos = p[0] & MQTTSN_QOS_MASK;
+    uint16_t id = byteorder_bebuftohs(&p[1]);
+    uint16_t msg_id = byteorder_bebuftohs(&p[3]);
+    uint8_t rc = MQTTSN_ACEPTADO;
+
+    if ((p[0] & MQTTSN_TIPO_TEMA) != 0 || qos == MQTTSN_QOS_2) {
+        rc = MQTTSN_NO_SOPORTADO;
+    }
+
+    mutex_lock(&lock);
+    cliente_t *c = buscar_cliente(nodo, false);
+    const char *tema = tema_registrado(c, id) ? nombre_tema(id) : NULL;
+    // Reenvío de algo ya aceptado cuyo PUBACK se perdió: solo se confirma
+    bool repetida = rc == MQTTSN_ACEPTADO && tema != NULL && qos == MQTTSN_QOS_1 &&
+                    (p[0] & MQTTSN_DUP) && publicacion_reciente(c, msg_id);
+    if (rc == MQTTSN_ACEPTADO && tema == NULL) {
+        rc = MQTTSN_TEMA_INVALIDO;
+    } else if (rc == MQTTSN_ACEPTADO && !repetida && !agregar_a_lote(tema, &p[5], len - 5)) {
+        rc = MQTTSN_CONGESTION;
+    }
+    if (repetida) {
+        stats.repetidos++;
+    } else if (rc == MQTTSN_ACEPTADO) {
+        stats.recibidos++;
+        if (qos == MQTTSN_QOS_1) {
+            anotar_publicacion(c, msg_id);
+        }
+    } else {
+        stats.rechazados++;
+    }
+    if (v != NULL) {
+        if (p[0] & MQTTSN_DUP) {
+            v->retransmisiones++;
+        }
+        if (rc != MQTTSN_ACEPTADO) {
+            v->descartes++;
+        }
+    }
+    mutex_unlock(&lock);
+
+    // El PUBACK sale en cuanto el mensaje está en el lote. Con QoS 0 solo se
+    // responde a los rechazos; los nodos publican con QoS 1, así que ven el
+    // rechazo y reconectan con sesión limpia para registrar los temas
+    if (qos == MQTTSN_QOS_1 || rc != MQTTSN_ACEPTADO) {
+        respuesta[1] = MQTTSN_PUBACK;
+        memcpy(&respuesta[2], &p[1], 4);
+        respuesta[6] = rc;
+        responder(nodo, 7);
+    }
+}
+
+static void al_suscribir(const sock_udp_ep_t *nodo, pasarela_vecino_t *v,
+                         uint8_t *p, size_t len) {
+    if (len < 4) {
+        return;
+    }
+    p[len] = '\0';
+    const char *nombre = (char *)&p[3];
+    uint16_t id = 0;
+    uint8_t rc = MQTTSN_ACEPTADO;
+
+    if ((p[0] & MQTTSN_TIPO_TEMA) != 0 || strpbrk(nombre, "#+") != NULL) {
+        rc = MQTTSN_NO_SOPORTADO;
+    } else {
+        mutex_lock(&lock);
+        id = buscar_tema(nombre, true);
+        if (v != NULL) {
+            anotar_id_nodo(v, nombre);
+        }
+        if (id == 0 || !agregar_suscripcion(nodo, id)) {
+            rc = MQTTSN_CONGESTION;
+        } else if (!temas[id - 1].suscrito) {
+            temas[id - 1].pedir_sub = true;
+        }
+        mutex_unlock(&lock);
+    }
+
+    respuesta[1] = MQTTSN_SUBACK;
+    respuesta[2] = 0;           // QoS concedida: 0
+    byteorder_htobebufs(&respuesta[3], rc == MQTTSN_ACEPTADO ? id : 0);
+    memcpy(&respuesta[5], &p[1], 2);
+    respuesta[7] = rc;
+    responder(nodo, 8);
+}
+
+static void al_desuscribir(const sock_udp_ep_t *nodo, uint8_t *p, size_t len) {
+    if (len < 4) {
+        return;
+    }
+    p[len] = '\0';
+
+    mutex_lock(&lock);
+    uint16_t id = buscar_tema((char *)&p[3], false);
+    if (id != 0) {
+        quitar_suscripcion(nodo, id);
+    }
+    mutex_unlock(&lock);
+
+    respuesta[1] = MQTTSN_UNSUBACK;
+    memcpy(&respuesta[2], &p[1], 2);
+    responder(nodo, 4);
+}
+
+static void procesar_paquete(const sock_udp_ep_t *nodo, pasarela_vecino_t *v,
+                             uint8_t *buf, size_t res) {
+    // Longitud de 1 byte o 0x01 seguido de 2 bytes
+    size_t cabecera = 2;
+    size_t len = buf[0];
+    if (buf[0] == 0x01) {
+        if (res < 4) {
+            anotar_descarte(v);
+            return;
+        }
+        cabecera = 4;
+        len = byteorder_bebuftohs(&buf[1]);
+    }
+    if (len != res || len < cabecera) {
+        anotar_descarte(v);
+        return;
+    }
+
+    uint8_t tipo = buf[cabecera - 1];
+    uint8_t *p = &buf[cabecera];
+    len -= cabecera;
+
+    switch (tipo) {
+    case MQTTSN_CONNECT:
+        al_conectar(nodo, v, p, len);
+        break;
+    case MQTTSN_REGISTER:
+        al_registrar(nodo, v, p, len);
+        break;
+    case MQTTSN_PUBLISH:
+        al_publicar(nodo, v, p, len);
+        break;
+    case MQTTSN_SUBSCRIBE:
+        al_suscribir(nodo, v, p, len);
+        break;
+    case MQTTSN_UNSUBSCRIBE:
+        al_desuscribir(nodo, p, len);
+        break;
+    case MQTTSN_PINGREQ:
+        respuesta[1] = MQTTSN_PINGRESP;
+        responder(nodo, 2);
+        break;
+    case MQTTSN_DISCONNECT:
+        respuesta[1] = MQTTSN_DISCONNECT;
+        responder(nodo, 2);
+        break;
+    default:
+        anotar_descarte(v);
+        break;
+    }
+}
+
+static void *hilo_recepcion(void *arg) {
+    (void)arg;
+
+    while (1) {
+        sock_udp_ep_t nodo;
+        sock_udp_aux_rx_t aux = { .flags = SOCK_AUX_GET_RSSI };
+        // Se deja un byte libre para terminar los nombres de tema
+        ssize_t res = sock_udp_recv_aux(&sock, paquete, sizeof(paquete) - 1, SOCK_NO_TIMEOUT,
+                                        &nodo, &aux);
+        if (res < 0) {
+            continue;
+        }
+
+        mutex_lock(&lock);
+        pasarela_vecino_t *v = buscar_vecino((const ipv6_addr_t *)&nodo.addr.ipv6);
+        if (v != NULL) {
+            v->paquetes++;
+            v->bytes += res;
+            v->ultima_vez = segundos();
+            // sock_udp_recv_aux borra la bandera si ha podido rellenar el valor
+            if (!(aux.flags & SOCK_AUX_GET_RSSI)) {
+                anotar_rssi(v, aux.rssi);
+            }
+        }
+        mutex_unlock(&lock);
+
+        if (res >= 2) {
+            procesar_paquete(&nodo, v, paquete, res);
+        } else {
+            anotar_descarte(v);
+        }
+    }
+    return NULL;
+}
+
+// --- Reenvío del broker a los nodos (hilo de emcute) ------------------------
+
+static void al_recibir_broker(const emcute_topic_t *topic, void *datos, size_t len) {
+    static uint8_t reenvio[TAM_REENVIO + 7];
+
+    if (len > TAM_REENVIO) {
+        printf("pasarela: mensaje de %u bytes en '%s' demasiado grande para reenviar\n",
+               (unsigned)len, topic->name);
+        return;
+    }
+
+    mutex_lock(&lock);
+    uint16_t id = buscar_tema(topic->name, false);
+    reenvio[0] = 7 + len;
+    reenvio[1] = MQTTSN_PUBLISH;
+    reenvio[2] = 0;             // QoS 0, tema normal
+    byteorder_htobebufs(&reenvio[3], id);
+    byteorder_htobebufs(&reenvio[5], 0);
+    memcpy(&reenvio[7], datos, len);
+    for (unsigned i = 0; id != 0 && i < num_suscripciones; i++) {
+        if (suscripciones[i].tema == id) {
+            sock_udp_send(&sock, reenvio, 7 + len, &suscripciones[i].nodo);
+            stats.reenviados++;
+        }
+    }
+    mutex_unlock(&lock);
+}
+
+// --- Subida al broker -------------------------------------------------------
+
+static int conectar_subida(void) {
+    sock_udp_ep_t gw = { .family = AF_INET6, .port = PASARELA_BROKER_PUERTO };
+    if (ipv6_addr_from_str((ipv6_addr_t *)&gw.addr.ipv6, PASARELA_BROKER) == NULL) {
+        puts("pasarela: dirección del broker no válida");
+        return 1;
+    }
+
+    // Sesión persistente: el broker conserva las suscripciones entre cortes y
+    // la lista de emcute sigue siendo válida al reconectar
+    if (emcute_con(&gw, false, NULL, NULL, 0, 0) != EMCUTE_OK) {
+        return 1;
+    }
+    tema_lote.name = PASARELA_TEMA_LOTE;
+    tema_vecinos.name = PASARELA_TEMA_VECINOS;
+    if (emcute_reg(&tema_lote) != EMCUTE_OK || emcute_reg(&tema_vecinos) != EMCUTE_OK) {
+        emcute_discon();
+        return 1;
+    }
+    printf("pasarela: conectada al broker [%s]:%u\n", PASARELA_BROKER, PASARELA_BROKER_PUERTO);
+    return 0;
+}
+
+static void suscribir_pendientes(void) {
+    for (unsigned i = 0; i < PASARELA_MAX_TEMAS; i++) {
+        mutex_lock(&lock);
+        bool pedir = i < num_temas && temas[i].pedir_sub;
+        mutex_unlock(&lock);
+        if (!pedir) {
+            continue;
+        }
+
+        // Nombre y callback se fijan antes de que emcute enlace la suscripción
+        temas[i].sub.topic.name = temas[i].nombre;
+        temas[i].sub.cb = al_recibir_broker;
+        if (emcute_sub(&temas[i].sub, EMCUTE_QOS_0) != EMCUTE_OK) {
+            printf("pasarela: no se puede suscribir a '%s'\n", temas[i].nombre);
+            return;
+        }
+        mutex_lock(&lock);
+        temas[i].pedir_sub = false;
+        temas[i].suscrito = true;
+        mutex_unlock(&lock);
+    }
+}
+
+// Envía los lotes pendientes en orden; devuelve false si se perdió la conexión
+static bool enviar_pendientes(void) {
+    while (1) {
+        mutex_lock(&lock);
+        if (num_pendientes == 0) {
+            mutex_unlock(&lock);
+            return true;
+        }
+        envio = pendientes[primero];
+        mutex_unlock(&lock);
+
+        escribir_u32(&envio.datos[2], segundos());
+        int res = emcute_pub(&tema_lote, envio.datos, envio.longitud, EMCUTE_QOS_1);
+
+        mutex_lock(&lock);
+        if (res == EMCUTE_OK) {
+            stats.lotes_enviados++;
+            // Durante el envío el lote pudo descartarse por falta de espacio
+            if (num_pendientes > 0 && pendientes[primero].numero == envio.numero) {
+                primero = (primero + 1) % PASARELA_LOTES_PENDIENTES;
+                num_pendientes--;
+            }
+        } else {
+            stats.fallos_subida++;
+        }
+        mutex_unlock(&lock);
+
+        if (res != EMCUTE_OK) {
+            printf("pasarela: fallo al subir un lote (%d), se reintenta\n", res);
+            return false;
+        }
+    }
+}
+
+static void publicar_vecinos(void) {
+    uint32_t ahora = segundos();
+
+    mutex_lock(&lock);
+    uint8_t *p = informe;
+    *p++ = PASARELA_LOTE_VERSION;
+    *p++ = (uint8_t)num_vecinos;
+    p = escribir_u32(p, ahora);
+    for (unsigned i = 0; i < num_vecinos; i++) {
+        const pasarela_vecino_t *v = &vecinos[i];
+        p = escribir_u16(p, v->id_nodo);
+        memcpy(p, &v->direccion.u8[8], 8);
+        p = escribir_u32(p + 8, v->paquetes);
+        p = escribir_u32(p, v->bytes);
+        p = escribir_u16(p, v->retransmisiones);
+        p = escribir_u16(p, v->descartes);
+        *p++ = (uint8_t)v->rssi;
+        *p++ = (uint8_t)v->rssi_medio;
+        p = escribir_u32(p, ahora - v->ultima_vez);
+    }
+    mutex_unlock(&lock);
+
+    if (emcute_pub(&tema_vecinos, informe, p - informe, EMCUTE_QOS_0) != EMCUTE_OK) {
+        puts("pasarela: no se pudo publicar la tabla de vecinos");
+    }
+}
+
+static void *hilo_subida(void *arg) {
+    (void)arg;
+    bool conectada = false;
+    uint32_t ultimo = ztimer_now(ZTIMER_MSEC);
+    uint32_t ultimo_informe = ultimo;
+
+    while (1) {
+        ztimer_periodic_wakeup(ZTIMER_MSEC, &ultimo, PASARELA_INTERVALO_MS);
+
+        mutex_lock(&lock);
+        cerrar_lote();
+        mutex_unlock(&lock);
+
+        if (!conectada) {
+            conectada = conectar_subida() == 0;
+        }
+        if (conectada) {
+            suscribir_pendientes();
+            conectada = enviar_pendientes();
+            if (!conectada) {
+                emcute_discon();
+            }
+        }
+        if (conectada && ultimo - ultimo_informe >= PASARELA_PERIODO_VECINOS_MS) {
+            publicar_vecinos();
+            ultimo_informe = ultimo;
+        }
+
+        mutex_lock(&lock);
+        stats.conectada = conectada;
+        mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+static void *hilo_emcute(void *arg) {
+    (void)arg;
+    emcute_run(PASARELA_PUERTO_SUBIDA, PASARELA_ID);
+    return NULL;
+}
+
+int pasarela_iniciar(void) {
+    sock_udp_ep_t local = SOCK_IPV6_EP_ANY;
+    local.port = PASARELA_PUERTO;
+    if (sock_udp_create(&sock, &local, NULL, 0) < 0) {
+        puts("pasarela: no se puede abrir el puerto de los nodos");
+        return 1;
+    }
+
+    thread_create(pila_emcute, sizeof(pila_emcute), THREAD_PRIORITY_MAIN - 1, 0,
+                  hilo_emcute, NULL, "emcute");
+    thread_create(pila_recepcion, sizeof(pila_recepcion), THREAD_PRIORITY_MAIN - 2, 0,
+                  hilo_recepcion, NULL, "pasarela");
+    thread_create(pila_subida, sizeof(pila_subida), THREAD_PRIORITY_MAIN - 1, 0,
+                  hilo_subida, NULL, "subida");
+
+    printf("pasarela: escuchando en el puerto %u, lotes cada %u ms\n",
+           PASARELA_PUERTO, PASARELA_INTERVALO_MS);
+    return 0;
+}
+
+void pasarela_stats(pasarela_stats_t *s) {
+    mutex_lock(&lock);
+    *s = stats;
+    s->lotes_pendientes = num_pendientes;
+    s->vecinos = num_vecinos;
+    s->temas = num_temas;
+    mutex_unlock(&lock);
+}
+
+unsigned pasarela_vecinos(pasarela_vecino_t *tabla, unsigned max) {
+    mutex_lock(&lock);
+    unsigned n = num_vecinos < max ? num_vecinos : max;
+    memcpy(tabla, vecinos, n * sizeof(*tabla));
+    mutex_unlock(&lock);
+    return n;
+}
+
+#endif /* PASARELA */
@@ -0,0 +1,111 @@
+#ifndef PASARELA_H
+#define PASARELA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "net/ipv6/addr.h"
+
+// Pasarela MQTT-SN local del router de borde (make PASARELA=1)
+//
+// Los nodos se conectan al router en lugar de al broker. La pasarela responde
+// en el acto a CONNECT, REGISTER, PUBLISH y SUBSCRIBE, junta lo publicado
+// durante PASARELA_INTERVALO_MS en un único mensaje hacia el broker y, si el
+// enlace de subida se cae, guarda hasta PASARELA_LOTES_PENDIENTES lotes
+// (descartando el más antiguo) para enviarlos al recuperarlo.
+//
+// Lote publicado en PASARELA_TEMA_LOTE, todo en little-endian:
+//   cabecera: version (u8) | num_registros (u8) | tiempo_envio (u32)
+//   registro: tiempo (u32) | longitud_tema (u8) | tema | longitud_datos (u16) | datos
+// Los tiempos son segundos desde el arranque del router; tiempo_envio -
+// tiempo es lo que esperó el mensaje en la pasarela.
+//
+// Los IDs de tema se numeran en una tabla común, pero cada cliente (dirección
+// y puerto) solo puede publicar en los que registró en su sesión; el resto se
+// rechaza con PUBACK de tema inválido. Un PUBLISH QoS 1 con la bandera DUP y
+// el msg_id de uno de los últimos PASARELA_MSG_RECIENTES aceptados del mismo
+// cliente es un reenvío por un PUBACK perdido: se confirma sin volver a
+// añadirlo al lote.
+//
+// Los mensajes del broker a los temas que piden los nodos (control/...) se les
+// reenvían con QoS 0. No se admiten comodines, will ni QoS 2.
+//
+// La pasarela lleva además una tabla por nodo vecino con el tráfico que le
+// llega y la publica cada PASARELA_PERIODO_VECINOS_MS en PASARELA_TEMA_VECINOS
+// (QoS 0, sin guardar durante cortes):
+//   cabecera: version (u8) | num_vecinos (u8) | tiempo (u32)
+//   vecino:   id_nodo (u16) | iid (8 bytes) | paquetes (u32) | bytes (u32) |
+//             retransmisiones (u16) | descartes (u16) | rssi (i8) |
+//             rssi_medio (i8) | antiguedad (u32)
+
+#ifndef PASARELA_BROKER
+#define PASARELA_BROKER             "2001:db8:a::1"
+#endif
+#define PASARELA_BROKER_PUERTO      (1885U)
+#define PASARELA_PUERTO             (1885U)     // Donde escuchan los nodos
+#define PASARELA_PUERTO_SUBIDA      (1886U)     // Cliente hacia el broker
+#define PASARELA_ID                 "router_borde"
+#define PASARELA_TEMA_LOTE          "pasarela/lote"
+#define PASARELA_TEMA_VECINOS       "pasarela/vecinos"
+
+#define PASARELA_LOTE_VERSION       (1U)
+#define PASARELA_TAM_CABECERA       (6U)
+#ifndef PASARELA_INTERVALO_MS
+#define PASARELA_INTERVALO_MS       (2000U)
+#endif
+#define PASARELA_TAM_LOTE           (480U)
+#define PASARELA_LOTES_PENDIENTES   (16U)
+#ifndef PASARELA_PERIODO_VECINOS_MS
+#define PASARELA_PERIODO_VECINOS_MS (60000U)
+#endif
+#define PASARELA_TAM_VECINO         (28U)
+
+#define PASARELA_MAX_VECINOS        (16U)
+#define PASARELA_MAX_TEMAS          (48U)
+#define PASARELA_LONGITUD_TEMA      (48U)
+#define PASARELA_MAX_SUSCRIPCIONES  (16U)
+#define PASARELA_MAX_CLIENTES       (2 * PASARELA_MAX_VECINOS)
+#define PASARELA_MSG_RECIENTES      (8U)        // Al menos la ventana del publicador fiable
+
+typedef struct {
+    uint32_t recibidos;             // PUBLISH de los nodos añadidos a un lote
+    uint32_t rechazados;            // PUBLISH con tema desconocido o demasiado grandes
+    uint32_t repetidos;             // Reenvíos de PUBLISH ya en un lote, solo confirmados
+    uint32_t lotes_enviados;
+    uint32_t lotes_descartados;     // Perdidos por llenarse el buffer durante un corte
+    uint32_t fallos_subida;
+    uint32_t reenviados;            // Mensajes del broker entregados a los nodos
+    unsigned lotes_pendientes;
+    unsigned vecinos;
+    unsigned temas;
+    bool conectada;
+} pasarela_stats_t;
+
+// Tráfico de un nodo vecino visto por la pasarela. El enlace del ESP32 solo da
+// RSSI (no LQI); las retransmisiones son PUBLISH con la bandera DUP y los
+// descartes, paquetes malformados o mensajes rechazados.
+#define PASARELA_RSSI_AUSENTE       INT8_MIN
+
+typedef struct {
+    ipv6_addr_t direccion;
+    uint16_t id_nodo;           // De sus temas (nodo_<N>); 0 si aún no se conoce
+    bool sesion;                // Conectado con sesión limpia desde el arranque
+    uint32_t paquetes;
+    uint32_t bytes;
+    uint16_t retransmisiones;
+    uint16_t descartes;
+    int8_t rssi;                // Último valor, en dBm
+    int8_t rssi_medio;          // Media exponencial con peso 1/8
+    uint32_t ultima_vez;        // Segundos desde el arranque del router
+} pasarela_vecino_t;
+
+// Arranca el cliente hacia el broker y los hilos de recepción y subida
+int pasarela_iniciar(void);
+
+// Copia las estadísticas actuales
+void pasarela_stats(pasarela_stats_t *stats);
+
+// Copia hasta max entradas de la tabla de vecinos; devuelve cuántas copió
+unsigned pasarela_vecinos(pasarela_vecino_t *tabla, unsigned max);
+
+#endif
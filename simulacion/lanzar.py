@@ -0,0 +1,290 @@
+#!/usr/bin/env python3
+"""Prueba de carga con nodos simulados en la placa native de RIOT.
+
+Lanza N instancias de nodo_dht11 y nodo_hw080 (compiladas con BOARD=native,
+que activa SIMULACION) sobre interfaces tap y mide lo que llega a la base de
+datos a través de app.py: filas por segundo, pérdida y latencia de extremo a
+extremo (marca de la lectura en el nodo frente a received_at).
+
+Requisitos en el equipo:
+  - Interfaces tap en el puente tapbr0 (tapsetup -c N, o --preparar-red) con
+    2001:db8:a::1/64 y radvd anunciando 2001:db8:a::/64 para que los nodos
+    tengan dirección global
+  - Un gateway MQTT-SN escuchando en [2001:db8:a::1]:1885 conectado a
+    mosquitto en localhost:1883
+  - app.py en marcha con hora_muestra.sql aplicado (columna received_at)
+
+Este script responde al servicio de hora del router (router_borde/hora.h)
+en el puerto 12346 del equipo, así que los nodos deben compilarse con
+DIRECCION_HORA=2001:db8:a::1 (--compilar lo hace).
+
+Ejemplo:
+  sudo ./lanzar.py --compilar --preparar-red -n 50 200 1000 --intervalo 10 --duracion 300
+"""
+
+import argparse
+import json
+import os
+import re
+import socket
+import struct
+import subprocess
+import threading
+import time
+from datetime import datetime
+
+import mysql.connector
+
+RAIZ = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+FIRMWARES = {
+    'dht11': ('nodo_dht11', 'dht11_data'),
+    'hw080': ('nodo_hw080', 'hw080_data'),
+}
+BINARIO = os.path.join('bin', 'native', 'emcute_mqttsn.elf')
+
+DIRECCION_HOST = '2001:db8:a::1'
+PUENTE = 'tapbr0'
+
+# Servicio de hora (router_borde/hora.h)
+HORA_PUERTO = 12346
+HORA_VERSION = 1
+HORA_SINCRONIZADA = 1
+HORA_PETICION = struct.Struct('<BI')        # version, origen
+HORA_RESPUESTA = struct.Struct('<BBIQ')     # version, estado, origen, unix_ms
+
+ENCOLADAS = re.compile(r'Encoladas: (\d+), enviadas: (\d+), descartadas: (\d+)')
+EN_COLA = re.compile(r'Cola: (\d+)/\d+ muestras')
+
+
+def compilar(args):
+    for firmware in args.firmware:
+        directorio = os.path.join(RAIZ, FIRMWARES[firmware][0])
+        orden = ['make', '-C', directorio, 'BOARD=native', f'DIRECCION_HORA={DIRECCION_HOST}',
+                 f'DIRECCION_BROKER={DIRECCION_HOST}', f'MODO_COMPACTO={args.compacto}',
+                 f'MODO_FIABLE={args.fiable}', f'-j{os.cpu_count()}']
+        print(' '.join(orden))
+        subprocess.run(orden, check=True)
+
+
+def preparar_red(riotbase, num_taps):
+    tapsetup = os.path.join(riotbase, 'dist', 'tools', 'tapsetup', 'tapsetup')
+    subprocess.run([tapsetup, '-d'], check=False)
+    subprocess.run([tapsetup, '-c', str(num_taps)], check=True)
+    subprocess.run(['ip', '-6', 'addr', 'add', f'{DIRECCION_HOST}/64', 'dev', PUENTE], check=False)
+    print(f"Red preparada: {num_taps} taps en {PUENTE}; arranque radvd con el prefijo "
+          "2001:db8:a::/64 en ese puente si no lo está ya")
+
+
+def servidor_hora(parar):
+    """Responde como el router de borde, con la hora del equipo."""
+    sock = socket.socket(socket.AF_INET6, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('::', HORA_PUERTO))
+    sock.settimeout(0.5)
+    while not parar.is_set():
+        try:
+            peticion, origen = sock.recvfrom(64)
+        except socket.timeout:
+            continue
+        if len(peticion) != HORA_PETICION.size:
+            continue
+        version, marca = HORA_PETICION.unpack(peticion)
+        if version != HORA_VERSION:
+            continue
+        sock.sendto(HORA_RESPUESTA.pack(HORA_VERSION, HORA_SINCRONIZADA, marca,
+                                        int(time.time() * 1000)), origen)
+    sock.close()
+
+
+class Instancia:
+    def __init__(self, firmware, id_nodo, tap, args, registros):
+        self.firmware = firmware
+        self.id_nodo = id_nodo
+        self.log = os.path.join(registros, f'nodo_{id_nodo}.log')
+        entorno = dict(os.environ, NODO_ID=str(id_nodo), SIM_INTERVALO_S=str(args.intervalo))
+        if args.traza:
+            entorno['SIM_TRAZA'] = os.path.abspath(args.traza)
+        binario = os.path.join(RAIZ, FIRMWARES[firmware][0], BINARIO)
+        self.salida = open(self.log, 'w')
+        self.proceso = subprocess.Popen([binario, tap], env=entorno, stdin=subprocess.PIPE,
+                                        stdout=self.salida, stderr=subprocess.STDOUT)
+
+    def orden(self, linea):
+        try:
+            self.proceso.stdin.write((linea + '\n').encode())
+            self.proceso.stdin.flush()
+        except (BrokenPipeError, OSError):
+            pass
+
+    def contadores(self):
+        """Últimos contadores de la cola impresos por el comando 'cola'."""
+        with open(self.log, errors='replace') as f:
+            texto = f.read()
+        encoladas = ENCOLADAS.findall(texto)
+        en_cola = EN_COLA.findall(texto)
+        if not encoladas:
+            return None
+        encoladas, enviadas, descartadas = (int(v) for v in encoladas[-1])
+        return {'encoladas': encoladas, 'enviadas': enviadas, 'descartadas': descartadas,
+                'en_cola': int(en_cola[-1]) if en_cola else 0}
+
+    def terminar(self):
+        self.proceso.terminate()
+        try:
+            self.proceso.wait(timeout=5)
+        except subprocess.TimeoutExpired:
+            self.proceso.kill()
+        self.salida.close()
+
+
+def percentil(valores, p):
+    if not valores:
+        return None
+    ordenados = sorted(valores)
+    return ordenados[min(len(ordenados) - 1, int(p / 100.0 * len(ordenados)))]
+
+
+def consultar_base(args, inicio, ids):
+    """Filas recibidas por cada nodo desde el inicio de la etapa y sus latencias."""
+    db = mysql.connector.connect(host=args.db_host, user=args.db_usuario,
+                                 password=args.db_clave, database=args.db_nombre)
+    cursor = db.cursor()
+    filas = {}
+    latencias = []
+    marcas = ', '.join(['%s'] * len(ids))
+    for firmware in args.firmware:
+        tabla = FIRMWARES[firmware][1]
+        cursor.execute(f"SELECT node_number, TIMESTAMPDIFF(SECOND, timestamp, received_at) "
+                       f"FROM {tabla} WHERE received_at >= %s AND node_number IN ({marcas})",
+                       (inicio, *ids))
+        for nodo, latencia in cursor.fetchall():
+            filas[nodo] = filas.get(nodo, 0) + 1
+            if latencia is not None:
+                latencias.append(latencia)
+    cursor.close()
+    db.close()
+    return filas, latencias
+
+
+def etapa(args, num_nodos, registros, id_base):
+    print(f"\n=== {num_nodos} nodos ===")
+    directorio = os.path.join(registros, f'{num_nodos}_nodos')
+    os.makedirs(directorio, exist_ok=True)
+
+    inicio = datetime.now().replace(microsecond=0)
+    instancias = []
+    escalonado = args.escalonado if args.escalonado is not None else args.intervalo
+    for i in range(num_nodos):
+        firmware = args.firmware[i % len(args.firmware)]
+        instancias.append(Instancia(firmware, id_base + i, f'tap{i}', args, directorio))
+        # Arranques repartidos para que los nodos no muestreen todos a la vez
+        time.sleep(escalonado / num_nodos)
+    print(f"{num_nodos} instancias en marcha, midiendo durante {args.duracion} s")
+    time.sleep(args.duracion)
+
+    for instancia in instancias:
+        instancia.orden('cola')
+    time.sleep(2)
+    contadores = {i.id_nodo: i.contadores() for i in instancias}
+    for instancia in instancias:
+        instancia.terminar()
+    fin = datetime.now()
+
+    # Lo que ya estaba en camino termina de llegar a la base
+    time.sleep(args.espera_final)
+    filas, latencias = consultar_base(args, inicio, [i.id_nodo for i in instancias])
+
+    encoladas = sum(c['encoladas'] for c in contadores.values() if c)
+    en_cola = sum(c['en_cola'] for c in contadores.values() if c)
+    descartadas = sum(c['descartadas'] for c in contadores.values() if c)
+    recibidas = sum(filas.values())
+    duracion = (fin - inicio).total_seconds()
+    resultado = {
+        'nodos': num_nodos,
+        'sin_contadores': sum(1 for c in contadores.values() if c is None),
+        'sin_filas': sum(1 for i in instancias if i.id_nodo not in filas),
+        'duracion_s': round(duracion, 1),
+        'encoladas': encoladas,
+        'en_cola_al_final': en_cola,
+        'descartadas_en_nodo': descartadas,
+        'filas': recibidas,
+        'ofrecidas_por_s': round(encoladas / duracion, 2),
+        'filas_por_s': round(recibidas / duracion, 2),
+        'perdida': round(1 - recibidas / encoladas, 4) if encoladas else None,
+        'latencia_s': {
+            'p50': percentil(latencias, 50),
+            'p90': percentil(latencias, 90),
+            'p99': percentil(latencias, 99),
+            'max': max(latencias) if latencias else None,
+        },
+    }
+    print(json.dumps(resultado, indent=2))
+    return resultado
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('-n', '--nodos', type=int, nargs='+', default=[50, 200, 1000],
+                        help="Número de nodos de cada etapa (se ejecutan en orden)")
+    parser.add_argument('--firmware', nargs='+', choices=FIRMWARES, default=list(FIRMWARES),
+                        help="Firmwares a lanzar; con varios se reparten los nodos entre ellos")
+    parser.add_argument('--intervalo', type=int, default=10, help="Segundos entre muestras de cada nodo")
+    parser.add_argument('--duracion', type=int, default=300, help="Segundos de medida por etapa")
+    parser.add_argument('--escalonado', type=float, default=None,
+                        help="Segundos para arrancar todas las instancias (por defecto, el intervalo)")
+    parser.add_argument('--espera-final', type=int, default=10,
+                        help="Segundos de espera tras parar los nodos antes de contar filas")
+    parser.add_argument('--traza', help="CSV con la traza a reproducir (ver simulacion.h)")
+    parser.add_argument('--id-base', type=int, default=1000, help="Número del primer nodo simulado; cada etapa sigue tras la anterior")
+    parser.add_argument('--compilar', action='store_true', help="Compilar los firmwares para native antes")
+    parser.add_argument('--compacto', type=int, choices=(0, 1), default=1, help="MODO_COMPACTO al compilar")
+    parser.add_argument('--fiable', type=int, choices=(0, 1), default=0, help="MODO_FIABLE al compilar")
+    parser.add_argument('--preparar-red', action='store_true',
+                        help="Crear las interfaces tap con tapsetup (requiere root)")
+    parser.add_argument('--riotbase', default=os.path.join(RAIZ, '..'), help="Directorio de RIOT")
+    parser.add_argument('--registros', default=os.path.join(RAIZ, 'simulacion', 'registros'),
+                        help="Directorio para la salida de cada nodo y el informe")
+    parser.add_argument('--db-host', default='localhost')
+    parser.add_argument('--db-usuario', default='user')
+    parser.add_argument('--db-clave', default='password')
+    parser.add_argument('--db-nombre', default='proyecto_iot')
+    args = parser.parse_args()
+
+    if args.compilar:
+        compilar(args)
+    if args.preparar_red:
+        preparar_red(args.riotbase, max(args.nodos))
+
+    parar = threading.Event()
+    hilo_hora = threading.Thread(target=servidor_hora, args=(parar,), daemon=True)
+    hilo_hora.start()
+
+    os.makedirs(args.registros, exist_ok=True)
+    resultados = []
+    # Cada etapa usa números de nodo nuevos: las filas de la anterior que
+    # lleguen tarde no cuentan en la siguiente
+    id_base = args.id_base
+    try:
+        for num_nodos in args.nodos:
+            resultados.append(etapa(args, num_nodos, args.registros, id_base))
+            id_base += num_nodos
+    finally:
+        parar.set()
+
+    informe = os.path.join(args.registros, f"informe_{datetime.now():%Y%m%d_%H%M%S}.json")
+    with open(informe, 'w') as f:
+        json.dump({'intervalo_s': args.intervalo, 'firmware': args.firmware,
+                   'compacto': args.compacto, 'fiable': args.fiable, 'etapas': resultados}, f, indent=2)
+    print(f"\nInforme guardado en {informe}")
+    print(f"{'nodos':>6} {'ofrecidas/s':>12} {'filas/s':>9} {'pérdida':>8} {'p50':>5} {'p90':>5} {'p99':>5}")
+    for r in resultados:
+        lat = r['latencia_s']
+        print(f"{r['nodos']:>6} {r['ofrecidas_por_s']:>12} {r['filas_por_s']:>9} "
+              f"{r['perdida'] if r['perdida'] is not None else '-':>8} "
+              f"{lat['p50'] if lat['p50'] is not None else '-':>5} "
+              f"{lat['p90'] if lat['p90'] is not None else '-':>5} "
+              f"{lat['p99'] if lat['p99'] is not None else '-':>5}")
+
+
+if __name__ == '__main__':
+    main()